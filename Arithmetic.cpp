@@ -0,0 +1,422 @@
+#include "Arithmetic.h"
+#include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+    inline bool isNameStart(char c) {
+        return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+    }
+    
+    inline bool isNameChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+    
+    inline bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+    
+    /**
+     * A binary operator and how tightly it binds (higher: tighter)
+     * Operators sharing a prefix are listed longest first.
+     */
+    struct BinaryOperator {
+        const char* text;
+        int precedence;
+        ArithOp::Code code;
+    };
+    
+    const BinaryOperator binaryOperators[] = {
+        {"||", 1, ArithOp::OrJump},
+        {"&&", 2, ArithOp::AndJump},
+        {"==", 6, ArithOp::Equal},
+        {"!=", 6, ArithOp::NotEqual},
+        {"<=", 7, ArithOp::LessEqual},
+        {">=", 7, ArithOp::GreaterEqual},
+        {"<<", 8, ArithOp::ShiftLeft},
+        {">>", 8, ArithOp::ShiftRight},
+        {"**", 11, ArithOp::Power},
+        {"|", 3, ArithOp::BitOr},
+        {"^", 4, ArithOp::BitXor},
+        {"&", 5, ArithOp::BitAnd},
+        {"<", 7, ArithOp::Less},
+        {">", 7, ArithOp::Greater},
+        {"+", 9, ArithOp::Add},
+        {"-", 9, ArithOp::Subtract},
+        {"*", 10, ArithOp::Multiply},
+        {"/", 10, ArithOp::Divide},
+        {"%", 10, ArithOp::Remainder},
+    };
+    
+    /**
+     * Assignment operators; plain `=` has no operation of its own
+     */
+    struct AssignOperator {
+        const char* text;
+        ArithOp::Code code;
+        bool compound;
+    };
+    
+    const AssignOperator assignOperators[] = {
+        {"<<=", ArithOp::ShiftLeft, true},
+        {">>=", ArithOp::ShiftRight, true},
+        {"+=", ArithOp::Add, true},
+        {"-=", ArithOp::Subtract, true},
+        {"*=", ArithOp::Multiply, true},
+        {"/=", ArithOp::Divide, true},
+        {"%=", ArithOp::Remainder, true},
+        {"&=", ArithOp::BitAnd, true},
+        {"^=", ArithOp::BitXor, true},
+        {"|=", ArithOp::BitOr, true},
+        {"=", ArithOp::Store, false},
+    };
+    
+    /**
+     * Convert a constant's digits (no sign, no blanks)
+     */
+    bool parseLiteral(std::string_view digits, int64_t& value) {
+        if (digits.empty()) {
+            return false;
+        }
+        unsigned base = 10;
+        size_t i = 0;
+        if (digits.size() > 1 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+            base = 16;
+            i = 2;
+            if (digits.size() == 2) {
+                return false;
+            }
+        } else if (digits.size() > 1 && digits[0] == '0') {
+            base = 8;
+            i = 1;
+        }
+        
+        // Overflow wraps, as in the other shells
+        uint64_t result = 0;
+        for (; i < digits.size(); i++) {
+            char c = digits[i];
+            unsigned digit = std::isdigit(static_cast<unsigned char>(c)) ? c - '0' :
+                             std::isxdigit(static_cast<unsigned char>(c)) ? std::tolower(c) - 'a' + 10 : 99;
+            if (digit >= base) {
+                return false;
+            }
+            result = result * base + digit;
+        }
+        value = static_cast<int64_t>(result);
+        return true;
+    }
+    
+    /**
+     * Recursive-descent parser with precedence climbing for the binary
+     * operators, emitting code as it goes
+     */
+    class Compiler {
+    private:
+        std::string_view source;
+        size_t pos;
+        std::vector<ArithOp>& code;
+        std::vector<char>& names;
+        size_t base;        // Index of the expression's first operation
+        
+        void skipBlanks() {
+            while (pos < source.size() && isBlank(source[pos])) {
+                pos++;
+            }
+        }
+        
+        bool next(const char* text) {
+            skipBlanks();
+            return source.compare(pos, std::strlen(text), text) == 0;
+        }
+        
+        size_t here() const { return code.size() - base; }
+        
+        size_t emit(ArithOp::Code op, int64_t value = 0) {
+            code.push_back(ArithOp{op, 0, 0, value});
+            return here() - 1;
+        }
+        
+        void emitName(ArithOp::Code op, std::string_view name) {
+            code.push_back(ArithOp{op, static_cast<uint32_t>(names.size()),
+                                   static_cast<uint32_t>(name.size()), 0});
+            names.insert(names.end(), name.begin(), name.end());
+        }
+        
+        void patch(size_t jump) {
+            code[base + jump].offset = static_cast<uint32_t>(here());
+        }
+        
+        size_t nameEnd(size_t start) const {
+            while (start < source.size() && isNameChar(source[start])) {
+                start++;
+            }
+            return start;
+        }
+        
+        bool fail(const char* message) {
+            std::string_view rest = source.substr(std::min(pos, source.size()));
+            while (!rest.empty() && isBlank(rest.back())) {
+                rest.remove_suffix(1);
+            }
+            std::cerr << "MyShell: " << source << ": " << message;
+            if (!rest.empty()) {
+                std::cerr << " (error token is \"" << rest << "\")";
+            }
+            std::cerr << "\n";
+            return false;
+        }
+        
+        bool parseComma() {
+            if (!parseAssign()) {
+                return false;
+            }
+            while (next(",")) {
+                pos++;
+                emit(ArithOp::Pop);
+                if (!parseAssign()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        
+        bool parseAssign() {
+            skipBlanks();
+            size_t start = pos;
+            if (pos < source.size() && isNameStart(source[pos])) {
+                size_t end = nameEnd(pos);
+                std::string_view name = source.substr(pos, end - pos);
+                pos = end;
+                skipBlanks();
+                for (const AssignOperator& op : assignOperators) {
+                    size_t length = std::strlen(op.text);
+                    if (source.compare(pos, length, op.text) != 0) {
+                        continue;
+                    }
+                    if (!op.compound && pos + 1 < source.size() && source[pos + 1] == '=') {
+                        break;      // ==
+                    }
+                    pos += length;
+                    if (op.compound) {
+                        emitName(ArithOp::Load, name);
+                    }
+                    if (!parseAssign()) {
+                        return false;
+                    }
+                    if (op.compound) {
+                        emit(op.code);
+                    }
+                    emitName(ArithOp::Store, name);
+                    return true;
+                }
+                pos = start;
+            }
+            return parseConditional();
+        }
+        
+        bool parseConditional() {
+            if (!parseBinary(1)) {
+                return false;
+            }
+            if (!next("?")) {
+                return true;
+            }
+            pos++;
+            size_t skipThen = emit(ArithOp::JumpIfZero);
+            if (!parseComma()) {
+                return false;
+            }
+            if (!next(":")) {
+                return fail("syntax error: `:' expected for conditional expression");
+            }
+            pos++;
+            size_t skipElse = emit(ArithOp::Jump);
+            patch(skipThen);
+            if (!parseAssign()) {
+                return false;
+            }
+            patch(skipElse);
+            return true;
+        }
+        
+        bool parseBinary(int minPrecedence) {
+            if (!parseUnary()) {
+                return false;
+            }
+            for (;;) {
+                skipBlanks();
+                const BinaryOperator* found = nullptr;
+                for (const BinaryOperator& op : binaryOperators) {
+                    if (source.compare(pos, std::strlen(op.text), op.text) == 0) {
+                        found = &op;
+                        break;
+                    }
+                }
+                if (!found || found->precedence < minPrecedence) {
+                    return true;
+                }
+                pos += std::strlen(found->text);
+                
+                if (found->code == ArithOp::AndJump || found->code == ArithOp::OrJump) {
+                    // The right side only runs if the left one does not decide
+                    size_t jump = emit(found->code);
+                    if (!parseBinary(found->precedence + 1)) {
+                        return false;
+                    }
+                    emit(ArithOp::ToBool);
+                    patch(jump);
+                } else {
+                    // ** groups to the right, everything else to the left
+                    int rightPrecedence = found->code == ArithOp::Power ? found->precedence
+                                                                        : found->precedence + 1;
+                    if (!parseBinary(rightPrecedence)) {
+                        return false;
+                    }
+                    emit(found->code);
+                }
+            }
+        }
+        
+        bool parseUnary() {
+            skipBlanks();
+            if (next("++") || next("--")) {
+                ArithOp::Code op = source[pos] == '+' ? ArithOp::PreIncrement : ArithOp::PreDecrement;
+                pos += 2;
+                skipBlanks();
+                if (pos >= source.size() || !isNameStart(source[pos])) {
+                    return fail("syntax error: operand expected");
+                }
+                size_t end = nameEnd(pos);
+                emitName(op, source.substr(pos, end - pos));
+                pos = end;
+                return true;
+            }
+            if (pos < source.size() && std::strchr("+-!~", source[pos]) && source[pos] != '\0') {
+                char op = source[pos++];
+                if (!parseUnary()) {
+                    return false;
+                }
+                if (op != '+') {
+                    emit(op == '-' ? ArithOp::Negate : op == '!' ? ArithOp::Not : ArithOp::Complement);
+                }
+                return true;
+            }
+            return parsePrimary();
+        }
+        
+        bool parsePrimary() {
+            skipBlanks();
+            if (pos >= source.size()) {
+                return fail("syntax error: operand expected");
+            }
+            char c = source[pos];
+            
+            if (c == '(') {
+                pos++;
+                if (!parseComma()) {
+                    return false;
+                }
+                if (!next(")")) {
+                    return fail("missing `)'");
+                }
+                pos++;
+                return true;
+            }
+            
+            if (std::isdigit(static_cast<unsigned char>(c))) {
+                size_t end = nameEnd(pos);
+                int64_t value;
+                if (!parseLiteral(source.substr(pos, end - pos), value)) {
+                    return fail("value too great for base");
+                }
+                pos = end;
+                emit(ArithOp::Number, value);
+                return true;
+            }
+            
+            // A variable, with or without its '$'; $1, $# and the like too
+            size_t start = pos;
+            size_t end;
+            if (c == '$' && pos + 1 < source.size() &&
+                (std::isdigit(static_cast<unsigned char>(source[pos + 1])) ||
+                 source[pos + 1] == '#' || source[pos + 1] == '?')) {
+                start = pos + 1;
+                end = std::isdigit(static_cast<unsigned char>(source[start])) ? nameEnd(start) : start + 1;
+            } else {
+                if (c == '$') {
+                    start++;
+                }
+                if (start >= source.size() || !isNameStart(source[start])) {
+                    pos = start;
+                    return fail("syntax error: operand expected");
+                }
+                end = nameEnd(start);
+            }
+            std::string_view name = source.substr(start, end - start);
+            pos = end;
+            
+            if (next("++") || next("--")) {
+                emitName(source[pos] == '+' ? ArithOp::PostIncrement : ArithOp::PostDecrement, name);
+                pos += 2;
+            } else {
+                emitName(ArithOp::Load, name);
+            }
+            return true;
+        }
+    
+    public:
+        Compiler(std::string_view expression, std::vector<ArithOp>& out, std::vector<char>& nameText)
+            : source(expression), pos(0), code(out), names(nameText), base(out.size()) {}
+        
+        bool compile() {
+            skipBlanks();
+            if (pos == source.size()) {
+                // An empty expression is 0
+                emit(ArithOp::Number, 0);
+                return true;
+            }
+            if (!parseComma()) {
+                return false;
+            }
+            skipBlanks();
+            if (pos != source.size()) {
+                return fail("syntax error in expression");
+            }
+            return true;
+        }
+    };
+}
+
+bool Arithmetic::compile(std::string_view expression, std::vector<ArithOp>& code,
+                         std::vector<char>& names) {
+    size_t codeSize = code.size();
+    size_t namesSize = names.size();
+    if (!Compiler(expression, code, names).compile()) {
+        code.resize(codeSize);
+        names.resize(namesSize);
+        return false;
+    }
+    return true;
+}
+
+bool Arithmetic::parseNumber(std::string_view text, int64_t& value) {
+    while (!text.empty() && isBlank(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && isBlank(text.back())) {
+        text.remove_suffix(1);
+    }
+    bool negative = false;
+    if (!text.empty() && (text[0] == '-' || text[0] == '+')) {
+        negative = text[0] == '-';
+        text.remove_prefix(1);
+    }
+    if (!parseLiteral(text, value)) {
+        return false;
+    }
+    if (negative) {
+        value = static_cast<int64_t>(0 - static_cast<uint64_t>(value));
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef ARITHMETIC_H
+#define ARITHMETIC_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/**
+ * One operation of a compiled arithmetic expression
+ * Expressions run on a stack of 64-bit integers. Names are stored outside
+ * the operations (offset/length into a text buffer) and jump targets are
+ * relative to the expression's first operation, so compiled code can be
+ * copied between buffers as it is.
+ */
+struct ArithOp {
+    enum Code : uint8_t {
+        Number,             // Push value
+        Load,               // Push the variable's value (unset or empty: 0)
+        Store,              // Assign the top of the stack to the variable (kept)
+        PreIncrement,       // ++name, --name, name++, name--
+        PreDecrement,
+        PostIncrement,
+        PostDecrement,
+        Negate,             // Unary operators on the top of the stack
+        Not,
+        Complement,
+        Power,              // Binary operators: pop right, pop left, push result
+        Multiply,
+        Divide,
+        Remainder,
+        Add,
+        Subtract,
+        ShiftLeft,
+        ShiftRight,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Equal,
+        NotEqual,
+        BitAnd,
+        BitXor,
+        BitOr,
+        AndJump,            // &&: if the top is 0, jump to target (keeping 0), else pop
+        OrJump,             // ||: if the top is non-zero, make it 1 and jump, else pop
+        ToBool,             // Turn the top into 0 or 1
+        JumpIfZero,         // Pop; jump to target if it was 0
+        Jump,
+        Pop
+    };
+    
+    Code code;
+    uint32_t offset;        // Name start, or jump target
+    uint32_t length;        // Name length
+    int64_t value;          // Number
+};
+
+/**
+ * Arithmetic compiles $(( )) and `let` expressions
+ * Responsibilities:
+ * - Parse integer expressions by precedence climbing, with the C operator
+ *   set the shell uses: arithmetic, bitwise, comparison, logical (short
+ *   circuit), ?:, assignment operators, ++/-- and the comma operator
+ * - Emit them as stack code, so evaluating again costs no parsing
+ *
+ * Evaluation needs the shell's variables and lives in CommandParser.
+ */
+class Arithmetic {
+public:
+    /**
+     * Compile an expression
+     * @param expression The expression text
+     * @param code Receives the operations (appended)
+     * @param names Receives the names the operations refer to (appended)
+     * @return true if successful, false on a syntax error (already reported)
+     */
+    static bool compile(std::string_view expression, std::vector<ArithOp>& code,
+                        std::vector<char>& names);
+    
+    /**
+     * Parse an integer constant as an expression would (decimal, 0x hex,
+     * 0 octal), allowing surrounding blanks
+     * @param text The text
+     * @param value Receives the value
+     * @return false if the text is not a constant
+     */
+    static bool parseNumber(std::string_view text, int64_t& value);
+};
+
+#endif // ARITHMETIC_H
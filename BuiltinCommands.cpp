@@ -1,71 +1,275 @@
 #include "BuiltinCommands.h"
 #include "Shell.h"
+#include "Tracer.h"
+#include "TestExpression.h"
 #include <iostream>
 #include <unistd.h>
 #include <cstdlib>
 #include <climits>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <charconv>
+#include <cctype>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <dlfcn.h>
 
-BuiltinCommands::BuiltinCommands(Shell* shellInstance) : shell(shellInstance) {
+namespace {
+    /**
+     * Check whether a word can name a variable
+     */
+    bool isIdentifier(std::string_view word) {
+        if (word.empty() || std::isdigit(static_cast<unsigned char>(word[0]))) {
+            return false;
+        }
+        return std::all_of(word.begin(), word.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        });
+    }
+    
+    /**
+     * Parse a non-negative count or descriptor given to an option
+     * @return false if it is not a number
+     */
+    bool parseCount(std::string_view text, size_t& value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+}
+
+BuiltinCommands::BuiltinCommands(Shell* shellInstance) 
+    : shell(shellInstance), status(0), input(&std::cin), output(&std::cout), inputFd(-1), outputFd(-1),
+      table(INITIAL_TABLE_SIZE), tableCount(0) {
     registerCommands();
 }
 
+BuiltinCommands::~BuiltinCommands() {
+    // One dlopen() per loaded name, so one dlclose() each
+    for (const Builtin& builtin : table) {
+        if (builtin.library) {
+            dlclose(builtin.library);
+        }
+    }
+}
+
 void BuiltinCommands::registerCommands() {
-    commands["exit"] = [this](const std::vector<std::string>& args) { exitCommand(args); };
-    commands["cd"] = [this](const std::vector<std::string>& args) { cdCommand(args); };
-    commands["pwd"] = [this](const std::vector<std::string>& args) { pwdCommand(args); };
-    commands["echo"] = [this](const std::vector<std::string>& args) { echoCommand(args); };
-    commands["export"] = [this](const std::vector<std::string>& args) { exportCommand(args); };
-    commands["unset"] = [this](const std::vector<std::string>& args) { unsetCommand(args); };
-    commands["history"] = [this](const std::vector<std::string>& args) { historyCommand(args); };
-    commands["help"] = [this](const std::vector<std::string>& args) { helpCommand(args); };
-    commands["jobs"] = [this](const std::vector<std::string>& args) { jobsCommand(args); };
-    commands["fg"] = [this](const std::vector<std::string>& args) { fgCommand(args); };
+    static const struct {
+        const char* name;
+        Method method;
+    } compiledIn[] = {
+        {"exit", &BuiltinCommands::exitCommand},
+        {"cd", &BuiltinCommands::cdCommand},
+        {"pwd", &BuiltinCommands::pwdCommand},
+        {"echo", &BuiltinCommands::echoCommand},
+        {"export", &BuiltinCommands::exportCommand},
+        {"unset", &BuiltinCommands::unsetCommand},
+        {"history", &BuiltinCommands::historyCommand},
+        {"help", &BuiltinCommands::helpCommand},
+        {"jobs", &BuiltinCommands::jobsCommand},
+        {"fg", &BuiltinCommands::fgCommand},
+        {"hash", &BuiltinCommands::hashCommand},
+        {"launcher", &BuiltinCommands::launcherCommand},
+        {"pipesize", &BuiltinCommands::pipesizeCommand},
+        {"time", &BuiltinCommands::timeCommand},
+        {"parallel", &BuiltinCommands::parallelCommand},
+        {"cat", &BuiltinCommands::catCommand},
+        {"trace", &BuiltinCommands::traceCommand},
+        {"true", &BuiltinCommands::trueCommand},
+        {":", &BuiltinCommands::trueCommand},
+        {"false", &BuiltinCommands::falseCommand},
+        {"let", &BuiltinCommands::letCommand},
+        {"test", &BuiltinCommands::testCommand},
+        {"[", &BuiltinCommands::testCommand},
+        {"[[", &BuiltinCommands::conditionCommand},
+        {"read", &BuiltinCommands::readCommand},
+        {"mapfile", &BuiltinCommands::mapfileCommand},
+        {"readarray", &BuiltinCommands::mapfileCommand},
+        {"enable", &BuiltinCommands::enableCommand},
+    };
+    for (const auto& builtin : compiledIn) {
+        addBuiltin(builtin.name).method = builtin.method;
+    }
+}
+
+size_t BuiltinCommands::hashName(std::string_view name) {
+    // FNV-1a: names are short, so a simple byte loop is enough
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
 }
 
-bool BuiltinCommands::isBuiltin(const std::string& command) const {
-    return commands.find(command) != commands.end();
+const BuiltinCommands::Builtin* BuiltinCommands::findBuiltin(std::string_view name) const {
+    const size_t mask = table.size() - 1;
+    for (size_t slot = hashName(name) & mask; !table[slot].name.empty(); slot = (slot + 1) & mask) {
+        if (table[slot].name == name) {
+            return &table[slot];
+        }
+    }
+    return nullptr;
 }
 
-bool BuiltinCommands::execute(const std::vector<std::string>& args) {
-    if (args.empty()) return false;
+BuiltinCommands::Builtin& BuiltinCommands::addBuiltin(std::string_view name) {
+    const Builtin* existing = findBuiltin(name);
+    if (existing) {
+        return const_cast<Builtin&>(*existing);
+    }
     
-    auto it = commands.find(args[0]);
-    if (it != commands.end()) {
-        it->second(args);
-        return true;
+    // Keep the table at most half full, so probe runs stay short
+    if ((tableCount + 1) * 2 > table.size()) {
+        std::vector<Builtin> old(table.size() * 2);
+        old.swap(table);
+        tableCount = 0;
+        for (Builtin& entry : old) {
+            if (!entry.name.empty()) {
+                Builtin& moved = addBuiltin(entry.name);
+                moved = std::move(entry);
+            }
+        }
     }
     
+    const size_t mask = table.size() - 1;
+    size_t slot = hashName(name) & mask;
+    while (!table[slot].name.empty()) {
+        slot = (slot + 1) & mask;
+    }
+    table[slot].name.assign(name.data(), name.size());
+    tableCount++;
+    return table[slot];
+}
+
+void BuiltinCommands::removeBuiltin(const Builtin& entry) {
+    const size_t mask = table.size() - 1;
+    size_t gap = static_cast<size_t>(&entry - table.data());
+    table[gap] = Builtin();
+    tableCount--;
+    
+    // Without tombstones: move back each later entry of the run whose home
+    // slot does not lie between the gap and where it is now
+    for (size_t slot = (gap + 1) & mask; !table[slot].name.empty(); slot = (slot + 1) & mask) {
+        size_t home = hashName(table[slot].name) & mask;
+        bool stays = gap <= slot ? (gap < home && home <= slot) : (gap < home || home <= slot);
+        if (!stays) {
+            table[gap] = std::move(table[slot]);
+            table[slot] = Builtin();
+            gap = slot;
+        }
+    }
+}
+
+bool BuiltinCommands::isBuiltin(std::string_view command) const {
+    return findBuiltin(command) != nullptr;
+}
+
+bool BuiltinCommands::canCapture(std::string_view command) const {
+    // Builtins that change shell state (cd, export, let, ...) or write to
+    // raw descriptors (cat, parallel) need a subshell
+    static const char* const capturable[] = {
+        "echo", "pwd", "true", ":", "false", "test", "[", "[[", "help"
+    };
+    for (const char* name : capturable) {
+        if (command == name) {
+            return true;
+        }
+    }
     return false;
 }
 
+bool BuiltinCommands::execute(const ArgList& args) {
+    if (args.empty()) return false;
+    
+    const Builtin* builtin = findBuiltin(args[0]);
+    if (!builtin) {
+        return false;
+    }
+    status = 0;
+    if (builtin->method) {
+        (this->*builtin->method)(args);
+    } else {
+        runLoaded(*builtin, args);
+    }
+    return true;
+}
+
+bool BuiltinCommands::execute(const ArgList& args, std::istream& in, int inFd, 
+                              std::ostream& out, int outFd) {
+    input = &in;
+    output = &out;
+    inputFd = inFd;
+    outputFd = outFd;
+    
+    bool found = execute(args);
+    
+    // Bytes read past what the command used go back to a file
+    if (redirectedInput.descriptor() != -1) {
+        redirectedInput.release();
+        redirectedInput.reset(-1);
+    }
+    input = &std::cin;
+    output = &std::cout;
+    inputFd = -1;
+    outputFd = -1;
+    return found;
+}
+
+InputBuffer& BuiltinCommands::inputBuffer(int fd) {
+    if (fd != -1 || inputFd == -1) {
+        return shell->getInput(fd == -1 ? STDIN_FILENO : fd);
+    }
+    if (redirectedInput.descriptor() != inputFd) {
+        redirectedInput.reset(inputFd);
+    }
+    return redirectedInput;
+}
+
 std::vector<std::string> BuiltinCommands::getAvailableCommands() const {
     std::vector<std::string> commandList;
-    for (const auto& pair : commands) {
-        commandList.push_back(pair.first);
+    for (const Builtin& builtin : table) {
+        if (!builtin.name.empty()) {
+            commandList.push_back(builtin.name);
+        }
     }
+    std::sort(commandList.begin(), commandList.end());
     return commandList;
 }
 
-void BuiltinCommands::exitCommand(const std::vector<std::string>& args) {
-    int exitCode = 0;
+void BuiltinCommands::exitCommand(const ArgList& args) {
+    // Without an argument the shell exits with the last command's status
+    int exitCode = std::atoi(shell->getVariables()["?"].c_str());
     
     if (args.size() > 1) {
         try {
-            exitCode = std::stoi(args[1]);
+            exitCode = std::stoi(std::string(args[1]));
         } catch (const std::exception&) {
             std::cerr << "MyShell: exit: numeric argument required\n";
+            status = 1;
             exitCode = 1;
         }
     }
     
-    std::cout << "Exiting MyShell with code " << exitCode << ". Goodbye!\n";
-    shell->shutdown();
-    exit(exitCode);
+    // Only someone at the prompt needs telling; scripts, -c and $( ) keep
+    // their output clean
+    if (shell->isInteractive()) {
+        std::cerr << "Exiting MyShell with code " << exitCode << ". Goodbye!\n";
+    }
+    
+    // The shell stops after this command, so a script or function calling
+    // exit ends too, and the destructors still run
+    status = exitCode;
+    shell->shutdown(exitCode);
 }
 
-void BuiltinCommands::cdCommand(const std::vector<std::string>& args) {
+void BuiltinCommands::cdCommand(const ArgList& args) {
     const char* path = nullptr;
     
     if (args.size() == 1) {
@@ -73,6 +277,7 @@ void BuiltinCommands::cdCommand(const std::vector<std::string>& args) {
         path = getenv("HOME");
         if (!path) {
             std::cerr << "MyShell: cd: HOME not set\n";
+            status = 1;
             return;
         }
     } else if (args.size() == 2) {
@@ -83,13 +288,15 @@ void BuiltinCommands::cdCommand(const std::vector<std::string>& args) {
             path = getenv("OLDPWD");
             if (!path) {
                 std::cerr << "MyShell: cd: OLDPWD not set\n";
+                status = 1;
                 return;
             }
         } else {
-            path = args[1].c_str();
+            path = args[1].data();
         }
     } else {
         std::cerr << "MyShell: cd: too many arguments\n";
+        status = 1;
         return;
     }
     
@@ -97,6 +304,7 @@ void BuiltinCommands::cdCommand(const std::vector<std::string>& args) {
     char oldpwd[PATH_MAX];
     if (getcwd(oldpwd, sizeof(oldpwd)) == nullptr) {
         std::cerr << "MyShell: cd: cannot get current directory\n";
+        status = 1;
         return;
     }
     
@@ -104,6 +312,7 @@ void BuiltinCommands::cdCommand(const std::vector<std::string>& args) {
     if (chdir(path) != 0) {
         std::cerr << "MyShell: cd: cannot change directory to '" << path 
                   << "': " << strerror(errno) << "\n";
+        status = 1;
         return;
     }
     
@@ -117,18 +326,19 @@ void BuiltinCommands::cdCommand(const std::vector<std::string>& args) {
     }
 }
 
-void BuiltinCommands::pwdCommand(const std::vector<std::string>& args) {
+void BuiltinCommands::pwdCommand(const ArgList& args) {
     (void)args; // Suppress unused parameter warning
     
     char cwd[PATH_MAX];
     if (getcwd(cwd, sizeof(cwd)) != nullptr) {
-        std::cout << cwd << "\n";
+        out() << cwd << "\n";
     } else {
         std::cerr << "MyShell: pwd: " << strerror(errno) << "\n";
+        status = 1;
     }
 }
 
-void BuiltinCommands::echoCommand(const std::vector<std::string>& args) {
+void BuiltinCommands::echoCommand(const ArgList& args) {
     bool newline = true;
     size_t start = 1;
     
@@ -140,25 +350,25 @@ void BuiltinCommands::echoCommand(const std::vector<std::string>& args) {
     
     // Print arguments
     for (size_t i = start; i < args.size(); i++) {
-        if (i > start) std::cout << " ";
-        std::cout << args[i];
+        if (i > start) out() << " ";
+        out() << args[i];
     }
     
-    if (newline) std::cout << "\n";
+    if (newline) out() << "\n";
 }
 
-void BuiltinCommands::exportCommand(const std::vector<std::string>& args) {
+void BuiltinCommands::exportCommand(const ArgList& args) {
     if (args.size() < 2) {
         // Show all environment variables
         extern char **environ;
         for (char **env = environ; *env != nullptr; env++) {
-            std::cout << *env << "\n";
+            out() << *env << "\n";
         }
         return;
     }
     
     for (size_t i = 1; i < args.size(); i++) {
-        const std::string& assignment = args[i];
+        std::string assignment(args[i]);
         size_t eq_pos = assignment.find('=');
         
         if (eq_pos != std::string::npos) {
@@ -169,6 +379,11 @@ void BuiltinCommands::exportCommand(const std::vector<std::string>& args) {
             // Set in environment
             setenv(name.c_str(), value.c_str(), 1);
             
+            // Remembered command locations are only valid for the old PATH
+            if (name == "PATH") {
+                shell->getExecutor().getPathCache().clear();
+            }
+            
             // Also set in shell variables
             shell->getVariables()[name] = value;
         } else {
@@ -177,140 +392,1095 @@ void BuiltinCommands::exportCommand(const std::vector<std::string>& args) {
             auto it = vars.find(assignment);
             if (it != vars.end()) {
                 setenv(assignment.c_str(), it->second.c_str(), 1);
+                if (assignment == "PATH") {
+                    shell->getExecutor().getPathCache().clear();
+                }
             } else {
                 std::cerr << "MyShell: export: " << assignment << ": not found\n";
+                status = 1;
             }
         }
     }
 }
 
-void BuiltinCommands::unsetCommand(const std::vector<std::string>& args) {
+void BuiltinCommands::unsetCommand(const ArgList& args) {
     if (args.size() < 2) {
         std::cerr << "MyShell: unset: not enough arguments\n";
+        status = 1;
         return;
     }
     
     for (size_t i = 1; i < args.size(); i++) {
-        const std::string& varName = args[i];
+        std::string varName(args[i]);
         
         // Remove from environment
         unsetenv(varName.c_str());
         
-        // Remove from shell variables
+        // Remove from shell variables, and the elements of an array
         auto& vars = shell->getVariables();
         vars.erase(varName);
+        vars.erase(vars.lower_bound(varName + "["), vars.lower_bound(varName + "\\"));
+        
+        if (varName == "PATH") {
+            shell->getExecutor().getPathCache().clear();
+        }
     }
 }
 
-void BuiltinCommands::historyCommand(const std::vector<std::string>& args) {
-    const auto& history = shell->getHistory();
+void BuiltinCommands::historyCommand(const ArgList& args) {
+    auto& history = shell->getHistory();
+    size_t start = 0;
     
     if (args.size() > 1) {
+        if (args[1] == "-c") {
+            history.clear();
+            return;
+        }
+        
+        if (args[1] == "-s") {
+            // Substring search through the history index
+            if (args.size() < 3) {
+                std::cerr << "MyShell: history: -s: pattern required\n";
+                status = 1;
+                return;
+            }
+            std::vector<size_t> matches;
+            history.findAll(args[2], matches);
+            for (size_t i : matches) {
+                out() << i + 1 << "  " << history.at(i) << "\n";
+            }
+            return;
+        }
+        
         try {
-            int count = std::stoi(args[1]);
-            int start = std::max(0, static_cast<int>(history.size()) - count);
-            
-            for (int i = start; i < static_cast<int>(history.size()); i++) {
-                std::cout << i + 1 << "  " << history[i] << "\n";
+            int count = std::stoi(std::string(args[1]));
+            if (count < 0) {
+                throw std::invalid_argument("negative count");
             }
+            start = history.size() - std::min(history.size(), static_cast<size_t>(count));
         } catch (const std::exception&) {
             std::cerr << "MyShell: history: invalid number\n";
+            status = 1;
+            return;
         }
-    } else {
-        // Show all history
-        for (size_t i = 0; i < history.size(); i++) {
-            std::cout << i + 1 << "  " << history[i] << "\n";
-        }
+    }
+    
+    for (size_t i = start; i < history.size(); i++) {
+        out() << i + 1 << "  " << history.at(i) << "\n";
     }
 }
 
-void BuiltinCommands::helpCommand(const std::vector<std::string>& args) {
+void BuiltinCommands::helpCommand(const ArgList& args) {
     (void)args; // Suppress unused parameter warning
     
-    std::cout << "MyShell Built-in Commands:\n\n";
-    std::cout << "  exit [code]      - Exit the shell with optional exit code\n";
-    std::cout << "  cd [directory]   - Change directory (cd ~ for home, cd - for previous)\n";
-    std::cout << "  pwd              - Print current working directory\n";
-    std::cout << "  echo [-n] [args] - Print arguments (-n: no newline)\n";
-    std::cout << "  export [VAR=val] - Set environment variables\n";
-    std::cout << "  unset VAR        - Unset environment variables\n";
-    std::cout << "  history [n]      - Show command history (last n commands)\n";
-    std::cout << "  jobs             - Show background jobs\n";
-    std::cout << "  fg [job]         - Bring background job to foreground\n";
-    std::cout << "  help             - Show this help message\n\n";
-    
-    std::cout << "Features:\n";
-    std::cout << "  • I/O Redirection: cmd < input.txt > output.txt\n";
-    std::cout << "  • Pipes: cmd1 | cmd2\n";
-    std::cout << "  • Background: cmd &\n";
-    std::cout << "  • Variables: $VAR or ${VAR}\n";
-    std::cout << "  • Command History: Use 'history' command\n\n";
-}
-
-void BuiltinCommands::jobsCommand(const std::vector<std::string>& args) {
+    out() << "MyShell Built-in Commands:\n\n";
+    out() << "  exit [code]      - Exit the shell with optional exit code\n";
+    out() << "  cd [directory]   - Change directory (cd ~ for home, cd - for previous)\n";
+    out() << "  pwd              - Print current working directory\n";
+    out() << "  echo [-n] [args] - Print arguments (-n: no newline)\n";
+    out() << "  export [VAR=val] - Set environment variables\n";
+    out() << "  unset VAR        - Unset environment variables\n";
+    out() << "  history [n|-c]   - Show command history (last n commands, -c: clear)\n";
+    out() << "  history -s text  - Show history entries containing text\n";
+    out() << "  jobs             - Show background jobs\n";
+    out() << "  fg [n|%n]        - Bring background job to foreground\n";
+    out() << "  hash [-r] [cmd]  - Show or remember command paths (-r: forget all)\n";
+    out() << "  launcher [fork|spawn|zygote|-r] - Select launch backend or show/reset latency\n";
+    out() << "  pipesize [bytes] - Show or set pipeline pipe size (0: default)\n";
+    out() << "  time cmd         - Run cmd and report time, memory and context switches\n";
+    out() << "  time -a on|off   - Report resource usage after every command\n";
+    out() << "  parallel [-j N] [-k] cmd [args] [::: items]\n"
+              << "                   - Run cmd once per item (stdin lines by default),\n"
+              << "                     N at a time; -k keeps output in input order\n";
+    out() << "  cat [files]      - Copy files (or input) to the output without forking\n";
+    out() << "  trace on FILE|off - Record a Chrome trace of every command (Perfetto)\n";
+    out() << "  true, :, false   - Do nothing, successfully (or not: false)\n";
+    out() << "  let expr...      - Evaluate arithmetic; fails if the last value is 0\n";
+    out() << "  test expr, [ expr ] - Check files (-e -f -d -s -nt ...), strings, integers\n";
+    out() << "  [[ expr ]]       - Like test, with && || and patterns (== *.txt, =~ regex)\n";
+    out() << "  read [-r] [-d c] [-n N] [-p text] [-u fd] [names]\n"
+          << "                   - Read a line and split it on IFS into variables\n";
+    out() << "  mapfile [-t] [-n N] [-s N] [-d c] [-u fd] [array]\n"
+          << "                   - Read lines into array[0], array[1], ... (also readarray)\n";
+    out() << "  enable -f lib.so name... - Load builtins from a shared library\n"
+          << "  enable -d name   - Remove a loaded builtin; enable alone lists builtins\n";
+    out() << "  help             - Show this help message\n\n";
+    
+    out() << "Features:\n";
+    out() << "  • I/O Redirection: cmd < input.txt > output.txt\n";
+    out() << "  • Pipes: cmd1 | cmd2 | cmd3 ...\n";
+    out() << "  • Background: cmd &\n";
+    out() << "  • Variables: $VAR or ${VAR}\n";
+    out() << "  • Command History: Use 'history' command\n";
+    out() << "  • Lists: cmd1; cmd2, cmd1 && cmd2, cmd1 || cmd2, ! cmd\n";
+    out() << "  • Control flow: if/elif/else/fi, while/until ... do ... done,\n"
+          << "    for NAME in words; do ... done, break, continue\n"
+          << "    Loops read a file with `done < file`; pipes into compound commands\n"
+          << "    and other redirections on them are not supported\n";
+    out() << "  • Functions: name() { ...; }, arguments in $1, $2, ..., $# and $@; return [n]\n";
+    out() << "  • Assignments: NAME=value\n";
+    out() << "  • Arithmetic: $(( expr )) with C operators, e.g. $((i += 2)), $((a < b ? a : b))\n";
+    out() << "  • Command substitution: $(cmd) or `cmd`; echo, pwd and tests run without forking\n";
+    out() << "  • Parameters: ${VAR:-default} ${VAR:=x} ${#VAR} ${VAR#pat} ${VAR%pat}\n"
+          << "    ${VAR/old/new} ${VAR:offset:length}\n";
+    out() << "  • Arrays (from mapfile): ${NAME[i]}, ${NAME[@]}, ${#NAME[@]}\n\n";
+}
+
+void BuiltinCommands::jobsCommand(const ArgList& args) {
     (void)args; // Suppress unused parameter warning
     
-    auto& bgProcesses = shell->getBackgroundProcesses();
+    JobTable& jobs = shell->getJobs();
+    jobs.reap();
     
-    if (bgProcesses.empty()) {
-        std::cout << "No background jobs\n";
+    if (jobs.empty()) {
+        out() << "No background jobs\n";
         return;
     }
     
-    std::cout << "Background Jobs:\n";
-    for (size_t i = 0; i < bgProcesses.size(); i++) {
-        pid_t pid = bgProcesses[i];
-        
-        // Check if process is still running
-        int status;
-        pid_t result = waitpid(pid, &status, WNOHANG);
-        
-        if (result == 0) {
-            // Still running
-            std::cout << "[" << i + 1 << "] " << pid << " Running\n";
-        } else {
-            // Finished
-            std::cout << "[" << i + 1 << "] " << pid << " Done\n";
+    out() << "Background Jobs:\n";
+    for (int id = 1; id <= jobs.getHighestId(); id++) {
+        const JobTable::Job* job = jobs.find(id);
+        if (!job) {
+            continue;
+        }
+        out() << "[" << id << "] " << job->pids.back() << " " 
+                  << JobTable::statusText(*job) << "  " << job->command << "\n";
+    }
+    
+    // Finished jobs have now been reported
+    for (int id = 1; id <= jobs.getHighestId(); id++) {
+        const JobTable::Job* job = jobs.find(id);
+        if (job && job->done()) {
+            jobs.remove(id);
         }
     }
 }
 
-void BuiltinCommands::fgCommand(const std::vector<std::string>& args) {
-    auto& bgProcesses = shell->getBackgroundProcesses();
+void BuiltinCommands::fgCommand(const ArgList& args) {
+    JobTable& jobs = shell->getJobs();
     
-    if (bgProcesses.empty()) {
+    if (jobs.empty()) {
         std::cerr << "MyShell: fg: no background jobs\n";
+        status = 1;
         return;
     }
     
-    pid_t pid;
+    JobTable::Job* job;
     
     if (args.size() == 1) {
         // Bring most recent background job to foreground
-        pid = bgProcesses.back();
-        bgProcesses.pop_back();
+        job = jobs.newest();
     } else {
         try {
-            int jobNum = std::stoi(args[1]) - 1; // Convert to 0-based index
-            if (jobNum < 0 || jobNum >= static_cast<int>(bgProcesses.size())) {
+            std::string_view spec = args[1];
+            if (!spec.empty() && spec[0] == '%') {
+                spec.remove_prefix(1);
+            }
+            job = jobs.find(std::stoi(std::string(spec)));
+            if (!job) {
                 std::cerr << "MyShell: fg: job not found\n";
+                status = 1;
                 return;
             }
-            
-            pid = bgProcesses[jobNum];
-            bgProcesses.erase(bgProcesses.begin() + jobNum);
         } catch (const std::exception&) {
             std::cerr << "MyShell: fg: invalid job number\n";
+            status = 1;
             return;
         }
     }
     
-    std::cout << "Bringing process " << pid << " to foreground\n";
+    int id = job->id;
+    out() << "Bringing job [" << id << "] to foreground: " << job->command << "\n";
     
-    // Wait for the process
-    int status;
-    if (waitpid(pid, &status, 0) == -1) {
-        std::cerr << "MyShell: fg: failed to wait for process " << pid 
+    // Wait for the job's remaining processes
+    if (!shell->getExecutor().waitJob(id)) {
+        std::cerr << "MyShell: fg: failed to wait for job " << id 
                   << ": " << strerror(errno) << "\n";
+        status = 1;
+    }
+    jobs.remove(id);
+}
+
+void BuiltinCommands::hashCommand(const ArgList& args) {
+    PathCache& cache = shell->getExecutor().getPathCache();
+    
+    if (args.size() == 1) {
+        // List remembered commands with their hit counts
+        auto entries = cache.getEntries();
+        if (entries.empty()) {
+            out() << "hash: hash table empty\n";
+            return;
+        }
+        
+        out() << "hits\tcommand\n";
+        for (const auto& entry : entries) {
+            out() << std::setw(4) << entry.second.hits << "\t" << entry.second.path << "\n";
+        }
+        return;
+    }
+    
+    if (args[1] == "-r") {
+        cache.clear();
+        return;
+    }
+    
+    if (args[1] == "-d") {
+        if (args.size() < 3) {
+            std::cerr << "MyShell: hash: -d: option requires an argument\n";
+            status = 1;
+            return;
+        }
+        for (size_t i = 2; i < args.size(); i++) {
+            if (!cache.remove(std::string(args[i]))) {
+                std::cerr << "MyShell: hash: " << args[i] << ": not found\n";
+                status = 1;
+            }
+        }
+        return;
+    }
+    
+    for (size_t i = 1; i < args.size(); i++) {
+        if (!cache.add(std::string(args[i]))) {
+            std::cerr << "MyShell: hash: " << args[i] << ": not found\n";
+            status = 1;
+        }
+    }
+}
+
+void BuiltinCommands::launcherCommand(const ArgList& args) {
+    CommandExecutor& executor = shell->getExecutor();
+    
+    if (args.size() > 1) {
+        if (args[1] == "fork") {
+            executor.setBackend(LaunchBackend::Fork);
+        } else if (args[1] == "spawn") {
+            executor.setBackend(LaunchBackend::Spawn);
+        } else if (args[1] == "zygote") {
+            if (!executor.setBackend(LaunchBackend::Zygote)) {
+                status = 1;
+            }
+        } else if (args[1] == "-r") {
+            executor.resetLaunchStats();
+        } else {
+            std::cerr << "MyShell: launcher: unknown backend '" << args[1] 
+                      << "' (expected fork, spawn or zygote)\n";
+            status = 1;
+        }
+        return;
+    }
+    
+    const char* current = "fork";
+    if (executor.getBackend() == LaunchBackend::Spawn) {
+        current = "spawn";
+    } else if (executor.getBackend() == LaunchBackend::Zygote) {
+        current = executor.isZygoteRunning() ? "zygote" : "zygote (helper not running)";
     }
-}
\ No newline at end of file
+    out() << "Launch backend: " << current << "\n";
+    
+    const std::pair<const char*, LaunchBackend> backends[] = {
+        {"fork  ", LaunchBackend::Fork},
+        {"spawn ", LaunchBackend::Spawn},
+        {"zygote", LaunchBackend::Zygote}
+    };
+    for (const auto& backend : backends) {
+        const LaunchStats& stats = executor.getLaunchStats(backend.second);
+        out() << "  " << backend.first << ": " << stats.launches << " launches";
+        if (stats.launches > 0) {
+            out() << std::fixed << std::setprecision(1)
+                      << ", avg " << stats.totalMicros / stats.launches << " us"
+                      << ", max " << stats.maxMicros << " us";
+            out().unsetf(std::ios::floatfield);
+        }
+        out() << "\n";
+    }
+}
+
+void BuiltinCommands::pipesizeCommand(const ArgList& args) {
+    CommandExecutor& executor = shell->getExecutor();
+    
+    if (args.size() == 1) {
+        size_t bytes = executor.getPipeCapacity();
+        if (bytes == 0) {
+            out() << "default\n";
+        } else {
+            out() << bytes << "\n";
+        }
+        return;
+    }
+    
+    try {
+        long bytes = std::stol(std::string(args[1]));
+        if (bytes < 0) {
+            throw std::invalid_argument("negative size");
+        }
+        executor.setPipeCapacity(static_cast<size_t>(bytes));
+    } catch (const std::exception&) {
+        std::cerr << "MyShell: pipesize: invalid size\n";
+        status = 1;
+    }
+}
+
+void BuiltinCommands::timeCommand(const ArgList& args) {
+    // `time cmd ...` is handled by the shell before builtins are looked up;
+    // what reaches here is the always-on switch
+    if (args.size() == 1) {
+        out() << "time: report after every command is " 
+                  << (shell->getTimeAll() ? "on" : "off") << "\n";
+        return;
+    }
+    
+    if (args.size() == 3 && args[1] == "-a" && (args[2] == "on" || args[2] == "off")) {
+        shell->setTimeAll(args[2] == "on");
+        return;
+    }
+    
+    std::cerr << "MyShell: time: usage: time command [args...] | time -a on|off\n";
+    status = 2;
+}
+
+void BuiltinCommands::parallelCommand(const ArgList& args) {
+    long maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+    bool ordered = false;
+    size_t i = 1;
+    
+    // Options
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; i++) {
+        if (args[i] == "--") {
+            i++;
+            break;
+        } else if (args[i] == "-k") {
+            ordered = true;
+        } else if ((args[i] == "-j" && i + 1 < args.size()) ||
+                   (args[i][1] == 'j' && args[i].size() > 2 &&
+                    std::isdigit(static_cast<unsigned char>(args[i][2])))) {
+            // The count may be attached (-j4) or separate (-j 4)
+            char* end;
+            std::string value(args[i].size() > 2 ? args[i].substr(2) : args[++i]);
+            maxJobs = std::strtol(value.c_str(), &end, 10);
+            if (*end != '\0' || maxJobs <= 0) {
+                std::cerr << "MyShell: parallel: invalid job count '" << value << "'\n";
+                status = 2;
+                return;
+            }
+        } else {
+            std::cerr << "MyShell: parallel: unknown option '" << args[i] << "'\n";
+            status = 2;
+            return;
+        }
+    }
+    if (maxJobs <= 0) {
+        maxJobs = 1;
+    }
+    
+    // Command template, then items after ::: or one per line of stdin
+    std::vector<std::string> templ;
+    for (; i < args.size() && args[i] != ":::"; i++) {
+        templ.emplace_back(args[i]);
+    }
+    if (templ.empty()) {
+        std::cerr << "MyShell: parallel: usage: parallel [-j N] [-k] command [args...] [::: items...]\n";
+        status = 2;
+        return;
+    }
+    
+    std::vector<std::string> items;
+    if (i < args.size()) {
+        for (i++; i < args.size(); i++) {
+            items.emplace_back(args[i]);
+        }
+    } else {
+        // Through the input buffer, so lines the shell has read ahead count
+        InputBuffer& source = inputBuffer(-1);
+        std::string_view line;
+        bool terminated;
+        while (source.nextRecord('\n', std::string::npos, line, terminated)) {
+            if (!line.empty()) {
+                items.emplace_back(line);
+            }
+        }
+    }
+    
+    bool hasPlaceholder = std::any_of(templ.begin(), templ.end(), 
+        [](const std::string& word) { return word.find("{}") != std::string::npos; });
+    
+    struct Task {
+        pid_t pid;
+        int outputFd;       // Captured stdout in ordered mode (-1: none)
+        bool done;
+    };
+    std::vector<Task> tasks(items.size(), Task{-1, -1, false});
+    std::unordered_map<pid_t, size_t> running;
+    running.reserve(maxJobs);
+    
+    // Ordered mode holds finished output until everything before it has been
+    // printed; cap how far ahead of the printer we run so descriptors stay bounded
+    const size_t window = std::max<size_t>(maxJobs, 256);
+    size_t next = 0;
+    size_t printed = 0;
+    size_t failed = 0;
+    bool interrupted = false;
+    
+    auto copyOutput = [this](int fd) {
+        char buffer[65536];
+        lseek(fd, 0, SEEK_SET);
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0 && out().write(buffer, n)) {}
+        close(fd);
+    };
+    
+    auto finish = [&](size_t index, int waitStatus) {
+        tasks[index].done = true;
+        if (CommandExecutor::exitStatus(waitStatus) != 0) {
+            failed++;
+        }
+        // Stop starting new work once the user interrupts a command
+        if (WIFSIGNALED(waitStatus) && WTERMSIG(waitStatus) == SIGINT) {
+            interrupted = true;
+        }
+        
+        while (ordered && printed < tasks.size() && tasks[printed].done) {
+            if (tasks[printed].outputFd != -1) {
+                copyOutput(tasks[printed].outputFd);
+            }
+            printed++;
+        }
+    };
+    
+    CommandExecutor& executor = shell->getExecutor();
+    JobTable& jobs = shell->getJobs();
+    std::vector<std::string> words;
+    std::vector<char*> argv;
+    
+    out().flush();
+    auto start = std::chrono::steady_clock::now();
+    
+    while (true) {
+        // Fill every free slot
+        while (!interrupted && next < items.size() && 
+               running.size() < static_cast<size_t>(maxJobs) &&
+               (!ordered || next - printed < window)) {
+            words = templ;
+            if (hasPlaceholder) {
+                for (std::string& word : words) {
+                    // Search on after each item: it may contain {} itself
+                    size_t at = 0;
+                    while ((at = word.find("{}", at)) != std::string::npos) {
+                        word.replace(at, 2, items[next]);
+                        at += items[next].size();
+                    }
+                }
+            } else {
+                words.push_back(items[next]);
+            }
+            argv.clear();
+            for (std::string& word : words) {
+                argv.push_back(&word[0]);
+            }
+            argv.push_back(nullptr);
+            
+            Task& task = tasks[next];
+            if (ordered) {
+                task.outputFd = memfd_create("parallel", MFD_CLOEXEC);
+            }
+            // Children write straight to our output unless it is being collected
+            task.pid = executor.startCommand(argv.data(), -1, 
+                                             ordered ? task.outputFd : outputFd);
+            if (task.pid == -1) {
+                finish(next, 127 << 8);
+            } else {
+                running[task.pid] = next;
+            }
+            next++;
+        }
+        
+        if (running.empty()) {
+            break;
+        }
+        
+        // Take whichever child exits first; background jobs and stages of
+        // our own pipeline that finish meanwhile are handed to the job table
+        int waitStatus;
+        struct rusage usage;
+        pid_t pid = executor.waitAnyProcess(waitStatus, usage);
+        if (pid == -1) {
+            break;
+        }
+        
+        auto it = running.find(pid);
+        if (it == running.end()) {
+            if (!jobs.recordExit(pid, waitStatus)) {
+                jobs.recordStray(pid, waitStatus, usage);
+            }
+            continue;
+        }
+        size_t index = it->second;
+        running.erase(it);
+        finish(index, waitStatus);
+    }
+    
+    double makespan = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    
+    // Tasks never started after an interrupt still hold nothing, but a
+    // started one may be waiting behind them in ordered mode
+    for (; printed < tasks.size(); printed++) {
+        if (tasks[printed].outputFd != -1) {
+            close(tasks[printed].outputFd);
+        }
+    }
+    
+    std::cerr << "parallel: " << next << " of " << items.size() << " jobs run, " 
+              << failed << " failed, " << maxJobs << " at a time, makespan " 
+              << std::fixed << std::setprecision(3) << makespan << "s\n" 
+              << std::defaultfloat;
+    status = failed > 0 || interrupted ? 1 : 0;
+}
+
+void BuiltinCommands::catCommand(const ArgList& args) {
+    int inFd = inputFd == -1 ? STDIN_FILENO : inputFd;
+    int outFd = outputFd == -1 ? STDOUT_FILENO : outputFd;
+    
+    // Options (-n, -A, ...) need the real cat, which still gets our streams
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i].size() > 1 && args[i][0] == '-') {
+            out().flush();
+            pid_t pid = shell->getExecutor().startCommand(args.argv(), inputFd, outputFd);
+            if (pid == -1) {
+                status = 127;
+                return;
+            }
+            // The pid may be the launch helper's child, not ours
+            status = shell->getExecutor().waitCommand(pid);
+            return;
+        }
+    }
+    
+    // Whatever the builtin stream buffered must come before the copied bytes
+    out().flush();
+    IORedirection& io = shell->getIOHandler();
+    
+    // Copying a file onto its own end would never finish; refuse, like cat
+    struct stat outStat;
+    bool outRegular = fstat(outFd, &outStat) == 0 && S_ISREG(outStat.st_mode);
+    auto isOutput = [&](int fd, std::string_view name) {
+        struct stat inStat;
+        if (!outRegular || fstat(fd, &inStat) != 0 ||
+            inStat.st_dev != outStat.st_dev || inStat.st_ino != outStat.st_ino) {
+            return false;
+        }
+        std::cerr << "MyShell: cat: " << name << ": input file is output file\n";
+        status = 1;
+        return true;
+    };
+    
+    if (args.size() == 1) {
+        if (isOutput(inFd, "-")) {
+            return;
+        }
+        if (!io.copyData(inFd, outFd) && errno != EPIPE) {
+            std::cerr << "MyShell: cat: " << strerror(errno) << "\n";
+            status = 1;
+        }
+        return;
+    }
+    
+    for (size_t i = 1; i < args.size(); i++) {
+        std::string path(args[i]);
+        int fd = path == "-" ? inFd : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            std::cerr << "MyShell: cat: " << path << ": " << strerror(errno) << "\n";
+            status = 1;
+            continue;
+        }
+        if (isOutput(fd, path)) {
+            if (fd != inFd) {
+                close(fd);
+            }
+            continue;
+        }
+        
+        bool ok = io.copyData(fd, outFd);
+        int err = errno;
+        if (fd != inFd) {
+            close(fd);
+        }
+        
+        if (!ok) {
+            // The reader went away: stop quietly, like cat killed by SIGPIPE
+            if (err != EPIPE) {
+                std::cerr << "MyShell: cat: " << path << ": " << strerror(err) << "\n";
+            }
+            status = 1;
+            if (err == EPIPE) {
+                return;
+            }
+        }
+    }
+}
+
+void BuiltinCommands::traceCommand(const ArgList& args) {
+    if (args.size() == 1) {
+        if (Tracer::enabled()) {
+            out() << "trace: on, writing " << Tracer::getPath() << " (" 
+                  << Tracer::getRecorded() << " events, " 
+                  << Tracer::getDropped() << " dropped)\n";
+        } else {
+            out() << "trace: off\n";
+        }
+        return;
+    }
+    
+    if (args.size() == 3 && args[1] == "on") {
+        std::string path(args[2]);
+        if (!Tracer::start(path)) {
+            std::cerr << "MyShell: trace: cannot open '" << path << "': " 
+                      << strerror(errno) << "\n";
+            status = 1;
+        }
+        return;
+    }
+    
+    if (args.size() == 2 && args[1] == "off") {
+        Tracer::stop();
+        return;
+    }
+    
+    std::cerr << "MyShell: trace: usage: trace [on FILE | off]\n";
+    status = 2;
+}
+
+void BuiltinCommands::trueCommand(const ArgList& args) {
+    (void)args; // Suppress unused parameter warning
+}
+
+void BuiltinCommands::falseCommand(const ArgList& args) {
+    (void)args; // Suppress unused parameter warning
+    status = 1;
+}
+
+void BuiltinCommands::letCommand(const ArgList& args) {
+    if (args.size() < 2) {
+        std::cerr << "MyShell: let: expression expected\n";
+        status = 2;
+        return;
+    }
+    
+    // Each argument is one expression; the last value decides the status
+    int64_t value = 0;
+    for (size_t i = 1; i < args.size(); i++) {
+        if (!shell->getParser().evaluateArithmetic(args[i], value)) {
+            status = 1;
+            return;
+        }
+    }
+    status = value == 0 ? 1 : 0;
+}
+
+void BuiltinCommands::testCommand(const ArgList& args) {
+    size_t last = args.size();
+    if (args[0] == "[") {
+        if (args[last - 1] != "]") {
+            std::cerr << "MyShell: [: missing `]'\n";
+            status = 2;
+            return;
+        }
+        last--;
+    }
+    status = TestExpression(args, 1, last, TestExpression::Syntax::Test, nullptr).evaluate();
+}
+
+void BuiltinCommands::conditionCommand(const ArgList& args) {
+    size_t last = args.size();
+    if (last < 2 || args[last - 1] != "]]") {
+        std::cerr << "MyShell: [[: missing `]]'\n";
+        status = 2;
+        return;
+    }
+    status = TestExpression(args, 1, last - 1, TestExpression::Syntax::DoubleBracket, 
+                            &shell->getParser()).evaluate();
+}
+
+void BuiltinCommands::readCommand(const ArgList& args) {
+    bool raw = false;
+    char delimiter = '\n';
+    size_t limit = std::string::npos;
+    size_t fd = static_cast<size_t>(-1);
+    std::string_view prompt;
+    size_t i = 1;
+    
+    // Options; values may be attached (-d:) or separate (-d :)
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; i++) {
+        std::string_view option = args[i];
+        if (option == "--") {
+            i++;
+            break;
+        }
+        if (option == "-r") {
+            raw = true;
+            continue;
+        }
+        if (option[1] != 'd' && option[1] != 'n' && option[1] != 'p' && option[1] != 'u') {
+            std::cerr << "MyShell: read: " << option << ": invalid option\n";
+            status = 2;
+            return;
+        }
+        std::string_view value = option.substr(2);
+        if (option.size() == 2) {
+            if (i + 1 >= args.size()) {
+                std::cerr << "MyShell: read: " << option << ": option requires an argument\n";
+                status = 2;
+                return;
+            }
+            value = args[++i];
+        }
+        bool valid = true;
+        switch (option[1]) {
+            case 'd': delimiter = value.empty() ? '\0' : value[0]; break;
+            case 'n': valid = parseCount(value, limit); break;
+            case 'p': prompt = value; break;
+            case 'u': valid = parseCount(value, fd) && fd <= INT_MAX && fcntl(static_cast<int>(fd), F_GETFD) != -1; break;
+        }
+        if (!valid) {
+            std::cerr << "MyShell: read: " << value << ": invalid " 
+                      << (option[1] == 'u' ? "file descriptor" : "number") << "\n";
+            status = option[1] == 'u' ? 1 : 2;
+            return;
+        }
+    }
+    for (size_t k = i; k < args.size(); k++) {
+        if (!isIdentifier(args[k])) {
+            std::cerr << "MyShell: read: `" << args[k] << "': not a valid identifier\n";
+            status = 1;
+            return;
+        }
+    }
+    
+    InputBuffer& source = inputBuffer(static_cast<int>(fd));
+    if (!prompt.empty() && isatty(source.descriptor())) {
+        std::cerr << prompt << std::flush;
+    }
+    
+    // Without -r, a backslash before the delimiter continues the record on
+    // the next one; only then is it copied
+    auto continues = [&](std::string_view record) {
+        size_t other = record.find_last_not_of('\\');
+        size_t backslashes = record.size() - (other == std::string_view::npos ? 0 : other + 1);
+        return backslashes % 2 == 1;
+    };
+    std::string_view text;
+    bool terminated;
+    bool found = source.nextRecord(delimiter, limit, text, terminated);
+    if (!raw && terminated && continues(text)) {
+        lineScratch.clear();
+        do {
+            lineScratch.append(text.data(), text.size() - 1);
+            if (!source.nextRecord(delimiter, limit, text, terminated)) {
+                text = std::string_view();
+                break;
+            }
+        } while (terminated && continues(text));
+        lineScratch.append(text.data(), text.size());
+        text = lineScratch;
+    }
+    status = terminated ? 0 : 1;
+    
+    // Split on IFS: IFS whitespace runs are one separator and are trimmed
+    // at both ends; other IFS characters each end a field
+    const auto& variables = shell->getVariables();
+    auto ifsVariable = variables.find("IFS");
+    std::string_view ifs = ifsVariable != variables.end() ? std::string_view(ifsVariable->second) 
+                                                          : std::string_view(" \t\n");
+    auto isSeparator = [&](char c) { return ifs.find(c) != std::string_view::npos; };
+    auto isSpace = [&](char c) { return (c == ' ' || c == '\t' || c == '\n') && isSeparator(c); };
+    
+    size_t pos = 0;
+    const size_t size = found ? text.size() : 0;
+    if (i == args.size()) {
+        // REPLY gets the line as it is, less escapes
+        fieldScratch.clear();
+        for (; pos < size; pos++) {
+            if (!raw && text[pos] == '\\') {
+                pos++;
+                if (pos == size) {
+                    break;
+                }
+            }
+            fieldScratch += text[pos];
+        }
+        nameScratch.assign("REPLY");
+        shell->setVariable(nameScratch, fieldScratch);
+        return;
+    }
+    
+    while (pos < size && isSpace(text[pos])) {
+        pos++;
+    }
+    for (size_t k = i; k < args.size(); k++) {
+        bool last = k + 1 == args.size();
+        size_t keep = 0;    // Field length without trailing IFS whitespace
+        fieldScratch.clear();
+        while (pos < size) {
+            char c = text[pos];
+            if (!raw && c == '\\') {
+                if (pos + 1 < size) {
+                    fieldScratch += text[pos + 1];
+                    keep = fieldScratch.size();
+                }
+                pos += 2;
+                continue;
+            }
+            if (!last && isSeparator(c)) {
+                break;
+            }
+            fieldScratch += c;
+            pos++;
+            if (!isSpace(c)) {
+                keep = fieldScratch.size();
+            }
+        }
+        fieldScratch.resize(keep);
+        
+        // Whitespace, then at most one other separator and whitespace after it
+        while (pos < size && isSpace(text[pos])) {
+            pos++;
+        }
+        if (pos < size && isSeparator(text[pos])) {
+            pos++;
+            while (pos < size && isSpace(text[pos])) {
+                pos++;
+            }
+        }
+        nameScratch.assign(args[k].data(), args[k].size());
+        shell->setVariable(nameScratch, fieldScratch);
+    }
+}
+
+void BuiltinCommands::mapfileCommand(const ArgList& args) {
+    bool trim = false;
+    char delimiter = '\n';
+    size_t count = 0;
+    size_t skip = 0;
+    size_t fd = static_cast<size_t>(-1);
+    size_t i = 1;
+    
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; i++) {
+        std::string_view option = args[i];
+        if (option == "--") {
+            i++;
+            break;
+        }
+        if (option == "-t") {
+            trim = true;
+            continue;
+        }
+        if (option[1] != 'd' && option[1] != 'n' && option[1] != 's' && option[1] != 'u') {
+            std::cerr << "MyShell: " << args[0] << ": " << option << ": invalid option\n";
+            status = 2;
+            return;
+        }
+        std::string_view value = option.substr(2);
+        if (option.size() == 2) {
+            if (i + 1 >= args.size()) {
+                std::cerr << "MyShell: " << args[0] << ": " << option 
+                          << ": option requires an argument\n";
+                status = 2;
+                return;
+            }
+            value = args[++i];
+        }
+        bool valid = true;
+        switch (option[1]) {
+            case 'd': delimiter = value.empty() ? '\0' : value[0]; break;
+            case 'n': valid = parseCount(value, count); break;
+            case 's': valid = parseCount(value, skip); break;
+            case 'u': valid = parseCount(value, fd) && fd <= INT_MAX && fcntl(static_cast<int>(fd), F_GETFD) != -1; break;
+        }
+        if (!valid) {
+            std::cerr << "MyShell: " << args[0] << ": " << value << ": invalid " 
+                      << (option[1] == 'u' ? "file descriptor" : "number") << "\n";
+            status = option[1] == 'u' ? 1 : 2;
+            return;
+        }
+    }
+    std::string_view name = i < args.size() ? args[i] : std::string_view("MAPFILE");
+    if (i + 1 < args.size() || !isIdentifier(name)) {
+        std::cerr << "MyShell: " << args[0] << ": `" << (i < args.size() ? args[args.size() - 1] : name) 
+                  << "': not a valid identifier\n";
+        status = 1;
+        return;
+    }
+    
+    // The array's elements are the variables NAME[0], NAME[1], ...; old
+    // elements go first
+    auto& variables = shell->getVariables();
+    nameScratch.assign(name.data(), name.size());
+    nameScratch += '[';
+    auto first = variables.lower_bound(nameScratch);
+    nameScratch.back() = '\\';
+    variables.erase(first, variables.lower_bound(nameScratch));
+    
+    InputBuffer& source = inputBuffer(static_cast<int>(fd));
+    std::string_view record;
+    bool terminated;
+    size_t stored = 0;
+    char digits[24];
+    while ((count == 0 || stored < count) && 
+           source.nextRecord(delimiter, std::string::npos, record, terminated)) {
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        nameScratch.assign(name.data(), name.size());
+        nameScratch += '[';
+        nameScratch.append(digits, std::to_chars(digits, digits + sizeof(digits), stored).ptr);
+        nameScratch += ']';
+        std::string& element = variables[nameScratch];
+        element.assign(record.data(), record.size());
+        if (terminated && !trim) {
+            element += delimiter;
+        }
+        stored++;
+    }
+}
+
+void BuiltinCommands::runLoaded(const Builtin& builtin, const ArgList& args) {
+    // Whatever the shell buffered goes out before the builtin writes
+    // directly to out_fd
+    out().flush();
+    
+    myshell_api api;
+    api.abi_version = MYSHELL_BUILTIN_ABI;
+    api.size = sizeof(api);
+    api.context = reinterpret_cast<myshell_context*>(this);
+    api.in_fd = inputFd == -1 ? STDIN_FILENO : inputFd;
+    api.out_fd = outputFd == -1 ? STDOUT_FILENO : outputFd;
+    api.err_fd = STDERR_FILENO;
+    api.write_out = &BuiltinCommands::pluginWrite;
+    api.get_variable = &BuiltinCommands::pluginGetVariable;
+    api.set_variable = &BuiltinCommands::pluginSetVariable;
+    
+    status = builtin.function(static_cast<int>(args.size()), args.argv(), &api);
+    out().flush();
+}
+
+int BuiltinCommands::pluginWrite(myshell_context* context, const char* data, size_t size) {
+    BuiltinCommands* self = reinterpret_cast<BuiltinCommands*>(context);
+    self->out().write(data, static_cast<std::streamsize>(size));
+    return self->out() ? 0 : -1;
+}
+
+const char* BuiltinCommands::pluginGetVariable(myshell_context* context, const char* name) {
+    BuiltinCommands* self = reinterpret_cast<BuiltinCommands*>(context);
+    const char* value = getenv(name);
+    if (value) {
+        return value;
+    }
+    const auto& variables = self->shell->getVariables();
+    auto it = variables.find(name);
+    return it != variables.end() ? it->second.c_str() : nullptr;
+}
+
+int BuiltinCommands::pluginSetVariable(myshell_context* context, const char* name, const char* value) {
+    BuiltinCommands* self = reinterpret_cast<BuiltinCommands*>(context);
+    self->nameScratch.assign(name);
+    self->fieldScratch.assign(value);
+    self->shell->setVariable(self->nameScratch, self->fieldScratch);
+    return 0;
+}
+
+bool BuiltinCommands::loadBuiltins(const char* path, const ArgList& names) {
+    bool ok = true;
+    for (std::string_view name : names) {
+        const Builtin* existing = findBuiltin(name);
+        if (existing && existing->method) {
+            std::cerr << "MyShell: enable: " << name << ": cannot replace a compiled-in builtin\n";
+            ok = false;
+            continue;
+        }
+        
+        // Every name holds its own reference to the library
+        void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (!library) {
+            std::cerr << "MyShell: enable: cannot open shared object " << path << ": " 
+                      << dlerror() << "\n";
+            return false;
+        }
+        const unsigned* abi = static_cast<const unsigned*>(dlsym(library, "myshell_builtin_abi"));
+        if (abi && *abi != MYSHELL_BUILTIN_ABI) {
+            std::cerr << "MyShell: enable: " << path << ": built for builtin ABI " << *abi 
+                      << ", this shell has " << MYSHELL_BUILTIN_ABI << "\n";
+            dlclose(library);
+            return false;
+        }
+        
+        std::string symbol(name);
+        std::replace(symbol.begin(), symbol.end(), '-', '_');
+        symbol += "_builtin";
+        void* function = dlsym(library, symbol.c_str());
+        if (!function) {
+            std::cerr << "MyShell: enable: cannot find " << symbol << " in shared object " 
+                      << path << "\n";
+            dlclose(library);
+            ok = false;
+            continue;
+        }
+        
+        Builtin& builtin = addBuiltin(name);
+        if (builtin.library) {
+            dlclose(builtin.library);
+        }
+        builtin.function = reinterpret_cast<myshell_builtin_fn>(function);
+        builtin.library = library;
+    }
+    return ok;
+}
+
+void BuiltinCommands::enableCommand(const ArgList& args) {
+    // enable alone lists every builtin, loaded ones with their flag
+    if (args.size() == 1) {
+        for (const std::string& name : getAvailableCommands()) {
+            const Builtin* builtin = findBuiltin(name);
+            out() << "enable " << (builtin->function ? "-f " : "") << name << "\n";
+        }
+        return;
+    }
+    
+    if (args[1] == "-f") {
+        if (args.size() < 4) {
+            std::cerr << "MyShell: enable: usage: enable -f library.so name [name...]\n";
+            status = 2;
+            return;
+        }
+        std::string path(args[2]);
+        
+        // A bare file name would make dlopen() search the library path
+        if (path.find('/') == std::string::npos) {
+            path.insert(0, "./");
+        }
+        status = loadBuiltins(path.c_str(), args.skip(3)) ? 0 : 1;
+        return;
+    }
+    
+    if (args[1] == "-d") {
+        if (args.size() < 3) {
+            std::cerr << "MyShell: enable: -d: option requires an argument\n";
+            status = 2;
+            return;
+        }
+        for (size_t i = 2; i < args.size(); i++) {
+            const Builtin* builtin = findBuiltin(args[i]);
+            if (!builtin || !builtin->function) {
+                std::cerr << "MyShell: enable: " << args[i] << ": not dynamically loaded\n";
+                status = 1;
+                continue;
+            }
+            void* library = builtin->library;
+            removeBuiltin(*builtin);
+            dlclose(library);
+        }
+        return;
+    }
+    
+    std::cerr << "MyShell: enable: usage: enable [-f library.so name...] [-d name...]\n";
+    status = 2;
+}
@@ -3,8 +3,11 @@
 
 #include <string>
 #include <vector>
-#include <map>
-#include <functional>
+#include <string_view>
+#include <iostream>
+#include "CommandParser.h"
+#include "InputBuffer.h"
+#include "BuiltinPlugin.h"
 
 class Shell; // Forward declaration
 
@@ -24,42 +27,183 @@ class Shell; // Forward declaration
  * - help: Show available commands
  * - jobs: Show background jobs
  * - fg: Bring background job to foreground
+ * - hash: Show or manage remembered command locations
+ * - launcher: Select fork or posix_spawn for external commands
+ * - pipesize: Show or set the buffer size of pipeline pipes
+ * - time: Switch per-command resource reports on or off
+ * - parallel: Run a command over many inputs with a concurrency limit
+ * - cat: Copy files to the output inside the kernel
+ * - trace: Record a Chrome trace of every command
+ * - true, :, false: Succeed or fail without doing anything
+ * - let: Evaluate arithmetic expressions
+ * - test, [, [[: Evaluate conditions without running /usr/bin/test
+ * - read, mapfile, readarray: Read lines into variables, in large chunks
+ * - enable: Load builtins from shared libraries (see BuiltinPlugin.h)
+ *
+ * Compiled-in and loaded builtins share one open-addressing hash table,
+ * so looking a command up costs a hash and usually one comparison.
  */
 class BuiltinCommands {
+public:
+    // Slots in the builtin table at first; it doubles at half full
+    static const size_t INITIAL_TABLE_SIZE = 64;
+
 private:
+    using Method = void (BuiltinCommands::*)(const ArgList&);
+    
+    /**
+     * A slot of the builtin table
+     */
+    struct Builtin {
+        std::string name;               // Empty: a free slot
+        Method method = nullptr;        // A compiled-in builtin
+        myshell_builtin_fn function = nullptr;  // A loaded builtin
+        void* library = nullptr;        // dlopen() handle of a loaded builtin
+    };
+    
     Shell* shell;
-    std::map<std::string, std::function<void(const std::vector<std::string>&)>> commands;
+    int status;     // Exit status of the last builtin; error paths set it to 1
+    std::istream* input;        // Where builtins read from (std::cin by default)
+    std::ostream* output;       // Where builtins write to (std::cout by default)
+    int inputFd;                // Descriptor behind input (-1: stdin)
+    int outputFd;               // Descriptor behind output (-1: stdout)
+    InputBuffer redirectedInput;    // Buffer over inputFd for one command
+    std::string nameScratch;        // Reused buffers for read and mapfile
+    std::string fieldScratch;
+    std::string lineScratch;
+    
+    std::istream& in() { return *input; }
+    std::ostream& out() { return *output; }
+    std::vector<Builtin> table;     // Linear probing; the size is a power of two
+    size_t tableCount;
     
     // Individual command implementations
-    void exitCommand(const std::vector<std::string>& args);
-    void cdCommand(const std::vector<std::string>& args);
-    void pwdCommand(const std::vector<std::string>& args);
-    void echoCommand(const std::vector<std::string>& args);
-    void exportCommand(const std::vector<std::string>& args);
-    void unsetCommand(const std::vector<std::string>& args);
-    void historyCommand(const std::vector<std::string>& args);
-    void helpCommand(const std::vector<std::string>& args);
-    void jobsCommand(const std::vector<std::string>& args);
-    void fgCommand(const std::vector<std::string>& args);
+    void exitCommand(const ArgList& args);
+    void cdCommand(const ArgList& args);
+    void pwdCommand(const ArgList& args);
+    void echoCommand(const ArgList& args);
+    void exportCommand(const ArgList& args);
+    void unsetCommand(const ArgList& args);
+    void historyCommand(const ArgList& args);
+    void helpCommand(const ArgList& args);
+    void jobsCommand(const ArgList& args);
+    void fgCommand(const ArgList& args);
+    void hashCommand(const ArgList& args);
+    void launcherCommand(const ArgList& args);
+    void pipesizeCommand(const ArgList& args);
+    void timeCommand(const ArgList& args);
+    void parallelCommand(const ArgList& args);
+    void catCommand(const ArgList& args);
+    void traceCommand(const ArgList& args);
+    void trueCommand(const ArgList& args);
+    void falseCommand(const ArgList& args);
+    void letCommand(const ArgList& args);
+    void testCommand(const ArgList& args);
+    void conditionCommand(const ArgList& args);
+    void readCommand(const ArgList& args);
+    void mapfileCommand(const ArgList& args);
+    void enableCommand(const ArgList& args);
     
     void registerCommands();
     
+    static size_t hashName(std::string_view name);
+    
+    /**
+     * Find a builtin by name
+     * @return Its slot, or nullptr if there is no such builtin
+     */
+    const Builtin* findBuiltin(std::string_view name) const;
+    
+    /**
+     * Get the slot for a name, claiming a free one if it is new
+     */
+    Builtin& addBuiltin(std::string_view name);
+    
+    /**
+     * Free a slot, moving later entries of its probe run back into the gap
+     */
+    void removeBuiltin(const Builtin& entry);
+    
+    /**
+     * Run a loaded builtin with the C interface
+     */
+    void runLoaded(const Builtin& builtin, const ArgList& args);
+    
+    /**
+     * Load builtins from a shared library
+     * @return false if any could not be loaded (reported)
+     */
+    bool loadBuiltins(const char* path, const ArgList& names);
+    
+    // Callbacks behind myshell_api
+    static int pluginWrite(myshell_context* context, const char* data, size_t size);
+    static const char* pluginGetVariable(myshell_context* context, const char* name);
+    static int pluginSetVariable(myshell_context* context, const char* name, const char* value);
+    
+    /**
+     * Get the buffer a reading builtin takes its input from: the shell's
+     * own buffer for a descriptor, so leftover bytes carry over to the
+     * next read, or one for this command's redirected input
+     * @param fd Descriptor given with -u (-1: the command's input)
+     */
+    InputBuffer& inputBuffer(int fd);
+
 public:
     BuiltinCommands(Shell* shellInstance);
+    ~BuiltinCommands();
+    
+    BuiltinCommands(const BuiltinCommands&) = delete;
+    BuiltinCommands& operator=(const BuiltinCommands&) = delete;
     
     /**
      * Check if a command is a built-in command
      * @param command The command name to check
      * @return true if it's a built-in command
      */
-    bool isBuiltin(const std::string& command) const;
+    bool isBuiltin(std::string_view command) const;
+    
+    /**
+     * Check if a builtin only writes to its output stream and leaves the
+     * shell's state alone, so $( ) can run it in the shell process
+     * @param command The command name to check
+     */
+    bool canCapture(std::string_view command) const;
+    
+    /**
+     * Check if a builtin reads the shell's standard input directly rather
+     * than through the shell's input buffer (cat, loaded builtins)
+     * @param command The command name to check
+     */
+    bool readsDescriptor(std::string_view command) const {
+        const Builtin* builtin = findBuiltin(command);
+        return command == "cat" || (builtin && builtin->function);
+    }
     
     /**
      * Execute a built-in command
      * @param args Command arguments (first element is the command name)
      * @return true if command was executed successfully
      */
-    bool execute(const std::vector<std::string>& args);
+    bool execute(const ArgList& args);
+    
+    /**
+     * Execute a built-in command with its standard streams replaced
+     * Lets a builtin be a pipeline stage or honor redirection without forking.
+     * @param args Command arguments (first element is the command name)
+     * @param in Input source
+     * @param inFd Descriptor behind in, for builtins that move raw data or
+     *             start commands (-1: the shell's stdin)
+     * @param out Output sink
+     * @param outFd Descriptor behind out (-1: the shell's stdout)
+     * @return true if command was executed successfully
+     */
+    bool execute(const ArgList& args, std::istream& in, int inFd, std::ostream& out, int outFd);
+    
+    /**
+     * Get the exit status of the last builtin run
+     * @return 0 on success, non-zero on failure
+     */
+    int getStatus() const { return status; }
     
     /**
      * Get list of all available built-in commands
@@ -0,0 +1,77 @@
+#ifndef BUILTIN_PLUGIN_H
+#define BUILTIN_PLUGIN_H
+
+/**
+ * C interface for builtins loaded with `enable -f library.so name`
+ *
+ * A library provides one function per builtin, named after it with
+ * "_builtin" appended ('-' in the name becomes '_'):
+ *
+ *     int checksum_builtin(int argc, char* const* argv, const myshell_api* api);
+ *
+ * The function runs inside the shell process, like any other builtin; its
+ * return value is the command's exit status. argv[0] is the name it was
+ * called by and argv[argc] is NULL. Everything in api is valid for the
+ * duration of the call only.
+ *
+ * A library may export `const unsigned myshell_builtin_abi` set to
+ * MYSHELL_BUILTIN_ABI; the shell refuses a library built for another
+ * version. Fields are only ever added at the end of myshell_api, and
+ * api->size says how many the running shell has.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MYSHELL_BUILTIN_ABI 1
+
+/**
+ * The shell's side of a call (opaque)
+ */
+typedef struct myshell_context myshell_context;
+
+typedef struct myshell_api {
+    unsigned abi_version;       /* MYSHELL_BUILTIN_ABI of the shell */
+    size_t size;                /* sizeof(myshell_api) of the shell */
+    myshell_context* context;   /* First argument of every callback */
+
+    /*
+     * Standard streams of the command: pipes and redirections are already
+     * applied. Output written to out_fd goes after anything written with
+     * write_out so far.
+     */
+    int in_fd;
+    int out_fd;
+    int err_fd;
+
+    /*
+     * Write to the command's output through the shell's buffer; cheaper
+     * than write(out_fd) for many small pieces
+     * Returns 0, or -1 on an error (such as a closed pipe)
+     */
+    int (*write_out)(myshell_context* context, const char* data, size_t size);
+
+    /*
+     * Get a variable's value (the environment first, then shell variables)
+     * Returns NULL if it is unset; the value stays valid until the
+     * variable changes.
+     */
+    const char* (*get_variable)(myshell_context* context, const char* name);
+
+    /*
+     * Set a shell variable (the environment too, if it is exported)
+     * Returns 0
+     */
+    int (*set_variable)(myshell_context* context, const char* name, const char* value);
+} myshell_api;
+
+typedef int (*myshell_builtin_fn)(int argc, char* const* argv, const myshell_api* api);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUILTIN_PLUGIN_H */
@@ -1,193 +1,723 @@
 #include "CommandExecutor.h"
 #include "IORedirection.h"
+#include "BuiltinCommands.h"
+#include "FdStream.h"
+#include "Tracer.h"
 #include <iostream>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <errno.h>
 #include <cstring>
 #include <algorithm>
+#include <chrono>
+#include <signal.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
-CommandExecutor::CommandExecutor(std::vector<pid_t>* bgProcesses) 
-    : backgroundProcesses(bgProcesses), ioHandler(nullptr) {}
+extern char **environ;
+
+namespace {
+    /**
+     * Status of a command that could not be started: 127 if it was not
+     * found, 126 if it was found but could not be run
+     */
+    int notStartedStatus(int err) {
+        return err == ENOENT ? 127 : 126;
+    }
+}
+
+CommandExecutor::CommandExecutor(JobTable* jobTable) 
+    : jobs(jobTable), ioHandler(nullptr), builtins(nullptr), backend(LaunchBackend::Fork),
+      zygote(jobTable), pipeCapacity(0), inputRedirected(false), lastStatus(0) {
+    // Let the environment pick the launch backend, e.g. MYSHELL_LAUNCHER=spawn;
+    // the zygote helper is forked here, while the shell is still small
+    const char* launcher = getenv("MYSHELL_LAUNCHER");
+    if (launcher && std::string(launcher) == "spawn") {
+        backend = LaunchBackend::Spawn;
+    } else if (launcher && std::string(launcher) == "zygote") {
+        setBackend(LaunchBackend::Zygote);
+    }
+}
+
+bool CommandExecutor::setBackend(LaunchBackend newBackend) {
+    if (newBackend == LaunchBackend::Zygote && !zygote.start()) {
+        return false;
+    }
+    backend = newBackend;
+    return true;
+}
 
 void CommandExecutor::setIOHandler(IORedirection* handler) {
     ioHandler = handler;
 }
 
-void CommandExecutor::executeSimpleCommand(const std::vector<std::string>& args) {
-    if (args.empty()) return;
+void LaunchSpec::setStage(const PipelineStage& stage) {
+    argv = stage.args.argv();
+    inputFile = stage.inputFile.empty() ? nullptr : stage.inputFile.data();
+    outputFile = stage.outputFile.empty() ? nullptr : stage.outputFile.data();
+    appendOutput = stage.appendOutput;
+}
+
+void CommandExecutor::executeSimpleCommand(const char* path, char* const* argv) {
+    if (!argv || !argv[0]) return;
     
-    // Convert string vector to char* array for execvp
-    std::vector<char*> c_args;
-    for (const std::string& arg : args) {
-        c_args.push_back(const_cast<char*>(arg.c_str()));
+    // Execute the command by its resolved path; if that location has gone
+    // stale since it was cached, fall back to a normal PATH search
+    if (path) {
+        execv(path, argv);
     }
-    c_args.push_back(nullptr);
-    
-    // Execute the command
-    execvp(c_args[0], c_args.data());
+    execvp(argv[0], argv);
     
     // If we reach here, execvp failed
+    int err = errno;
     std::cerr << "MyShell Error: Command not found or failed to execute '" 
-              << c_args[0] << "' (" << strerror(errno) << ")\n";
-    exit(EXIT_FAILURE);
+              << argv[0] << "' (" << strerror(err) << ")\n";
+    exit(notStartedStatus(err));
 }
 
-void CommandExecutor::execute(const ParsedCommand& cmd) {
-    if (cmd.args.empty()) return;
-    
-    // Handle piped commands
-    if (cmd.hasPipe) {
-        executeWithPipe(cmd);
-        return;
-    }
-    
-    // Fork a new process for the command
+pid_t CommandExecutor::launchWithFork(const LaunchSpec& spec) {
     pid_t pid = fork();
     
     if (pid == -1) {
         std::cerr << "MyShell Error: Failed to fork process (" 
                   << strerror(errno) << ")\n";
-        return;
+        return -1;
     }
     
     if (pid == 0) {
-        // Child process
+        // Child process: Ctrl+C and broken pipes should reach the command
+        // even though the shell itself ignores them
+        signal(SIGINT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        
+        // Wire up pipes first so file redirection can override them
+        if (!ioHandler->setupStream(spec.inputFd, STDIN_FILENO) ||
+            !ioHandler->setupStream(spec.outputFd, STDOUT_FILENO)) {
+            exit(EXIT_FAILURE);
+        }
+        if (spec.closeFd != -1) {
+            close(spec.closeFd);
+        }
         
         // Handle input redirection
-        if (!cmd.inputFile.empty()) {
-            if (!ioHandler->setupInputRedirection(cmd.inputFile)) {
+        if (spec.inputFile) {
+            if (!ioHandler->setupInputRedirection(spec.inputFile)) {
                 exit(EXIT_FAILURE);
             }
         }
         
         // Handle output redirection
-        if (!cmd.outputFile.empty()) {
-            if (!ioHandler->setupOutputRedirection(cmd.outputFile, cmd.appendOutput)) {
+        if (spec.outputFile) {
+            if (!ioHandler->setupOutputRedirection(spec.outputFile, spec.appendOutput)) {
                 exit(EXIT_FAILURE);
             }
         }
         
+        if (Tracer::enabled()) {
+            Tracer::record(Tracer::Instant, "exec", spec.argv ? spec.argv[0] : "", getpid());
+        }
+        
         // Execute the command
-        executeSimpleCommand(cmd.args);
-    } else {
-        // Parent process
-        if (cmd.background) {
-            // Add to background processes list
-            backgroundProcesses->push_back(pid);
-            std::cout << "[Background] Process " << pid << " started: ";
-            for (const auto& arg : cmd.args) {
-                std::cout << arg << " ";
-            }
-            std::cout << "\n";
+        executeSimpleCommand(spec.path, spec.argv);
+    }
+    
+    return pid;
+}
+
+pid_t CommandExecutor::launchWithSpawn(const LaunchSpec& spec) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+    
+    // Same order as the fork path: pipes, stray descriptors, then files
+    bool ok = ioHandler->addSpawnStream(&actions, spec.inputFd, STDIN_FILENO) &&
+              ioHandler->addSpawnStream(&actions, spec.outputFd, STDOUT_FILENO);
+    if (ok && spec.closeFd != -1) {
+        ok = posix_spawn_file_actions_addclose(&actions, spec.closeFd) == 0;
+    }
+    ok = ok && ioHandler->addSpawnRedirection(&actions, spec.inputFile, 
+                                              spec.outputFile, spec.appendOutput);
+    
+    // Restore default SIGINT and SIGPIPE handling in the child
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+    
+    pid_t pid = -1;
+    if (ok) {
+        int err;
+        if (spec.path) {
+            err = posix_spawn(&pid, spec.path, &actions, &attr, spec.argv, environ);
         } else {
-            // Wait for foreground process to complete
-            int status;
-            if (waitpid(pid, &status, 0) == -1) {
-                std::cerr << "MyShell Error: waitpid failed (" 
-                          << strerror(errno) << ")\n";
-            } else {
-                // Optionally check exit status
-                if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-                    // Command exited with non-zero status
-                    // Could print this for debugging, but usually not needed
-                }
+            err = posix_spawnp(&pid, spec.argv[0], &actions, &attr, spec.argv, environ);
+        }
+        
+        if (err != 0) {
+            std::cerr << "MyShell Error: Command not found or failed to execute '" 
+                      << spec.argv[0] << "' (" << strerror(err) << ")\n";
+            pid = -1;
+        }
+        errno = err;
+    }
+    
+    // The caller reports the failure by errno (ENOENT: not found)
+    int savedErrno = errno;
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    errno = savedErrno;
+    return pid;
+}
+
+bool CommandExecutor::canSpawn(const LaunchSpec& spec) const {
+    // Every pipe and redirection the parser can produce has a file action
+    // equivalent; only a launch with nothing to exec has to go through fork,
+    // where it is reported the usual way
+    return spec.argv != nullptr && spec.argv[0] != nullptr;
+}
+
+pid_t CommandExecutor::launch(const LaunchSpec& spec) {
+    bool useSpawn = backend == LaunchBackend::Spawn && canSpawn(spec);
+    bool useZygote = backend == LaunchBackend::Zygote && canSpawn(spec);
+    
+    // Anything the shell buffered must reach the terminal before the child's
+    // output, and must not be inherited by a forked child
+    std::cout.flush();
+    
+    uint64_t traceStart = Tracer::enabled() ? Tracer::now() : 0;
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = -1;
+    int launchError = 0;
+    {
+        TraceScope trace(useZygote ? "zygote" : useSpawn ? "spawn" : "fork", 
+                         spec.argv ? spec.argv[0] : "");
+        if (useZygote) {
+            // The helper still has the stdin the shell started with
+            LaunchSpec request = spec;
+            if (inputRedirected && request.inputFd == -1) {
+                request.inputFd = STDIN_FILENO;
             }
+            pid = zygote.spawn(request);
+            if (pid == -1 && errno != E2BIG && errno != ECHILD) {
+                std::cerr << "MyShell Error: Launch helper failed to start '" 
+                          << spec.argv[0] << "' (" << strerror(errno) << ")\n";
+                return -1;
+            }
+            // Too many arguments for one request, or no helper: start it here
+            useZygote = pid != -1;
+        }
+        if (!useZygote) {
+            pid = useSpawn ? launchWithSpawn(spec) : launchWithFork(spec);
         }
+        launchError = errno;
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (pid == -1) {
+        // Callers tell a command that was not found from other failures
+        errno = launchError;
+        return -1;
+    }
+    
+    // The child gets its own lane, spanning from launch until it is reaped
+    if (pid > 0 && Tracer::enabled()) {
+        Tracer::record(Tracer::ProcessName, "process_name", spec.argv[0], pid);
+        Tracer::record(Tracer::Begin, "process", spec.argv[0], pid, traceStart);
     }
+    
+    if (pid > 0) {
+        LaunchStats& stats = useZygote ? zygoteStats : useSpawn ? spawnStats : forkStats;
+        double micros = std::chrono::duration<double, std::micro>(end - start).count();
+        stats.launches++;
+        stats.totalMicros += micros;
+        stats.maxMicros = std::max(stats.maxMicros, micros);
+    }
+    
+    return pid;
 }
 
-void CommandExecutor::executeWithPipe(const ParsedCommand& cmd) {
-    if (!ioHandler || cmd.args.empty() || cmd.pipeCommand.empty()) {
-        std::cerr << "MyShell Error: Invalid pipe command\n";
+const LaunchStats& CommandExecutor::getLaunchStats(LaunchBackend which) const {
+    switch (which) {
+        case LaunchBackend::Spawn: return spawnStats;
+        case LaunchBackend::Zygote: return zygoteStats;
+        default: return forkStats;
+    }
+}
+
+void CommandExecutor::resetLaunchStats() {
+    forkStats = LaunchStats();
+    spawnStats = LaunchStats();
+    zygoteStats = LaunchStats();
+}
+
+void CommandExecutor::execute(const ParsedCommand& cmd) {
+    if (cmd.stages.empty() || cmd.stages[0].args.empty()) return;
+    TraceScope trace("execute");
+    
+    // Handle piped commands
+    if (cmd.hasPipe()) {
+        executeWithPipe(cmd);
         return;
     }
     
-    int pipefd[2];
-    if (!ioHandler->createPipe(pipefd)) {
+    const PipelineStage& stage = cmd.stages[0];
+    
+    if (isBuiltinStage(stage) && !cmd.background) {
+        lastRun.stages.clear();
+        lastStatus = runBuiltin(stage, -1, -1);
         return;
     }
     
-    // Fork first process (writer)
-    pid_t pid1 = fork();
-    if (pid1 == -1) {
-        std::cerr << "MyShell Error: Failed to fork first process (" 
-                  << strerror(errno) << ")\n";
-        ioHandler->closePipe(pipefd);
+    LaunchSpec spec;
+    spec.setStage(stage);
+    // Resolve the executable in the shell so the child doesn't probe PATH
+    spec.path = pathCache.resolve(spec.argv[0]);
+    
+    int hereFd = -1;
+    if (stage.hasHereInput() && !isBuiltinStage(stage)) {
+        hereFd = openHereInput(stage);
+        if (hereFd == -1) {
+            lastStatus = 1;
+            return;
+        }
+        spec.inputFd = hereFd;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    lastRun.stages.clear();
+    
+    pid_t pid = isBuiltinStage(stage) ? startBuiltin(stage, -1, -1, -1) : launch(spec);
+    if (hereFd != -1) {
+        close(hereFd);
+    }
+    if (pid == -1) {
+        lastStatus = notStartedStatus(errno);
         return;
     }
     
-    if (pid1 == 0) {
-        // First child process (writer)
-        ioHandler->setupPipe(pipefd, true); // Setup as writer
-        
-        // Handle input redirection for first command
-        if (!cmd.inputFile.empty()) {
-            if (!ioHandler->setupInputRedirection(cmd.inputFile)) {
-                exit(EXIT_FAILURE);
+    if (cmd.background) {
+        pipelinePids.clear();
+        pipelinePids.push_back(pid);
+        startJob(cmd, pipelinePids);
+        lastStatus = 0;
+    } else {
+        // Wait for foreground process to complete
+        int status = waitForeground(pid);
+        lastStatus = status == -1 ? 127 : exitStatus(status);
+        lastRun.wallMicros = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int CommandExecutor::openHereInput(const PipelineStage& stage) {
+    if (stage.hereDocFd == -1) {
+        return ioHandler->openHereString(stage.hereString);
+    }
+    
+    // The body stays with the parsed command, so every run gets its own
+    // descriptor that starts from the beginning
+    int fd = fcntl(stage.hereDocFd, F_DUPFD_CLOEXEC, 0);
+    if (fd == -1) {
+        std::cerr << "MyShell Error: Cannot open here-document: " 
+                  << strerror(errno) << "\n";
+        return -1;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+bool CommandExecutor::isBuiltinStage(const PipelineStage& stage) const {
+    return builtins && !stage.args.empty() && builtins->isBuiltin(stage.args[0]);
+}
+
+int CommandExecutor::runBuiltin(const PipelineStage& stage, int inputFd, int outputFd) {
+    TraceScope trace("builtin", stage.args[0]);
+    
+    // Plain builtins keep using the shell's own streams
+    if (inputFd == -1 && outputFd == -1 && stage.inputFile.empty() && 
+        stage.outputFile.empty() && !stage.hasHereInput()) {
+        builtins->execute(stage.args);
+        return builtins->getStatus();
+    }
+    
+    int openedInput = -1;
+    int openedOutput = -1;
+    if (stage.hasHereInput()) {
+        openedInput = openHereInput(stage);
+        if (openedInput == -1) {
+            return 1;
+        }
+        inputFd = openedInput;
+    } else if (!stage.inputFile.empty()) {
+        openedInput = ioHandler->openInputFile(std::string(stage.inputFile));
+        if (openedInput == -1) {
+            return 1;
+        }
+        inputFd = openedInput;
+    }
+    if (!stage.outputFile.empty()) {
+        openedOutput = ioHandler->openOutputFile(std::string(stage.outputFile), 
+                                                 stage.appendOutput);
+        if (openedOutput == -1) {
+            if (openedInput != -1) {
+                close(openedInput);
             }
+            return 1;
         }
-        
-        executeSimpleCommand(cmd.args);
+        outputFd = openedOutput;
     }
     
-    // Fork second process (reader)
-    pid_t pid2 = fork();
-    if (pid2 == -1) {
-        std::cerr << "MyShell Error: Failed to fork second process (" 
+    std::cout.flush();
+    {
+        FdIStream in(inputFd);
+        FdOStream out(outputFd);
+        builtins->execute(stage.args, 
+                          inputFd == -1 ? static_cast<std::istream&>(std::cin) : in, inputFd,
+                          outputFd == -1 ? static_cast<std::ostream&>(std::cout) : out, outputFd);
+    }
+    
+    if (openedInput != -1) {
+        close(openedInput);
+    }
+    if (openedOutput != -1) {
+        close(openedOutput);
+    }
+    return builtins->getStatus();
+}
+
+pid_t CommandExecutor::startBuiltin(const PipelineStage& stage, int inputFd, int outputFd, 
+                                    int closeFd) {
+    // Nothing buffered may be inherited and written twice
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == -1) {
+        std::cerr << "MyShell Error: Failed to fork process (" 
                   << strerror(errno) << ")\n";
-        ioHandler->closePipe(pipefd);
+        return -1;
+    }
+    
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        if (closeFd != -1) {
+            close(closeFd);
+        }
+        
+        // Children of the launch helper would report their exits to the
+        // shell, so commands the builtin starts are forked here
+        setBackend(LaunchBackend::Fork);
+        int status = runBuiltin(stage, inputFd, outputFd);
+        std::cout.flush();
+        _exit(status);
+    }
+    return pid;
+}
+
+pid_t CommandExecutor::startCommand(char* const* argv, int inputFd, int outputFd) {
+    if (!argv || !argv[0]) return -1;
+    
+    LaunchSpec spec;
+    spec.argv = argv;
+    spec.path = pathCache.resolve(argv[0]);
+    spec.inputFd = inputFd;
+    spec.outputFd = outputFd;
+    return launch(spec);
+}
+
+void CommandExecutor::executeWithPipe(const ParsedCommand& cmd) {
+    TraceScope trace("pipeline");
+    
+    if (!ioHandler) {
+        std::cerr << "MyShell Error: Invalid pipe command\n";
         return;
     }
+    for (const PipelineStage& stage : cmd.stages) {
+        if (stage.args.empty()) {
+            std::cerr << "MyShell Error: Invalid pipe command\n";
+            return;
+        }
+    }
+    
+    std::vector<pid_t>& pids = pipelinePids;
+    pids.clear();
+    
+    // Read end of the pipe feeding the next stage (-1 for the first stage)
+    int prevRead = -1;
+    bool lastStarted = false;
+    int lastError = 0;      // Why the last stage failed to start
+    int builtinStatus = 0;
+    
+    // The last builtin stage may stream into external stages after it, so
+    // it runs once those have started; earlier builtins run as reached.
+    // In the background every builtin gets a process of its own instead.
+    size_t lastBuiltin = cmd.stages.size();
+    for (size_t i = 0; i < cmd.stages.size() && !cmd.background; i++) {
+        if (isBuiltinStage(cmd.stages[i])) {
+            lastBuiltin = i;
+        }
+    }
+    const PipelineStage* deferred = nullptr;
+    int deferredInput = -1;
+    int deferredOutput = -1;
     
-    if (pid2 == 0) {
-        // Second child process (reader)
-        ioHandler->setupPipe(pipefd, false); // Setup as reader
+    auto start = std::chrono::steady_clock::now();
+    lastRun.stages.clear();
+    
+    for (size_t i = 0; i < cmd.stages.size(); i++) {
+        const PipelineStage& stage = cmd.stages[i];
+        bool isLast = i + 1 == cmd.stages.size();
         
-        // Handle output redirection for second command
-        if (!cmd.outputFile.empty()) {
-            if (!ioHandler->setupOutputRedirection(cmd.outputFile, cmd.appendOutput)) {
-                exit(EXIT_FAILURE);
+        if (i == lastBuiltin && !isLast) {
+            // Keep both ends of this builtin's streams away from the
+            // external stages started before it runs
+            int pipefd[2];
+            if (!ioHandler->createPipe(pipefd)) {
+                break;
             }
+            if (pipeCapacity > 0) {
+                ioHandler->setPipeCapacity(pipefd, pipeCapacity);
+            }
+            fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+            if (prevRead != -1) {
+                fcntl(prevRead, F_SETFD, FD_CLOEXEC);
+            }
+            
+            deferred = &stage;
+            deferredInput = prevRead;
+            deferredOutput = pipefd[1];
+            prevRead = pipefd[0];
+            continue;
         }
         
-        executeSimpleCommand(cmd.pipeCommand);
+        if (isBuiltinStage(stage) && !cmd.background) {
+            // Output goes to the terminal for the last stage, otherwise to
+            // an in-memory file read by the stages after it
+            int outputFd = -1;
+            if (!isLast) {
+                outputFd = memfd_create("pipeline", MFD_CLOEXEC);
+                if (outputFd == -1) {
+                    std::cerr << "MyShell Error: Failed to buffer pipeline stage: " 
+                              << strerror(errno) << "\n";
+                    break;
+                }
+            }
+            
+            builtinStatus = runBuiltin(stage, prevRead, outputFd);
+            
+            if (prevRead != -1) {
+                close(prevRead);
+            }
+            if (outputFd != -1) {
+                lseek(outputFd, 0, SEEK_SET);
+            }
+            prevRead = outputFd;
+            continue;
+        }
+        
+        int pipefd[2] = {-1, -1};
+        if (!isLast) {
+            if (!ioHandler->createPipe(pipefd)) {
+                break;
+            }
+            if (pipeCapacity > 0) {
+                ioHandler->setPipeCapacity(pipefd, pipeCapacity);
+            }
+        }
+        
+        // A stage that fails to start just leaves its neighbours with a
+        // closed pipe, the same as a command that exits immediately
+        pid_t pid;
+        int hereFd = -1;
+        if (isBuiltinStage(stage)) {
+            pid = startBuiltin(stage, prevRead, pipefd[1], pipefd[0]);
+        } else {
+            LaunchSpec spec;
+            spec.setStage(stage);
+            spec.path = pathCache.resolve(spec.argv[0]);
+            spec.inputFd = prevRead;
+            spec.outputFd = pipefd[1];
+            spec.closeFd = pipefd[0];
+            
+            // Here input replaces the pipe from the previous stage
+            hereFd = stage.hasHereInput() ? openHereInput(stage) : -1;
+            if (hereFd != -1) {
+                spec.inputFd = hereFd;
+            }
+            pid = launch(spec);
+        }
+        if (pid != -1) {
+            pids.push_back(pid);
+        } else if (isLast) {
+            lastError = errno;
+        }
+        if (hereFd != -1) {
+            close(hereFd);
+        }
+        lastStarted = isLast && pid != -1;
+        
+        // The parent keeps only the read end for the next stage
+        if (prevRead != -1) {
+            close(prevRead);
+        }
+        if (pipefd[1] != -1) {
+            close(pipefd[1]);
+        }
+        prevRead = pipefd[0];
+    }
+    
+    if (prevRead != -1) {
+        close(prevRead);
     }
     
-    // Parent process
-    ioHandler->closePipe(pipefd);
+    if (deferred) {
+        // Everything downstream is running; stream into it
+        runBuiltin(*deferred, deferredInput, deferredOutput);
+        if (deferredInput != -1) {
+            close(deferredInput);
+        }
+        close(deferredOutput);
+    }
     
     if (cmd.background) {
-        // Add both processes to background list
-        backgroundProcesses->push_back(pid1);
-        backgroundProcesses->push_back(pid2);
-        std::cout << "[Background] Pipe processes " << pid1 << " | " << pid2 << " started\n";
+        startJob(cmd, pids);
+        lastStatus = 0;
     } else {
-        // Wait for both processes
-        int status1, status2;
-        waitpid(pid1, &status1, 0);
-        waitpid(pid2, &status2, 0);
+        // Wait for every stage; the pipeline's status is the last stage's
+        int status = -1;
+        for (pid_t pid : pids) {
+            status = waitForeground(pid);
+        }
+        if (lastBuiltin + 1 == cmd.stages.size()) {
+            lastStatus = builtinStatus;
+        } else {
+            lastStatus = !lastStarted ? notStartedStatus(lastError) :
+                         status == -1 ? 127 : exitStatus(status);
+        }
+        lastRun.wallMicros = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
     }
 }
 
-void CommandExecutor::cleanupBackgroundProcesses() {
-    auto it = backgroundProcesses->begin();
-    while (it != backgroundProcesses->end()) {
-        int status;
-        pid_t result = waitpid(*it, &status, WNOHANG);
-        
-        if (result > 0) {
-            std::cout << "[Background] Process " << *it << " completed";
-            if (WIFEXITED(status)) {
-                std::cout << " (exit status: " << WEXITSTATUS(status) << ")";
+void CommandExecutor::startJob(const ParsedCommand& cmd, const std::vector<pid_t>& pids) {
+    if (pids.empty()) {
+        return;
+    }
+    
+    std::string command;
+    for (size_t i = 0; i < cmd.stages.size(); i++) {
+        if (i > 0) {
+            command += " |";
+        }
+        for (const auto& arg : cmd.stages[i].args) {
+            if (!command.empty()) {
+                command += ' ';
             }
-            std::cout << "\n";
-            it = backgroundProcesses->erase(it);
-        } else if (result == -1) {
-            // Process doesn't exist
-            it = backgroundProcesses->erase(it);
-        } else {
-            ++it;
+            command += arg;
+        }
+    }
+    
+    int id = jobs->add(pids, command);
+    std::cout << "[" << id << "]";
+    for (pid_t pid : pids) {
+        std::cout << " " << pid;
+    }
+    std::cout << " started: " << command << "\n";
+}
+
+pid_t CommandExecutor::waitProcess(pid_t pid, int& status, struct rusage& usage) {
+    // A builtin in the same pipeline (e.g. parallel) may have reaped it already
+    if (jobs->takeStray(pid, status, usage)) {
+        return pid;
+    }
+    
+    TraceScope trace("wait");
+    if (zygote.owns(pid)) {
+        return zygote.wait(pid, status, usage);
+    }
+    
+    pid_t result;
+    do {
+        result = wait4(pid, &status, 0, &usage);
+    } while (result == -1 && errno == EINTR);
+    if (result != -1) {
+        Tracer::record(Tracer::End, "process", std::string_view(), pid);
+    }
+    return result;
+}
+
+pid_t CommandExecutor::waitAnyProcess(int& status, struct rusage& usage) {
+    // startCommand() children all come from the current backend
+    if (backend == LaunchBackend::Zygote && zygote.hasChildren()) {
+        return zygote.wait(-1, status, usage);
+    }
+    
+    pid_t pid;
+    do {
+        pid = wait4(-1, &status, 0, &usage);
+    } while (pid == -1 && errno == EINTR);
+    if (pid != -1) {
+        Tracer::record(Tracer::End, "process", std::string_view(), pid);
+    }
+    return pid;
+}
+
+int CommandExecutor::waitCommand(pid_t pid) {
+    int status;
+    struct rusage usage;
+    if (waitProcess(pid, status, usage) == -1) {
+        std::cerr << "MyShell Error: waitpid failed (" 
+                  << strerror(errno) << ")\n";
+        return 1;
+    }
+    return exitStatus(status);
+}
+
+bool CommandExecutor::waitJob(int id) {
+    JobTable::Job* job = jobs->find(id);
+    if (!job) {
+        return false;
+    }
+    
+    bool ok = true;
+    for (pid_t pid : job->pids) {
+        if (!jobs->findByPid(pid)) {
+            // Already exited
+            continue;
         }
+        
+        int status;
+        struct rusage usage;
+        if (waitProcess(pid, status, usage) == -1) {
+            ok = false;
+            // Nothing left to wait for; don't let the job linger as running
+            status = 0;
+        }
+        jobs->recordExit(pid, status);
+    }
+    return ok;
+}
+
+int CommandExecutor::waitForeground(pid_t pid) {
+    StageUsage stage;
+    stage.pid = pid;
+    
+    pid_t result = waitProcess(pid, stage.status, stage.usage);
+    if (result == -1) {
+        std::cerr << "MyShell Error: waitpid failed (" 
+                  << strerror(errno) << ")\n";
+        return -1;
+    }
+    
+    lastRun.stages.push_back(stage);
+    return stage.status;
+}
+
+int CommandExecutor::exitStatus(int waitStatus) {
+    if (WIFSIGNALED(waitStatus)) {
+        return 128 + WTERMSIG(waitStatus);
     }
-}
\ No newline at end of file
+    return WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : 0;
+}
@@ -2,29 +2,196 @@
 #define COMMAND_EXECUTOR_H
 
 #include "CommandParser.h"
+#include "PathCache.h"
+#include "JobTable.h"
+#include "Zygote.h"
 #include <vector>
 #include <sys/types.h>
+#include <sys/resource.h>
 
 class IORedirection; // Forward declaration
+class BuiltinCommands;
+
+/**
+ * Ways of creating a child process for an external command
+ * - Fork: fork() then set up redirection and exec in the child
+ * - Spawn: posix_spawn() with redirection expressed as file actions,
+ *   which avoids copying the shell's page tables
+ * - Zygote: ask a small helper process forked at startup to fork and
+ *   exec, so the cost does not grow with the shell
+ */
+enum class LaunchBackend { Fork, Spawn, Zygote };
+
+/**
+ * Everything needed to start one external command
+ * Strings are borrowed (usually from a ParsedCommand), so building a spec
+ * does not allocate.
+ */
+struct LaunchSpec {
+    const char* path;                       // Resolved executable path (nullptr: search PATH)
+    char* const* argv;                      // nullptr-terminated command and arguments
+    int inputFd;                            // Descriptor to use as stdin (-1: inherit)
+    int outputFd;                           // Descriptor to use as stdout (-1: inherit)
+    int closeFd;                            // Descriptor the child must not keep open (-1: none)
+    const char* inputFile;                  // Input redirection file (nullptr: none)
+    const char* outputFile;                 // Output redirection file (nullptr: none)
+    bool appendOutput;                      // Whether to append (>>) or overwrite (>)
+    
+    LaunchSpec() : path(nullptr), argv(nullptr), inputFd(-1), outputFd(-1), closeFd(-1),
+                   inputFile(nullptr), outputFile(nullptr), appendOutput(false) {}
+    
+    /**
+     * Fill in arguments and redirections from a parsed pipeline stage
+     * @param stage The stage to run
+     */
+    void setStage(const PipelineStage& stage);
+};
+
+/**
+ * Launch latency counters for one backend
+ * Latency is the time the shell is blocked creating the child
+ */
+struct LaunchStats {
+    unsigned long launches;
+    double totalMicros;
+    double maxMicros;
+    
+    LaunchStats() : launches(0), totalMicros(0), maxMicros(0) {}
+};
+
+/**
+ * Resources used by one process of a foreground command, from wait4()
+ */
+struct StageUsage {
+    pid_t pid;
+    int status;                 // Raw wait status
+    struct rusage usage;
+};
+
+/**
+ * Accounting for the last foreground command
+ */
+struct RunUsage {
+    std::vector<StageUsage> stages;     // One per started process, first stage first
+    double wallMicros;                  // From the first launch to the last exit
+    
+    RunUsage() : wallMicros(0) {}
+};
 
 /**
  * CommandExecutor handles the execution of external commands
  * Responsibilities:
- * - Fork processes for command execution
+ * - Fork or spawn processes for command execution
  * - Handle simple command execution
- * - Handle piped command execution
- * - Manage background processes
+ * - Handle piped command execution (any number of stages)
+ * - Register background pipelines as jobs
+ * - Run builtin stages in the shell process with their streams replaced
  * - Coordinate with IORedirection for file operations
+ * - Resolve command paths once in the shell through PathCache
  */
 class CommandExecutor {
 private:
-    std::vector<pid_t>* backgroundProcesses;
+    JobTable* jobs;
     IORedirection* ioHandler;
+    BuiltinCommands* builtins;
+    PathCache pathCache;
+    LaunchBackend backend;
+    LaunchStats forkStats;
+    LaunchStats spawnStats;
+    LaunchStats zygoteStats;
+    Zygote zygote;
+    size_t pipeCapacity;    // Requested pipe buffer size in bytes (0: kernel default)
+    bool inputRedirected;   // The shell's stdin is no longer the one it started with
+    std::vector<pid_t> pipelinePids;    // Reused list of running pipeline stages
+    RunUsage lastRun;
+    int lastStatus;         // Exit status of the last command, as $? reports it
+    
+    /**
+     * Replace the current (child) process with the command
+     * @param path Resolved executable path, or nullptr to let execvp search PATH
+     * @param argv nullptr-terminated command and arguments
+     */
+    void executeSimpleCommand(const char* path, char* const* argv);
+    
+    /**
+     * Start a command with the selected backend
+     * Falls back to fork when the spec cannot be expressed as a spawn.
+     * @param spec What to run and how to wire its standard streams
+     * @return pid of the child, or -1 on failure
+     */
+    pid_t launch(const LaunchSpec& spec);
+    
+    pid_t launchWithFork(const LaunchSpec& spec);
+    pid_t launchWithSpawn(const LaunchSpec& spec);
+    
+    /**
+     * Check whether the spawn backend can express a launch
+     * @param spec The launch to check
+     * @return true if posix_spawn can be used
+     */
+    bool canSpawn(const LaunchSpec& spec) const;
+    
+    /**
+     * Add started processes to the job table and announce the job
+     * @param cmd The command that was started
+     * @param pids Its processes, first stage first
+     */
+    void startJob(const ParsedCommand& cmd, const std::vector<pid_t>& pids);
+    
+    /**
+     * Check whether a stage runs as a builtin
+     * @param stage The stage
+     * @return true if its command is a builtin
+     */
+    bool isBuiltinStage(const PipelineStage& stage) const;
+    
+    /**
+     * Open the here-document or here-string feeding a stage
+     * @param stage The stage (must have here input)
+     * @return A descriptor positioned at the start of the text, which the
+     *         caller closes, or -1 on error
+     */
+    int openHereInput(const PipelineStage& stage);
+    
+    /**
+     * Run a builtin in the shell process, honoring its redirections
+     * File redirection overrides the given descriptors, as for external commands.
+     * @param stage The stage to run
+     * @param inputFd Descriptor to read from (-1: the shell's stdin)
+     * @param outputFd Descriptor to write to (-1: the shell's stdout)
+     * @return The builtin's exit status
+     */
+    int runBuiltin(const PipelineStage& stage, int inputFd, int outputFd);
     
-    void executeSimpleCommand(const std::vector<std::string>& args);
+    /**
+     * Run a builtin in a child process, for a command that runs in the
+     * background and must not hold up the shell
+     * @param stage The stage to run
+     * @param inputFd Descriptor to read from (-1: the shell's stdin)
+     * @param outputFd Descriptor to write to (-1: the shell's stdout)
+     * @param closeFd Descriptor the child must close (-1: none)
+     * @return Child PID, or -1 on error
+     */
+    pid_t startBuiltin(const PipelineStage& stage, int inputFd, int outputFd, int closeFd);
+    
+    /**
+     * Wait for one started process, however it was started
+     * @param pid The process
+     * @param status Receives its raw wait status
+     * @param usage Receives its resource usage
+     * @return pid, or -1 if waiting failed
+     */
+    pid_t waitProcess(pid_t pid, int& status, struct rusage& usage);
     
+    /**
+     * Wait for a foreground process and record its resource usage
+     * @param pid The process
+     * @return Its raw wait status, or -1 if waiting failed
+     */
+    int waitForeground(pid_t pid);
+
 public:
-    CommandExecutor(std::vector<pid_t>* bgProcesses);
+    CommandExecutor(JobTable* jobTable);
     
     /**
      * Set the IO redirection handler
@@ -32,6 +199,12 @@ public:
      */
     void setIOHandler(IORedirection* handler);
     
+    /**
+     * Set the builtin commands that may appear as pipeline stages
+     * @param commands Pointer to BuiltinCommands instance (nullptr: none)
+     */
+    void setBuiltins(BuiltinCommands* commands) { builtins = commands; }
+    
     /**
      * Execute a parsed command with all its features
      * @param cmd The parsed command structure
@@ -39,15 +212,113 @@ public:
     void execute(const ParsedCommand& cmd);
     
     /**
-     * Execute a command with pipe support
+     * Execute a pipeline of any number of stages and wait for all of them
+     * Builtin stages run in the shell. One whose output feeds only external
+     * stages runs after those are started and writes into the pipe; one
+     * followed by another builtin writes to an in-memory file that the next
+     * stages read once it is done, so the shell never blocks on itself.
      * @param cmd The parsed command with pipe information
      */
     void executeWithPipe(const ParsedCommand& cmd);
     
     /**
-     * Clean up finished background processes
+     * Start one external command without waiting for it
+     * Used by builtins that manage their own children, like parallel.
+     * @param argv nullptr-terminated command and arguments
+     * @param inputFd Descriptor to use as stdin (-1: inherit)
+     * @param outputFd Descriptor to use as stdout (-1: inherit)
+     * @return pid of the child, or -1 on failure
+     */
+    pid_t startCommand(char* const* argv, int inputFd, int outputFd);
+    
+    /**
+     * Wait for whichever command started with startCommand() exits first
+     * Processes of other commands may be returned too; the caller passes
+     * those on to the job table.
+     * @param status Receives its raw wait status
+     * @param usage Receives its resource usage
+     * @return The process, or -1 with errno set (ECHILD: none left)
+     */
+    pid_t waitAnyProcess(int& status, struct rusage& usage);
+    
+    /**
+     * Wait for one command started with startCommand()
+     * @param pid The process
+     * @return Its exit status, as $? reports it (1 if waiting failed)
+     */
+    int waitCommand(pid_t pid);
+    
+    /**
+     * Wait for the remaining processes of a background job
+     * @param id The job
+     * @return true if successful, false if waiting failed
+     */
+    bool waitJob(int id);
+    
+    /**
+     * Pass exits reported by the launch helper to the job table, without
+     * blocking
+     */
+    void collectExits() { zygote.collect(); }
+    
+    /**
+     * Get the exit status of the last command run
+     * @return 0-255, 128 + N for a command killed by signal N, 127 if it
+     *         could not be started
+     */
+    int getLastStatus() const { return lastStatus; }
+    
+    /**
+     * Get the resource usage of the last foreground command
+     * @return Per-process usage and wall time
+     */
+    const RunUsage& getLastRun() const { return lastRun; }
+    
+    /**
+     * Convert a raw wait status to a shell exit status
+     * @param waitStatus Status from waitpid() or wait4()
+     * @return The exit code, or 128 + N for a process killed by signal N
+     */
+    static int exitStatus(int waitStatus);
+    
+    /**
+     * Get the resolved command path cache
+     * @return Reference to the executor's PathCache
+     */
+    PathCache& getPathCache() { return pathCache; }
+    
+    /**
+     * Select how external commands are started
+     * @param newBackend The backend to use for subsequent launches
+     * @return true if successful, false if the zygote helper could not be
+     *         started (the backend is left alone)
+     */
+    bool setBackend(LaunchBackend newBackend);
+    LaunchBackend getBackend() const { return backend; }
+    
+    /**
+     * Tell the executor the shell's stdin was replaced (a loop's `< file`),
+     * so the launch helper passes it on instead of its own
+     * @param redirected Whether stdin differs from the one at startup
+     */
+    void setInputRedirected(bool redirected) { inputRedirected = redirected; }
+    
+    /**
+     * Get launch latency counters
+     * @param which The backend to report on
+     * @return Counters accumulated since startup or the last reset
+     */
+    const LaunchStats& getLaunchStats(LaunchBackend which) const;
+    bool isZygoteRunning() const { return zygote.running(); }
+    void resetLaunchStats();
+    
+    /**
+     * Set the buffer size of pipes created between pipeline stages
+     * Larger pipes let high-volume stages run longer between context switches.
+     * @param bytes Requested capacity, or 0 for the kernel default
      */
-    void cleanupBackgroundProcesses();
+    void setPipeCapacity(size_t bytes) { pipeCapacity = bytes; }
+    size_t getPipeCapacity() const { return pipeCapacity; }
 };
 
 #endif // COMMAND_EXECUTOR_H
\ No newline at end of file
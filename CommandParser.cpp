@@ -1,111 +1,1774 @@
 #include "CommandParser.h"
-#include <sstream>
+#include "Tracer.h"
+#include <iostream>
 #include <algorithm>
 #include <cctype>
 #include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <unistd.h>
+
+namespace {
+    inline bool isNameChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+    
+    inline bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+    
+    inline bool isOperatorChar(char c) {
+        return c == '|' || c == '<' || c == '>' || c == '&' || 
+               c == ';' || c == '(' || c == ')' || c == '\n';
+    }
+    
+    /**
+     * Characters that end a run of plain word text, as a lookup table so
+     * the lexer's inner loop is one load per character
+     */
+    struct WordBreaks {
+        bool table[256] = {};
+        
+        constexpr WordBreaks() {
+            for (const char* c = " \t\r\n|<>&;()'\"\\$`"; *c; c++) {
+                table[static_cast<unsigned char>(*c)] = true;
+            }
+        }
+        
+        bool operator()(char c) const { return table[static_cast<unsigned char>(c)]; }
+    };
+    constexpr WordBreaks endsPlainRun;
+    
+    /**
+     * Characters escaped in quoted [[ ]] text, so that patterns and regular
+     * expressions take them literally
+     */
+    inline bool isPatternChar(char c) {
+        return c != '\0' && std::strchr("\\*?[]{}()|^$.+", c);
+    }
+    
+    /**
+     * Append text, escaping it as a [[ ]] word part requires
+     */
+    void appendEscaped(std::vector<char>& out, const char* text, size_t count, 
+                       WordPart::Escape escape) {
+        for (size_t i = 0; i < count; i++) {
+            if (escape == WordPart::EscapeSpecial ? isPatternChar(text[i]) : text[i] == '\\') {
+                out.push_back('\\');
+            }
+            out.push_back(text[i]);
+        }
+    }
+    
+    /**
+     * Check whether unquoted text makes a word a glob pattern: * or ?, or
+     * a [ closed later by ] (so `[`, `[[` and `]]` are not patterns)
+     */
+    bool hasPattern(const char* text, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (text[i] == '*' || text[i] == '?') {
+                return true;
+            }
+            if (text[i] == '[' && std::memchr(text + i + 1, ']', count - i - 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    /**
+     * Find the ')' closing a $( ), skipping quoted text, backquotes and
+     * nested parentheses
+     * @param input The text being scanned
+     * @param pos Index just past the '('
+     * @return Index of the ')', or npos if it is missing
+     */
+    size_t commandEnd(std::string_view input, size_t pos) {
+        int depth = 0;
+        for (size_t i = pos; i < input.length(); i++) {
+            char c = input[i];
+            if (c == '\\') {
+                i++;
+            } else if (c == '\'' || c == '`') {
+                i = input.find(c, i + 1);
+                if (i == std::string::npos) {
+                    return i;
+                }
+            } else if (c == '"') {
+                for (i++; i < input.length() && input[i] != '"'; i++) {
+                    if (input[i] == '\\') {
+                        i++;
+                    }
+                }
+            } else if (c == '(') {
+                depth++;
+            } else if (c == ')' && depth-- == 0) {
+                return i;
+            }
+        }
+        return std::string::npos;
+    }
+    
+    /**
+     * Find the '}' closing a ${...}, skipping quoted text and nested braces
+     * @param input The text being scanned
+     * @param pos Index just past the '{'
+     * @return Index of the '}', or npos if it is missing
+     */
+    size_t braceEnd(std::string_view input, size_t pos) {
+        int depth = 0;
+        for (size_t i = pos; i < input.length(); i++) {
+            char c = input[i];
+            if (c == '\\') {
+                i++;
+            } else if (c == '\'') {
+                i = input.find(c, i + 1);
+                if (i == std::string::npos) {
+                    return i;
+                }
+            } else if (c == '"') {
+                for (i++; i < input.length() && input[i] != '"'; i++) {
+                    if (input[i] == '\\') {
+                        i++;
+                    }
+                }
+            } else if (c == '{') {
+                depth++;
+            } else if (c == '}' && depth-- == 0) {
+                return i;
+            }
+        }
+        return std::string::npos;
+    }
+    
+    /**
+     * Read a `...` command; inside, \` \\ and \$ lose the backslash
+     * @param input The text being scanned
+     * @param pos Index of the opening '`'
+     * @param command Receives the command text
+     * @return Index of the closing '`', or npos if it is missing
+     */
+    size_t backquoteEnd(std::string_view input, size_t pos, std::string& command) {
+        command.clear();
+        size_t end = pos + 1;
+        for (; end < input.length() && input[end] != '`'; end++) {
+            if (input[end] == '\\' && end + 1 < input.length() && std::strchr("`\\$", input[end + 1])) {
+                end++;
+            }
+            command += input[end];
+        }
+        return end < input.length() ? end : std::string::npos;
+    }
+    
+    /**
+     * Find the "))" closing a $(( expression
+     * @param input The text being scanned
+     * @param pos Index just past the "(("
+     * @return Index of the first ')', or npos if it is missing
+     */
+    size_t arithmeticEnd(std::string_view input, size_t pos) {
+        size_t close = pos;
+        for (int depth = 0; close < input.length(); close++) {
+            if (input[close] == '(') {
+                depth++;
+            } else if (input[close] == ')' && depth-- == 0) {
+                break;
+            }
+        }
+        if (close + 1 >= input.length() || input[close + 1] != ')') {
+            return std::string::npos;
+        }
+        return close;
+    }
+    
+    /**
+     * Check whether arithmetic text has to be expanded before it can be
+     * compiled: quotes, ${...}, $( ), $(( )) or `...` ($NAME compiles as is)
+     */
+    bool needsExpansion(std::string_view expression) {
+        return expression.find_first_of("`\"'\\") != std::string_view::npos ||
+               expression.find("${") != std::string_view::npos ||
+               expression.find("$(") != std::string_view::npos;
+    }
+    
+    bool isRedirection(TokenType type) {
+        return type == TokenType::Input || type == TokenType::Output || 
+               type == TokenType::Append || type == TokenType::HereDoc || 
+               type == TokenType::HereDocStrip || type == TokenType::HereString;
+    }
+    
+    /**
+     * Check whether a word leaves the lexer at the start of a command
+     */
+    bool opensCommand(std::string_view word) {
+        return word == "if" || word == "then" || word == "elif" || word == "else" || 
+               word == "while" || word == "until" || word == "do" || word == "!" || word == "{";
+    }
+}
+
+void ParsedCommand::clear() {
+    closeHereDocs();
+    stages.clear();
+    stages.emplace_back();
+    background = false;
+    arena.clear();
+    argViews.clear();
+    argPointers.clear();
+    hereDocs.clear();
+}
+
+void CommandTemplate::append(const CommandTemplate& source, size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+        Token token = source.tokens[i];
+        if (token.type == TokenType::Word) {
+            size_t firstPart = parts.size();
+            for (size_t p = token.offset; p < token.offset + token.length; p++) {
+                WordPart part = source.parts[p];
+                if (part.kind == WordPart::Arithmetic) {
+                    // Jumps are relative to the expression; only names move
+                    size_t firstOp = arithmetic.size();
+                    for (size_t o = part.offset; o < part.offset + part.length; o++) {
+                        ArithOp op = source.arithmetic[o];
+                        if (op.length > 0) {
+                            const char* name = source.text.data() + op.offset;
+                            op.offset = static_cast<uint32_t>(text.size());
+                            text.insert(text.end(), name, name + op.length);
+                        }
+                        arithmetic.push_back(op);
+                    }
+                    part.offset = static_cast<uint32_t>(firstOp);
+                } else if (part.kind == WordPart::Parameter) {
+                    // Ranges are relative to the text between the braces
+                    ParameterExpansion expansion = source.parameters[part.offset];
+                    const char* inner = source.text.data() + expansion.offset;
+                    expansion.offset = static_cast<uint32_t>(text.size());
+                    text.insert(text.end(), inner, inner + expansion.length);
+                    part.offset = static_cast<uint32_t>(parameters.size());
+                    parameters.push_back(expansion);
+                } else {
+                    const char* partText = source.text.data() + part.offset;
+                    part.offset = static_cast<uint32_t>(text.size());
+                    text.insert(text.end(), partText, partText + part.length);
+                }
+                parts.push_back(part);
+            }
+            token.offset = firstPart;
+        }
+        tokens.push_back(token);
+    }
+}
+
+std::string_view CommandTemplate::literal(size_t index) const {
+    const Token& token = tokens[index];
+    if (token.type != TokenType::Word || token.quoted || token.length != 1) {
+        return std::string_view();
+    }
+    const WordPart& part = parts[token.offset];
+    if (part.kind != WordPart::Literal) {
+        return std::string_view();
+    }
+    return std::string_view(text.data() + part.offset, part.length);
+}
+
+void ParsedCommand::closeHereDocs() {
+    for (PipelineStage& stage : stages) {
+        if (stage.hereDocFd != -1) {
+            close(stage.hereDocFd);
+            stage.hereDocFd = -1;
+        }
+    }
+}
 
 CommandParser::CommandParser(const std::map<std::string, std::string>* variables) 
-    : shellVariables(variables) {}
+    : shellVariables(variables), arithmeticDepth(0), substitutionDepth(0), parameterDepth(0),
+      checkFailed(false) {}
+
+size_t CommandParser::parameterCount() const {
+    auto it = shellVariables->find("#");
+    return it == shellVariables->end() ? 0 : std::strtoul(it->second.c_str(), nullptr, 10);
+}
 
-std::vector<std::string> CommandParser::tokenize(const std::string& input) {
-    std::vector<std::string> tokens;
-    std::istringstream iss(input);
-    std::string token;
+const char* CommandParser::lookupVariable(const std::string& name) {
+    // $@ and $* are all positional parameters as one word
+    if (name == "@" || name == "*") {
+        joinScratch.clear();
+        size_t count = parameterCount();
+        for (size_t i = 1; i <= count; i++) {
+            auto it = shellVariables->find(std::to_string(i));
+            if (i > 1) {
+                joinScratch += ' ';
+            }
+            if (it != shellVariables->end()) {
+                joinScratch += it->second;
+            }
+        }
+        return joinScratch.c_str();
+    }
     
-    while (iss >> token) {
-        tokens.push_back(token);
+    // Check environment variables first
+    const char* envValue = getenv(name.c_str());
+    if (envValue) {
+        return envValue;
+    }
+    
+    // Check shell variables
+    auto it = shellVariables->find(name);
+    if (it != shellVariables->end()) {
+        return it->second.c_str();
+    }
+    
+    // If variable not found, it expands to nothing
+    return nullptr;
+}
+
+size_t CommandParser::nameEnd(std::string_view input, size_t pos) {
+    // Special parameters are a single character
+    if (pos < input.length() && input[pos] != '\0' && std::strchr("?#@*", input[pos])) {
+        return pos + 1;
+    }
+    // Positional parameters are all digits: $1x is $1 then x
+    if (pos < input.length() && std::isdigit(static_cast<unsigned char>(input[pos]))) {
+        while (pos < input.length() && std::isdigit(static_cast<unsigned char>(input[pos]))) {
+            pos++;
+        }
+        return pos;
+    }
+    while (pos < input.length() && isNameChar(input[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+const char* CommandParser::partValue(const CommandTemplate& tpl, const WordPart& part) {
+    nameScratch.assign(tpl.text.data() + part.offset, part.length);
+    const char* value = lookupVariable(nameScratch);
+    return value ? value : "";
+}
+
+const char* CommandParser::arithmeticValue(const CommandTemplate& tpl, const WordPart& part) {
+    int64_t value;
+    if (part.kind == WordPart::ArithmeticText) {
+        // The expansion gets the next level's buffers, like a ${...} operand
+        if (parameterScratch.size() <= parameterDepth) {
+            parameterScratch.push_back(std::make_unique<ParameterScratch>());
+        }
+        std::string& scratch = parameterScratch[parameterDepth]->word;
+        parameterDepth++;
+        bool ok = evaluateOperand(std::string_view(tpl.text.data() + part.offset, part.length),
+                                  scratch, value);
+        parameterDepth--;
+        if (!ok) {
+            return nullptr;
+        }
+    } else if (!evaluate(tpl.arithmetic.data() + part.offset, part.length, tpl.text.data(), value)) {
+        return nullptr;
+    }
+    *std::to_chars(numberScratch, numberScratch + sizeof(numberScratch) - 1, value).ptr = '\0';
+    return numberScratch;
+}
+
+const char* CommandParser::runSubstitution(std::string_view command) {
+    if (!substituter) {
+        std::cerr << "MyShell: command substitution is not available in this context\n";
+        return nullptr;
+    }
+    
+    // The command is expanded with this parser too; park the word being
+    // built, in storage kept per depth
+    size_t depth = substitutionDepth++;
+    if (savedExpansions.size() <= depth) {
+        savedExpansions.emplace_back();
+    }
+    savedExpansions[depth].tokens.swap(tokens);
+    savedExpansions[depth].pattern.swap(patternScratch);
+    
+    const char* value = substituter(command);
+    
+    tokens.swap(savedExpansions[depth].tokens);
+    patternScratch.swap(savedExpansions[depth].pattern);
+    substitutionDepth--;
+    return value;
+}
+
+const char* CommandParser::expandPart(const CommandTemplate& tpl, const WordPart& part) {
+    switch (part.kind) {
+        case WordPart::Arithmetic:
+        case WordPart::ArithmeticText: return arithmeticValue(tpl, part);
+        case WordPart::Command: return commandValue(tpl, part);
+        case WordPart::Parameter: return parameterValue(tpl, part);
+        default: return partValue(tpl, part);
+    }
+}
+
+bool CommandParser::parseParameter(std::string_view inner, ParameterExpansion& expansion) {
+    expansion = ParameterExpansion();
+    expansion.length = static_cast<uint32_t>(inner.size());
+    
+    // ${#NAME} is the length of the value; ${#} alone is $#
+    size_t start = inner.size() > 1 && inner[0] == '#' ? 1 : 0;
+    size_t end = nameEnd(inner, start);
+    if (end == start) {
+        return false;
+    }
+    expansion.name = static_cast<uint32_t>(start);
+    expansion.nameLength = static_cast<uint32_t>(end - start);
+    
+    // NAME[subscript] names an array element
+    if (end < inner.size() && inner[end] == '[' && !std::isdigit(static_cast<unsigned char>(inner[start])) &&
+        isNameChar(inner[start])) {
+        size_t close = inner.find(']', end + 1);
+        if (close == std::string_view::npos || close == end + 1) {
+            return false;
+        }
+        expansion.subscript = static_cast<uint32_t>(end + 1);
+        expansion.subscriptLength = static_cast<uint32_t>(close - end - 1);
+        end = close + 1;
+    }
+    if (start == 1) {
+        expansion.operation = ParameterExpansion::Length;
+        return end == inner.size();
+    }
+    if (end == inner.size()) {
+        expansion.operation = ParameterExpansion::Value;
+        return true;
+    }
+    
+    // The operator, then the operands up to the closing brace
+    size_t operand = end + 1;
+    char op = inner[end];
+    char next = end + 1 < inner.size() ? inner[end + 1] : '\0';
+    if (op == ':' && next != '\0' && std::strchr("-=+?", next)) {
+        expansion.colon = true;
+        op = next;
+        operand++;
+    } else if ((op == '#' || op == '%' || op == '/') && next == op) {
+        operand++;
+    } else if (op == '/' && (next == '#' || next == '%')) {
+        operand++;
+    }
+    
+    using Op = ParameterExpansion;
+    switch (op) {
+        case '-': expansion.operation = Op::Default; break;
+        case '=': expansion.operation = Op::Assign; break;
+        case '+': expansion.operation = Op::Alternative; break;
+        case '?': expansion.operation = Op::Check; break;
+        case ':': expansion.operation = Op::Substring; break;
+        case '#': expansion.operation = next == '#' ? Op::RemoveLongPrefix : Op::RemoveShortPrefix; break;
+        case '%': expansion.operation = next == '%' ? Op::RemoveLongSuffix : Op::RemoveShortSuffix; break;
+        case '/':
+            expansion.operation = next == '/' ? Op::ReplaceAll : next == '#' ? Op::ReplacePrefix :
+                                  next == '%' ? Op::ReplaceSuffix : Op::ReplaceFirst;
+            break;
+        default:
+            return false;
+    }
+    
+    // offset:length and pattern/string have a second operand
+    size_t separator = std::string_view::npos;
+    if (expansion.operation == Op::Substring) {
+        separator = inner.find(':', operand);
+    } else if (op == '/') {
+        for (size_t i = operand; i < inner.size(); i++) {
+            if (inner[i] == '\\') {
+                i++;
+            } else if (inner[i] == '\'' || inner[i] == '"') {
+                i = inner.find(inner[i], i + 1);
+                if (i == std::string_view::npos) {
+                    break;
+                }
+            } else if (inner[i] == '/') {
+                separator = i;
+                break;
+            }
+        }
+    }
+    expansion.word = static_cast<uint32_t>(operand);
+    if (separator == std::string_view::npos) {
+        expansion.wordLength = static_cast<uint32_t>(inner.size() - operand);
+    } else {
+        expansion.wordLength = static_cast<uint32_t>(separator - operand);
+        expansion.hasSecond = true;
+        expansion.second = static_cast<uint32_t>(separator + 1);
+        expansion.secondLength = static_cast<uint32_t>(inner.size() - separator - 1);
+    }
+    return true;
+}
+
+bool CommandParser::evaluateOperand(std::string_view expression, std::string& scratch, 
+                                    int64_t& value) {
+    if (expression.find_first_not_of(" \t") == std::string_view::npos) {
+        value = 0;
+        return true;
+    }
+    if (needsExpansion(expression)) {
+        scratch.clear();
+        if (!expandText(expression, scratch, TextMode::Word)) {
+            return false;
+        }
+        expression = scratch;
+    }
+    return evaluateArithmetic(expression, value);
+}
+
+bool CommandParser::lookupElement(std::string_view name, std::string_view subscript, std::string& key,
+                                  size_t& count, const char*& value) {
+    // Elements are NAME[0], NAME[1], ... up to the first one missing
+    char digits[24];
+    auto elementKey = [&](size_t index) {
+        key.assign(name.data(), name.size());
+        key += '[';
+        key.append(digits, std::to_chars(digits, digits + sizeof(digits), index).ptr);
+        key += ']';
+        return shellVariables->find(key);
+    };
+    auto countElements = [&]() {
+        count = 0;
+        while (elementKey(count) != shellVariables->end()) {
+            count++;
+        }
+    };
+    
+    if (subscript == "@" || subscript == "*") {
+        countElements();
+        joinScratch.clear();
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) {
+                joinScratch += ' ';
+            }
+            joinScratch += elementKey(i)->second;
+        }
+        key.assign(name.data(), name.size());
+        value = count > 0 ? joinScratch.c_str() : nullptr;
+        return true;
+    }
+    
+    int64_t index;
+    if (!evaluateOperand(subscript, key, index)) {
+        return false;
+    }
+    count = 0;
+    if (index < 0) {
+        countElements();
+        index += static_cast<int64_t>(count);
+        if (index < 0) {
+            std::cerr << "MyShell: " << name << "[" << subscript << "]: bad array subscript\n";
+            return false;
+        }
+    }
+    auto it = elementKey(static_cast<size_t>(index));
+    value = it != shellVariables->end() ? it->second.c_str() : nullptr;
+    return true;
+}
+
+const char* CommandParser::parameterValue(const CommandTemplate& tpl, const WordPart& part) {
+    // Each level of nesting has its own buffers; a substitution in an
+    // operand may expand another template with this parser
+    if (parameterScratch.size() <= parameterDepth) {
+        parameterScratch.push_back(std::make_unique<ParameterScratch>());
+    }
+    std::string& result = parameterScratch[parameterDepth]->result;
+    result.clear();
+    
+    const ParameterExpansion& expansion = tpl.parameters[part.offset];
+    if (!expandParameter(expansion, tpl.text.data() + expansion.offset, result)) {
+        return nullptr;
+    }
+    return result.c_str();
+}
+
+bool CommandParser::expandParameter(const ParameterExpansion& expansion, const char* text, 
+                                    std::string& out) {
+    if (parameterScratch.size() <= parameterDepth) {
+        parameterScratch.push_back(std::make_unique<ParameterScratch>());
+    }
+    ParameterScratch& scratch = *parameterScratch[parameterDepth];
+    std::string_view name(text + expansion.name, expansion.nameLength);
+    std::string_view subscript(text + expansion.subscript, expansion.subscriptLength);
+    std::string_view word(text + expansion.word, expansion.wordLength);
+    std::string_view second(text + expansion.second, expansion.secondLength);
+    
+    // Copy the value: expanding an operand may change the variable
+    parameterDepth++;
+    const char* found;
+    size_t count = 0;
+    if (subscript.empty()) {
+        scratch.name.assign(name.data(), name.size());
+        found = lookupVariable(scratch.name);
+    } else if (!lookupElement(name, subscript, scratch.name, count, found)) {
+        parameterDepth--;
+        return false;
+    }
+    scratch.value.assign(found ? found : "");
+    bool missing = !found || (expansion.colon && scratch.value.empty());
+    bool all = subscript == "@" || subscript == "*";
+    
+    bool ok = true;
+    switch (expansion.operation) {
+        case ParameterExpansion::Value:
+            out += scratch.value;
+            break;
+        case ParameterExpansion::Length: {
+            // ${#NAME[@]} is the number of elements
+            char digits[24];
+            size_t length = all ? count : scratch.value.size();
+            out.append(digits, std::to_chars(digits, digits + sizeof(digits), length).ptr);
+            break;
+        }
+        case ParameterExpansion::Default:
+            if (missing) {
+                ok = expandText(word, out, TextMode::Word);
+            } else {
+                out += scratch.value;
+            }
+            break;
+        case ParameterExpansion::Alternative:
+            if (!missing) {
+                ok = expandText(word, out, TextMode::Word);
+            }
+            break;
+        case ParameterExpansion::Assign:
+            if (!missing) {
+                out += scratch.value;
+                break;
+            }
+            scratch.word.clear();
+            if (!(ok = expandText(word, scratch.word, TextMode::Word))) {
+                break;
+            }
+            if ((!std::isalpha(static_cast<unsigned char>(name[0])) && name[0] != '_') || all) {
+                std::cerr << "MyShell: $" << name << ": cannot assign in this way\n";
+                ok = false;
+            } else if (!assigner) {
+                std::cerr << "MyShell: " << name << ": cannot assign in this context\n";
+                ok = false;
+            } else {
+                assigner(scratch.name, scratch.word);
+                out += scratch.word;
+            }
+            break;
+        case ParameterExpansion::Check:
+            if (!missing) {
+                out += scratch.value;
+                break;
+            }
+            scratch.word.clear();
+            if (expandText(word, scratch.word, TextMode::Word)) {
+                std::cerr << "MyShell: " << name << ": " 
+                          << (scratch.word.empty() ? "parameter null or not set" : scratch.word) << "\n";
+            }
+            checkFailed = true;
+            ok = false;
+            break;
+        case ParameterExpansion::Substring: {
+            int64_t start, span = 0;
+            if (!(ok = evaluateOperand(word, scratch.word, start) && 
+                       (!expansion.hasSecond || evaluateOperand(second, scratch.word, span)))) {
+                break;
+            }
+            // Negative offsets count from the end; a negative length
+            // leaves that many characters off the end
+            const int64_t size = static_cast<int64_t>(scratch.value.size());
+            if (start < 0) {
+                start += size;
+            }
+            if (start < 0 || start > size) {
+                break;
+            }
+            int64_t end = size;
+            if (expansion.hasSecond) {
+                end = span < 0 ? size + span : start + std::min(span, size - start);
+            }
+            if (end < start) {
+                std::cerr << "MyShell: " << second << ": substring expression < 0\n";
+                ok = false;
+                break;
+            }
+            out.append(scratch.value, static_cast<size_t>(start), static_cast<size_t>(end - start));
+            break;
+        }
+        default:
+            // Pattern operators
+            scratch.word.clear();
+            scratch.second.clear();
+            ok = expandText(word, scratch.word, TextMode::Pattern) &&
+                 expandText(second, scratch.second, TextMode::Word);
+            if (ok) {
+                applyPattern(expansion.operation, scratch.value, scratch.word, scratch.second, out);
+            }
+            break;
+    }
+    parameterDepth--;
+    return ok;
+}
+
+void CommandParser::applyPattern(ParameterExpansion::Operation operation, std::string_view value,
+                                 std::string_view pattern, std::string_view replacement, 
+                                 std::string& out) {
+    parameterPattern.compile(pattern);
+    std::string_view literal;
+    bool plain = parameterPattern.literalText(literal);
+    const size_t size = value.size();
+    
+    // Plain text is compared directly; only its own length can match
+    auto matches = [&](size_t from, size_t count) {
+        if (plain) {
+            return count == literal.size() && value.compare(from, count, literal) == 0;
+        }
+        return parameterPattern.matchesText(value.substr(from, count));
+    };
+    
+    switch (operation) {
+        case ParameterExpansion::RemoveShortPrefix:
+        case ParameterExpansion::RemoveLongPrefix:
+        case ParameterExpansion::ReplacePrefix: {
+            bool shortest = operation == ParameterExpansion::RemoveShortPrefix;
+            for (size_t k = 0; k <= size; k++) {
+                size_t count = shortest ? k : size - k;
+                if (matches(0, count)) {
+                    if (operation == ParameterExpansion::ReplacePrefix) {
+                        out += replacement;
+                    }
+                    out += value.substr(count);
+                    return;
+                }
+            }
+            break;
+        }
+        case ParameterExpansion::RemoveShortSuffix:
+        case ParameterExpansion::RemoveLongSuffix:
+        case ParameterExpansion::ReplaceSuffix: {
+            bool shortest = operation == ParameterExpansion::RemoveShortSuffix;
+            for (size_t k = 0; k <= size; k++) {
+                size_t count = shortest ? k : size - k;
+                if (matches(size - count, count)) {
+                    out += value.substr(0, size - count);
+                    if (operation == ParameterExpansion::ReplaceSuffix) {
+                        out += replacement;
+                    }
+                    return;
+                }
+            }
+            break;
+        }
+        default: {
+            // ReplaceFirst and ReplaceAll: the longest match at the first
+            // place one starts; an empty pattern replaces nothing
+            if (plain && literal.empty()) {
+                break;
+            }
+            bool all = operation == ParameterExpansion::ReplaceAll;
+            size_t copied = 0;
+            for (size_t at = 0; at < size;) {
+                size_t count = 0;
+                if (plain) {
+                    at = value.find(literal, at);
+                    if (at == std::string_view::npos) {
+                        break;
+                    }
+                    count = literal.size();
+                } else {
+                    for (count = size - at; count > 0 && !matches(at, count); count--) {}
+                    if (count == 0) {
+                        at++;
+                        continue;
+                    }
+                }
+                out += value.substr(copied, at - copied);
+                out += replacement;
+                at += count;
+                copied = at;
+                if (!all) {
+                    break;
+                }
+            }
+            out += value.substr(copied);
+            return;
+        }
+    }
+    out += value;
+}
+
+bool CommandParser::expandText(std::string_view text, std::string& out, TextMode mode) {
+    const bool hereDocument = mode == TextMode::HereDocument;
+    bool inDouble = false;
+    std::string command;
+    std::string expression;     // Nested $(( )) text, expanded
+    
+    // Quoted text in a pattern is escaped so that it matches literally
+    auto emit = [&](const char* data, size_t count, bool quoted) {
+        if (mode == TextMode::Pattern && quoted) {
+            for (size_t i = 0; i < count; i++) {
+                out += '\\';
+                out += data[i];
+            }
+        } else {
+            out.append(data, count);
+        }
+    };
+    
+    for (size_t pos = 0; pos < text.size();) {
+        char c = text[pos];
+        
+        if (c == '\\' && pos + 1 < text.size()) {
+            // Here-documents and double quotes only escape a few characters
+            char next = text[pos + 1];
+            bool escapes = hereDocument ? std::strchr("$`\\", next) != nullptr :
+                           inDouble ? std::strchr("$`\\\"", next) != nullptr : true;
+            if (!escapes) {
+                emit(&c, 1, true);
+                pos++;
+            } else if (mode == TextMode::Pattern) {
+                out += c;
+                out += next;
+                pos += 2;
+            } else {
+                out += next;
+                pos += 2;
+            }
+        } else if (c == '\'' && !hereDocument && !inDouble) {
+            size_t close = text.find('\'', pos + 1);
+            if (close == std::string_view::npos) {
+                close = text.size();
+            }
+            emit(text.data() + pos + 1, close - pos - 1, true);
+            pos = close + 1;
+        } else if (c == '"' && !hereDocument) {
+            inDouble = !inDouble;
+            pos++;
+        } else if (c == '`') {
+            size_t close = backquoteEnd(text, pos, command);
+            if (close == std::string_view::npos) {
+                std::cerr << "MyShell: syntax error: unterminated `\n";
+                return false;
+            }
+            const char* value = runSubstitution(command);
+            if (!value) {
+                return false;
+            }
+            emit(value, std::strlen(value), inDouble);
+            pos = close + 1;
+        } else if (c == '$') {
+            size_t start = pos + 1;
+            if (text.compare(start, 2, "((") == 0) {
+                size_t close = arithmeticEnd(text, start + 2);
+                int64_t number;
+                if (close == std::string_view::npos) {
+                    std::cerr << "MyShell: syntax error: unterminated $((\n";
+                    return false;
+                }
+                if (!evaluateOperand(text.substr(start + 2, close - start - 2), expression, number)) {
+                    return false;
+                }
+                char digits[24];
+                out.append(digits, std::to_chars(digits, digits + sizeof(digits), number).ptr);
+                pos = close + 2;
+            } else if (start < text.size() && text[start] == '(') {
+                size_t close = commandEnd(text, start + 1);
+                if (close == std::string_view::npos) {
+                    std::cerr << "MyShell: syntax error: unterminated $(\n";
+                    return false;
+                }
+                const char* value = runSubstitution(text.substr(start + 1, close - start - 1));
+                if (!value) {
+                    return false;
+                }
+                emit(value, std::strlen(value), inDouble);
+                pos = close + 1;
+            } else if (start < text.size() && text[start] == '{') {
+                size_t close = braceEnd(text, start + 1);
+                if (close == std::string_view::npos) {
+                    std::cerr << "MyShell: syntax error: unterminated ${\n";
+                    return false;
+                }
+                std::string_view inner = text.substr(start + 1, close - start - 1);
+                ParameterExpansion expansion;
+                if (!parseParameter(inner, expansion)) {
+                    std::cerr << "MyShell: ${" << inner << "}: bad substitution\n";
+                    return false;
+                }
+                size_t mark = out.size();
+                if (!expandParameter(expansion, inner.data(), out)) {
+                    return false;
+                }
+                if (mode == TextMode::Pattern && inDouble) {
+                    std::string value = out.substr(mark);
+                    out.resize(mark);
+                    emit(value.data(), value.size(), true);
+                }
+                pos = close + 1;
+            } else {
+                // A '$' without a name is literal
+                size_t end = nameEnd(text, start);
+                if (end == start) {
+                    emit("$", 1, inDouble);
+                } else {
+                    nameScratch.assign(text.data() + start, end - start);
+                    const char* value = lookupVariable(nameScratch);
+                    if (value) {
+                        emit(value, std::strlen(value), inDouble);
+                    }
+                }
+                pos = end;
+            }
+        } else {
+            // Copy the plain run in one go
+            size_t end = pos + 1;
+            while (end < text.size() && !std::strchr("\\'\"`$", text[end])) {
+                end++;
+            }
+            emit(text.data() + pos, end - pos, inDouble);
+            pos = end;
+        }
+    }
+    return true;
+}
+
+bool CommandParser::variableNumber(const char* names, const ArithOp& op, int64_t& value) {
+    nameScratch.assign(names + op.offset, op.length);
+    const char* text = lookupVariable(nameScratch);
+    if (!text || !*text) {
+        value = 0;
+        return true;
+    }
+    if (Arithmetic::parseNumber(text, value)) {
+        return true;
+    }
+    
+    // x=y+1 makes $((x)) evaluate y+1; copy the text, as evaluating may
+    // assign the variable it came from
+    if (arithmeticDepth >= MAX_ARITHMETIC_DEPTH) {
+        std::cerr << "MyShell: " << text << ": expression recursion level exceeded\n";
+        return false;
+    }
+    std::string expression(text);
+    return evaluateArithmetic(expression, value);
+}
+
+bool CommandParser::assignNumber(const char* names, const ArithOp& op, int64_t value) {
+    nameScratch.assign(names + op.offset, op.length);
+    if (!assigner) {
+        std::cerr << "MyShell: " << nameScratch << ": cannot assign in this context\n";
+        return false;
+    }
+    char digits[24];
+    auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    assigner(nameScratch, std::string(digits, end));
+    return true;
+}
+
+bool CommandParser::evaluate(const ArithOp* code, size_t count, const char* names, int64_t& result) {
+    // Nested evaluations (variables holding expressions) stack on top
+    std::vector<int64_t>& stack = arithmeticStack;
+    const size_t base = stack.size();
+    arithmeticDepth++;
+    bool ok = true;
+    
+    for (size_t pc = 0; pc < count && ok; pc++) {
+        const ArithOp& op = code[pc];
+        switch (op.code) {
+            case ArithOp::Number:
+                stack.push_back(op.value);
+                break;
+            case ArithOp::Load: {
+                int64_t value = 0;
+                ok = variableNumber(names, op, value);
+                stack.push_back(value);
+                break;
+            }
+            case ArithOp::Store:
+                ok = assignNumber(names, op, stack.back());
+                break;
+            case ArithOp::PreIncrement:
+            case ArithOp::PreDecrement:
+            case ArithOp::PostIncrement:
+            case ArithOp::PostDecrement: {
+                int64_t value;
+                if (!(ok = variableNumber(names, op, value))) {
+                    break;
+                }
+                bool up = op.code == ArithOp::PreIncrement || op.code == ArithOp::PostIncrement;
+                int64_t updated = static_cast<int64_t>(static_cast<uint64_t>(value) + (up ? 1 : -1));
+                ok = assignNumber(names, op, updated);
+                bool post = op.code == ArithOp::PostIncrement || op.code == ArithOp::PostDecrement;
+                stack.push_back(post ? value : updated);
+                break;
+            }
+            case ArithOp::Negate:
+                stack.back() = static_cast<int64_t>(0 - static_cast<uint64_t>(stack.back()));
+                break;
+            case ArithOp::Not:
+                stack.back() = stack.back() == 0;
+                break;
+            case ArithOp::Complement:
+                stack.back() = ~stack.back();
+                break;
+            case ArithOp::AndJump:
+                if (stack.back() == 0) {
+                    pc = op.offset - 1;
+                } else {
+                    stack.pop_back();
+                }
+                break;
+            case ArithOp::OrJump:
+                if (stack.back() != 0) {
+                    stack.back() = 1;
+                    pc = op.offset - 1;
+                } else {
+                    stack.pop_back();
+                }
+                break;
+            case ArithOp::ToBool:
+                stack.back() = stack.back() != 0;
+                break;
+            case ArithOp::JumpIfZero: {
+                int64_t value = stack.back();
+                stack.pop_back();
+                if (value == 0) {
+                    pc = op.offset - 1;
+                }
+                break;
+            }
+            case ArithOp::Jump:
+                pc = op.offset - 1;
+                break;
+            case ArithOp::Pop:
+                stack.pop_back();
+                break;
+            default: {
+                // Binary operators; + - * and << wrap around instead of overflowing
+                int64_t right = stack.back();
+                stack.pop_back();
+                int64_t& left = stack.back();
+                uint64_t l = static_cast<uint64_t>(left);
+                uint64_t r = static_cast<uint64_t>(right);
+                switch (op.code) {
+                    case ArithOp::Power: {
+                        if (right < 0) {
+                            std::cerr << "MyShell: arithmetic: exponent less than 0\n";
+                            ok = false;
+                            break;
+                        }
+                        uint64_t power = 1;
+                        for (; r; r >>= 1, l *= l) {
+                            if (r & 1) {
+                                power *= l;
+                            }
+                        }
+                        left = static_cast<int64_t>(power);
+                        break;
+                    }
+                    case ArithOp::Multiply: left = static_cast<int64_t>(l * r); break;
+                    case ArithOp::Divide:
+                    case ArithOp::Remainder:
+                        if (right == 0) {
+                            std::cerr << "MyShell: arithmetic: division by 0\n";
+                            ok = false;
+                        } else if (right == -1) {
+                            // Avoids the INT64_MIN / -1 trap
+                            left = op.code == ArithOp::Divide ? static_cast<int64_t>(0 - l) : 0;
+                        } else {
+                            left = op.code == ArithOp::Divide ? left / right : left % right;
+                        }
+                        break;
+                    case ArithOp::Add: left = static_cast<int64_t>(l + r); break;
+                    case ArithOp::Subtract: left = static_cast<int64_t>(l - r); break;
+                    case ArithOp::ShiftLeft: left = static_cast<int64_t>(l << (r & 63)); break;
+                    case ArithOp::ShiftRight: left >>= (r & 63); break;
+                    case ArithOp::Less: left = left < right; break;
+                    case ArithOp::LessEqual: left = left <= right; break;
+                    case ArithOp::Greater: left = left > right; break;
+                    case ArithOp::GreaterEqual: left = left >= right; break;
+                    case ArithOp::Equal: left = left == right; break;
+                    case ArithOp::NotEqual: left = left != right; break;
+                    case ArithOp::BitAnd: left &= right; break;
+                    case ArithOp::BitXor: left ^= right; break;
+                    case ArithOp::BitOr: left |= right; break;
+                    default: break;
+                }
+                break;
+            }
+        }
     }
     
-    return tokens;
+    if (ok) {
+        result = stack.back();
+    }
+    stack.resize(base);
+    arithmeticDepth--;
+    return ok;
+}
+
+bool CommandParser::evaluateArithmetic(std::string_view expression, int64_t& result) {
+    expressionKey.assign(expression.data(), expression.size());
+    auto it = expressionCache.find(expressionKey);
+    if (it == expressionCache.end()) {
+        // Start over rather than grow without bound; entries in use by an
+        // outer evaluation have to stay put
+        if (expressionCache.size() >= EXPRESSION_CACHE_SIZE && arithmeticDepth == 0) {
+            expressionCache.clear();
+        }
+        CachedExpression compiled;
+        if (!Arithmetic::compile(expression, compiled.code, compiled.names)) {
+            return false;
+        }
+        it = expressionCache.emplace(expressionKey, std::move(compiled)).first;
+    }
+    const CachedExpression& cached = it->second;
+    return evaluate(cached.code.data(), cached.code.size(), cached.names.data(), result);
+}
+
+bool CommandParser::isAllParameters(const CommandTemplate& tpl, const Token& word) {
+    if (word.length != 1) {
+        return false;
+    }
+    const WordPart& part = tpl.parts[word.offset];
+    return part.kind == WordPart::Variable && part.length == 1 && tpl.text[part.offset] == '@';
 }
 
 std::string CommandParser::expandVariables(const std::string& input) {
-    std::string result = input;
+    std::string result;
+    result.reserve(input.length());
+    expandText(input, result, TextMode::HereDocument);
+    return result;
+}
+
+bool CommandParser::lex(const std::string& input, CommandTemplate& tpl) {
+    TraceScope trace("parse");
+    tpl.clear();
+    const size_t length = input.length();
     size_t pos = 0;
     
-    while ((pos = result.find('$', pos)) != std::string::npos) {
-        size_t start = pos + 1;
-        size_t end = start;
+    size_t firstPart = 0;   // First part of the word being built
+    bool inWord = false;    // A word has started (even if it expands to nothing)
+    bool quoted = false;    // The word contains quotes, so keep it even if empty
+    bool commandStart = true;       // The next word would be a command name
+    bool doubleBracket = false;     // Inside [[ ... ]]
+    bool wordGlob = false;          // The word has unquoted pattern characters
+    
+    auto valueEscape = [&](bool partQuoted) {
+        if (!doubleBracket) {
+            return WordPart::NoEscape;
+        }
+        return partQuoted ? WordPart::EscapeSpecial : WordPart::EscapeBackslash;
+    };
+    auto addPart = [&](WordPart::Kind kind, bool partQuoted, const char* text, size_t count) {
+        WordPart::Escape escape = kind == WordPart::Literal ? WordPart::NoEscape 
+                                                            : valueEscape(partQuoted);
         
-        // Find the end of the variable name
-        while (end < result.length() && 
-               (std::isalnum(result[end]) || result[end] == '_')) {
-            end++;
+        if (kind == WordPart::Literal && !partQuoted && !wordGlob) {
+            wordGlob = hasPattern(text, count);
         }
         
-        if (end > start) {
-            std::string varName = result.substr(start, end - start);
-            std::string varValue;
-            
-            // Check environment variables first
-            const char* envValue = getenv(varName.c_str());
-            if (envValue) {
-                varValue = envValue;
+        // Neighbouring text with the same quoting is kept as one part
+        size_t start = tpl.text.size();
+        if (doubleBracket && kind == WordPart::Literal && partQuoted) {
+            appendEscaped(tpl.text, text, count, WordPart::EscapeSpecial);
+        } else {
+            tpl.text.insert(tpl.text.end(), text, text + count);
+        }
+        uint32_t added = static_cast<uint32_t>(tpl.text.size() - start);
+        if (kind == WordPart::Literal && tpl.parts.size() > firstPart) {
+            WordPart& last = tpl.parts.back();
+            if (last.kind == WordPart::Literal && last.quoted == partQuoted) {
+                last.length += added;
+                return;
+            }
+        }
+        tpl.parts.push_back(WordPart{kind, partQuoted, escape, static_cast<uint32_t>(start), added});
+    };
+    auto addVariable = [&](bool partQuoted) {
+        // pos is just past the '$'
+        if (input.compare(pos, 2, "((") == 0) {
+            // $(( expression )): compiled now, evaluated on every expansion
+            size_t close = arithmeticEnd(input, pos + 2);
+            if (close == std::string::npos) {
+                std::cerr << "MyShell: syntax error: unterminated $((\n";
+                return false;
+            }
+            std::string_view expression = std::string_view(input).substr(pos + 2, close - pos - 2);
+            if (needsExpansion(expression)) {
+                // Only known once the text is expanded, on every expansion
+                addPart(WordPart::ArithmeticText, partQuoted, expression.data(), expression.size());
+                pos = close + 2;
+                return true;
+            }
+            size_t firstOp = tpl.arithmetic.size();
+            if (!Arithmetic::compile(expression, tpl.arithmetic, tpl.text)) {
+                return false;
+            }
+            tpl.parts.push_back(WordPart{WordPart::Arithmetic, partQuoted, WordPart::NoEscape, 
+                                         static_cast<uint32_t>(firstOp), 
+                                         static_cast<uint32_t>(tpl.arithmetic.size() - firstOp)});
+            pos = close + 2;
+            return true;
+        }
+        if (pos < length && input[pos] == '(') {
+            // $( command ): its text is run on every expansion
+            size_t close = commandEnd(input, pos + 1);
+            if (close == std::string::npos) {
+                std::cerr << "MyShell: syntax error: unterminated $(\n";
+                return false;
+            }
+            addPart(WordPart::Command, partQuoted, input.data() + pos + 1, close - pos - 1);
+            pos = close + 1;
+            return true;
+        }
+        if (pos < length && input[pos] == '{') {
+            // ${...}: a plain ${NAME} is a variable like $NAME; operators
+            // are split up now and applied on every expansion
+            size_t close = braceEnd(input, pos + 1);
+            if (close == std::string::npos) {
+                std::cerr << "MyShell: syntax error: unterminated ${\n";
+                return false;
+            }
+            std::string_view inner = std::string_view(input).substr(pos + 1, close - pos - 1);
+            ParameterExpansion expansion;
+            if (!parseParameter(inner, expansion)) {
+                std::cerr << "MyShell: ${" << inner << "}: bad substitution\n";
+                return false;
+            }
+            if (expansion.operation == ParameterExpansion::Value && expansion.subscriptLength == 0) {
+                addPart(WordPart::Variable, partQuoted, inner.data() + expansion.name, 
+                        expansion.nameLength);
             } else {
-                // Check shell variables
-                auto it = shellVariables->find(varName);
-                if (it != shellVariables->end()) {
-                    varValue = it->second;
-                }
-                // If variable not found, leave it as empty string
+                expansion.offset = static_cast<uint32_t>(tpl.text.size());
+                tpl.text.insert(tpl.text.end(), inner.begin(), inner.end());
+                tpl.parts.push_back(WordPart{WordPart::Parameter, partQuoted, valueEscape(partQuoted),
+                                             static_cast<uint32_t>(tpl.parameters.size()), 1});
+                tpl.parameters.push_back(expansion);
             }
-            
-            result.replace(pos, end - pos, varValue);
-            pos += varValue.length();
+            pos = close + 1;
+            return true;
+        }
+        
+        // A '$' without a name is literal
+        size_t end = nameEnd(input, pos);
+        if (end == pos) {
+            addPart(WordPart::Literal, partQuoted, "$", 1);
         } else {
+            addPart(WordPart::Variable, partQuoted, input.data() + pos, end - pos);
+        }
+        pos = end;
+        return true;
+    };
+    auto addBackquoted = [&](bool partQuoted) {
+        // pos is at the opening '`'
+        std::string command;
+        size_t end = backquoteEnd(input, pos, command);
+        if (end == std::string::npos) {
+            std::cerr << "MyShell: syntax error: unterminated `\n";
+            return false;
+        }
+        addPart(WordPart::Command, partQuoted, command.data(), command.size());
+        pos = end + 1;
+        return true;
+    };
+    auto pushOperator = [&](TokenType type) {
+        tpl.tokens.push_back(Token{type, 0, 0, false});
+        // Control operators start a new command; redirections do not
+        if (!isRedirection(type)) {
+            commandStart = true;
+        }
+    };
+    auto finishWord = [&]() {
+        if (inWord && (tpl.parts.size() > firstPart || quoted)) {
+            // [[ ]] operands and redirection targets are not globbed
+            bool target = !tpl.tokens.empty() && isRedirection(tpl.tokens.back().type);
+            tpl.tokens.push_back(Token{TokenType::Word, firstPart, tpl.parts.size() - firstPart, 
+                                       quoted, wordGlob && !doubleBracket && !target});
+            std::string_view word = tpl.literal(tpl.tokens.size() - 1);
+            if (doubleBracket) {
+                // Inside [[ ]] every word counts, even one that expands to nothing
+                if (word == "]]") {
+                    doubleBracket = false;
+                } else {
+                    tpl.tokens.back().quoted = true;
+                }
+            } else if (commandStart && word == "[[") {
+                doubleBracket = true;
+            }
+            commandStart = commandStart && opensCommand(word);
+        }
+        firstPart = tpl.parts.size();
+        inWord = false;
+        quoted = false;
+        wordGlob = false;
+    };
+    
+    while (pos < length) {
+        char c = input[pos];
+        
+        if (c != '\n' && isBlank(c)) {
+            finishWord();
+            pos++;
+        } else if (doubleBracket && isOperatorChar(c) && c != ';') {
+            // [[ ]] takes && || ( ) < > as its own words and may span lines
+            finishWord();
+            if (c != '\n') {
+                size_t count = (c == '&' || c == '|') && pos + 1 < length && input[pos + 1] == c ? 2 : 1;
+                inWord = true;
+                addPart(WordPart::Literal, false, input.data() + pos, count);
+                finishWord();
+                pos += count;
+            } else {
+                pos++;
+            }
+        } else if (isOperatorChar(c)) {
+            finishWord();
+            bool doubled = pos + 1 < length && input[pos + 1] == c;
+            if (c == '|') {
+                pushOperator(doubled ? TokenType::OrIf : TokenType::Pipe);
+                pos += doubled ? 2 : 1;
+            } else if (c == '&') {
+                pushOperator(doubled ? TokenType::AndIf : TokenType::Background);
+                pos += doubled ? 2 : 1;
+            } else if (c == ';' || c == '(' || c == ')' || c == '\n') {
+                pushOperator(c == ';' ? TokenType::Semicolon : 
+                             c == '(' ? TokenType::OpenParen : 
+                             c == ')' ? TokenType::CloseParen : TokenType::Newline);
+                pos++;
+            } else if (c == '<' && input.compare(pos, 3, "<<<") == 0) {
+                pushOperator(TokenType::HereString);
+                pos += 3;
+            } else if (c == '<' && input.compare(pos, 3, "<<-") == 0) {
+                pushOperator(TokenType::HereDocStrip);
+                pos += 3;
+            } else if (c == '<' && doubled) {
+                pushOperator(TokenType::HereDoc);
+                pos += 2;
+            } else if (c == '<') {
+                pushOperator(TokenType::Input);
+                pos++;
+            } else if (doubled) {
+                pushOperator(TokenType::Append);
+                pos += 2;
+            } else {
+                pushOperator(TokenType::Output);
+                pos++;
+            }
+        } else if (c == '#' && !inWord) {
+            // Comment runs to the end of the line
+            pos = input.find('\n', pos);
+            if (pos == std::string::npos) {
+                break;
+            }
+        } else if (c == '\'') {
+            // Single quotes: everything literal up to the closing quote
+            size_t close = input.find('\'', pos + 1);
+            if (close == std::string::npos) {
+                std::cerr << "MyShell: syntax error: unterminated quote\n";
+                return false;
+            }
+            addPart(WordPart::Literal, true, input.data() + pos + 1, close - pos - 1);
+            inWord = quoted = true;
+            pos = close + 1;
+        } else if (c == '"') {
+            // Double quotes: variables and a few backslash escapes still apply
+            inWord = quoted = true;
             pos++;
+            while (pos < length && input[pos] != '"') {
+                char d = input[pos];
+                if (d == '\\' && pos + 1 < length && 
+                    std::strchr("\"\\$`", input[pos + 1])) {
+                    addPart(WordPart::Literal, true, input.data() + pos + 1, 1);
+                    pos += 2;
+                } else if (d == '$') {
+                    pos++;
+                    if (!addVariable(true)) {
+                        return false;
+                    }
+                } else if (d == '`') {
+                    if (!addBackquoted(true)) {
+                        return false;
+                    }
+                } else {
+                    // Copy the plain run in one go
+                    size_t end = pos;
+                    while (end < length && input[end] != '"' && input[end] != '\\' && 
+                           input[end] != '$' && input[end] != '`') {
+                        end++;
+                    }
+                    if (end == pos) {
+                        end++;
+                    }
+                    addPart(WordPart::Literal, true, input.data() + pos, end - pos);
+                    pos = end;
+                }
+            }
+            if (pos >= length) {
+                std::cerr << "MyShell: syntax error: unterminated quote\n";
+                return false;
+            }
+            pos++;
+        } else if (c == '\\') {
+            // Backslash makes the next character literal
+            inWord = quoted = true;
+            if (pos + 1 < length) {
+                addPart(WordPart::Literal, true, input.data() + pos + 1, 1);
+            }
+            pos += 2;
+        } else if (c == '$') {
+            inWord = true;
+            pos++;
+            if (!addVariable(false)) {
+                return false;
+            }
+        } else if (c == '`') {
+            inWord = true;
+            if (!addBackquoted(false)) {
+                return false;
+            }
+        } else {
+            // Copy the plain run in one go
+            size_t end = pos + 1;
+            while (end < length && !endsPlainRun(input[end])) {
+                end++;
+            }
+            addPart(WordPart::Literal, false, input.data() + pos, end - pos);
+            inWord = true;
+            pos = end;
         }
     }
     
-    return result;
+    finishWord();
+    return true;
 }
 
-ParsedCommand CommandParser::parse(const std::string& commandLine) {
-    ParsedCommand cmd;
+void CommandParser::appendPattern(const WordPart& part, const char* value, size_t length) {
+    if (part.quoted) {
+        appendEscaped(patternScratch, value, length, WordPart::EscapeSpecial);
+    } else {
+        patternScratch.insert(patternScratch.end(), value, value + length);
+    }
+}
+
+bool CommandParser::expand(const CommandTemplate& tpl, ParsedCommand& cmd) {
+    checkFailed = false;
+    cmd.clear();
+    tokens.clear();
+    glob.clearCache();
+    std::vector<char>& arena = cmd.arena;
     
-    // Expand variables first
-    std::string expanded = expandVariables(commandLine);
+    // Substitute every word into the arena; once it is complete, views
+    // into it stay valid
+    for (const Token& token : tpl.tokens) {
+        if (token.type != TokenType::Word) {
+            tokens.push_back(token);
+            continue;
+        }
+        
+        if (isAllParameters(tpl, token)) {
+            // One word per positional parameter, empty ones included
+            size_t count = parameterCount();
+            for (size_t i = 1; i <= count; i++) {
+                nameScratch = std::to_string(i);
+                const char* value = lookupVariable(nameScratch);
+                size_t valueLength = value ? std::strlen(value) : 0;
+                tokens.push_back(Token{TokenType::Word, arena.size(), valueLength, true});
+                arena.insert(arena.end(), value, value + valueLength);
+                arena.push_back('\0');
+            }
+            continue;
+        }
+        
+        size_t start = arena.size();
+        patternScratch.clear();
+        for (size_t p = token.offset; p < token.offset + token.length; p++) {
+            const WordPart& part = tpl.parts[p];
+            const char* value;
+            size_t valueLength;
+            if (part.kind == WordPart::Literal) {
+                value = tpl.text.data() + part.offset;
+                valueLength = part.length;
+            } else {
+                value = expandPart(tpl, part);
+                if (!value) {
+                    cmd.clear();
+                    return false;
+                }
+                valueLength = std::strlen(value);
+            }
+            
+            if (part.escape == WordPart::NoEscape) {
+                arena.insert(arena.end(), value, value + valueLength);
+            } else {
+                appendEscaped(arena, value, valueLength, part.escape);
+            }
+            if (token.glob) {
+                appendPattern(part, value, valueLength);
+            }
+        }
+        
+        // A pattern that matches nothing stays as it is
+        if (token.glob && expandPattern()) {
+            arena.resize(start);
+            for (std::string_view path : glob.matches()) {
+                tokens.push_back(Token{TokenType::Word, arena.size(), path.size(), true});
+                arena.insert(arena.end(), path.begin(), path.end());
+                arena.push_back('\0');
+            }
+            continue;
+        }
+        if (arena.size() > start || token.quoted) {
+            tokens.push_back(Token{TokenType::Word, start, arena.size() - start, token.quoted});
+            arena.push_back('\0');
+        }
+    }
     
-    // Tokenize the expanded command
-    std::vector<std::string> tokens = tokenize(expanded);
+    if (!build(cmd)) {
+        cmd.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CommandParser::expandWords(const CommandTemplate& tpl, size_t first, size_t last, 
+                                std::vector<std::string>& words) {
+    checkFailed = false;
+    words.clear();
+    glob.clearCache();
+    std::string field;
+    
+    for (size_t i = first; i < last; i++) {
+        const Token& token = tpl.tokens[i];
+        if (isAllParameters(tpl, token)) {
+            size_t count = parameterCount();
+            for (size_t n = 1; n <= count; n++) {
+                nameScratch = std::to_string(n);
+                const char* value = lookupVariable(nameScratch);
+                words.emplace_back(value ? value : "");
+            }
+            continue;
+        }
+        
+        // A field exists once it has text or quotes; unquoted values split
+        bool haveField = token.quoted;
+        size_t firstWord = words.size();
+        field.clear();
+        patternScratch.clear();
+        for (size_t p = token.offset; p < token.offset + token.length; p++) {
+            const WordPart& part = tpl.parts[p];
+            if (part.kind == WordPart::Literal) {
+                field.append(tpl.text.data() + part.offset, part.length);
+                haveField = true;
+                if (token.glob) {
+                    appendPattern(part, tpl.text.data() + part.offset, part.length);
+                }
+                continue;
+            }
+            const char* value = expandPart(tpl, part);
+            if (!value) {
+                return false;
+            }
+            if (token.glob) {
+                appendPattern(part, value, std::strlen(value));
+            }
+            
+            if (part.quoted) {
+                field += value;
+                haveField = true;
+            } else {
+                for (const char* v = value; *v; v++) {
+                    if (!isBlank(*v)) {
+                        field += *v;
+                        haveField = true;
+                    } else if (haveField) {
+                        words.push_back(field);
+                        field.clear();
+                        haveField = false;
+                    }
+                }
+            }
+        }
+        if (haveField) {
+            words.push_back(field);
+        }
+        
+        // The whole word is the pattern; matches replace its fields
+        if (token.glob && expandPattern()) {
+            words.resize(firstWord);
+            for (std::string_view path : glob.matches()) {
+                words.emplace_back(path);
+            }
+        }
+    }
+    return true;
+}
+
+const char* CommandParser::operatorText(TokenType type) {
+    switch (type) {
+        case TokenType::Word: return "word";
+        case TokenType::Pipe: return "|";
+        case TokenType::Input: return "<";
+        case TokenType::Output: return ">";
+        case TokenType::Append: return ">>";
+        case TokenType::HereDoc: return "<<";
+        case TokenType::HereDocStrip: return "<<-";
+        case TokenType::HereString: return "<<<";
+        case TokenType::Background: return "&";
+        case TokenType::Semicolon: return ";";
+        case TokenType::AndIf: return "&&";
+        case TokenType::OrIf: return "||";
+        case TokenType::Newline: return "newline";
+        case TokenType::OpenParen: return "(";
+        case TokenType::CloseParen: return ")";
+    }
+    return "?";
+}
+
+bool CommandParser::isReservedWord(std::string_view word) {
+    static const char* const reserved[] = {
+        "if", "then", "elif", "else", "fi", "while", "until", "for", "in", "do", "done",
+        "function", "{", "}", "!", "break", "continue", "return"
+    };
+    for (const char* r : reserved) {
+        if (word == r) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CommandParser::isSimple(const CommandTemplate& tpl) const {
+    for (size_t i = 0; i < tpl.tokens.size(); i++) {
+        switch (tpl.tokens[i].type) {
+            case TokenType::Semicolon:
+            case TokenType::AndIf:
+            case TokenType::OrIf:
+            case TokenType::Newline:
+            case TokenType::OpenParen:
+            case TokenType::CloseParen:
+                return false;
+            case TokenType::Background:
+                // `a & b` is a list of two commands
+                if (i + 1 < tpl.tokens.size()) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return tpl.tokens.empty() || !isReservedWord(tpl.literal(0));
+}
+
+bool CommandParser::build(ParsedCommand& cmd) {
+    const char* base = cmd.arena.data();
     
     // Parse tokens for special operators
     for (size_t i = 0; i < tokens.size(); i++) {
-        if (tokens[i] == "<" && i + 1 < tokens.size()) {
-            // Input redirection
-            cmd.inputFile = tokens[++i];
-        } else if (tokens[i] == ">" && i + 1 < tokens.size()) {
-            // Output redirection (overwrite)
-            cmd.outputFile = tokens[++i];
-            cmd.appendOutput = false;
-        } else if (tokens[i] == ">>" && i + 1 < tokens.size()) {
-            // Output redirection (append)
-            cmd.outputFile = tokens[++i];
-            cmd.appendOutput = true;
-        } else if (tokens[i] == "|" && i + 1 < tokens.size()) {
-            // Pipe - everything after | goes to pipe command
-            cmd.hasPipe = true;
-            for (size_t j = i + 1; j < tokens.size(); j++) {
-                if (tokens[j] == "&") {
-                    cmd.background = true;
-                } else {
-                    cmd.pipeCommand.push_back(tokens[j]);
+        PipelineStage& stage = cmd.stages.back();
+        TokenType type = tokens[i].type;
+        
+        if (type == TokenType::Input || type == TokenType::Output || 
+            type == TokenType::Append) {
+            if (i + 1 >= tokens.size() || tokens[i + 1].type != TokenType::Word) {
+                std::cerr << "MyShell: syntax error: expected file name after '" 
+                          << (type == TokenType::Input ? "<" : 
+                              type == TokenType::Output ? ">" : ">>") << "'\n";
+                return false;
+            }
+            
+            const Token& file = tokens[++i];
+            std::string_view name(base + file.offset, file.length);
+            if (type == TokenType::Input) {
+                // Input redirection; the last input redirection wins
+                stage.inputFile = name;
+                stage.hereString = std::string_view();
+                for (HereDocument& doc : cmd.hereDocs) {
+                    if (doc.stage == cmd.stages.size() - 1) {
+                        doc.stage = std::string_view::npos;
+                    }
+                }
+            } else {
+                // Output redirection (overwrite or append)
+                stage.outputFile = name;
+                stage.appendOutput = type == TokenType::Append;
+            }
+        } else if (type == TokenType::HereDoc || type == TokenType::HereDocStrip || 
+                   type == TokenType::HereString) {
+            if (i + 1 >= tokens.size() || tokens[i + 1].type != TokenType::Word) {
+                std::cerr << "MyShell: syntax error: expected " 
+                          << (type == TokenType::HereString ? "word after '<<<'" 
+                                                            : "delimiter after '<<'") << "\n";
+                return false;
+            }
+            
+            const Token& word = tokens[++i];
+            stage.inputFile = std::string_view();
+            for (HereDocument& doc : cmd.hereDocs) {
+                if (doc.stage == cmd.stages.size() - 1) {
+                    doc.stage = std::string_view::npos;
                 }
             }
-            break; // Stop processing after pipe
-        } else if (tokens[i] == "&") {
+            
+            if (type == TokenType::HereString) {
+                // The word is followed by its NUL in the arena; the newline
+                // the command sees is added when the string is fed to it
+                stage.hereString = std::string_view(base + word.offset, word.length);
+            } else {
+                stage.hereString = std::string_view();
+                cmd.hereDocs.push_back(HereDocument{cmd.stages.size() - 1, 
+                    std::string_view(base + word.offset, word.length), 
+                    !word.quoted, type == TokenType::HereDocStrip});
+            }
+        } else if (type == TokenType::Pipe) {
+            // Pipe - start the next stage of the pipeline
+            cmd.stages.emplace_back();
+            cmd.stages.back().argStart = cmd.argViews.size();
+        } else if (type == TokenType::Background) {
             // Background execution
             cmd.background = true;
-        } else {
+        } else if (type == TokenType::Word) {
             // Regular argument
-            cmd.args.push_back(tokens[i]);
+            cmd.argViews.emplace_back(base + tokens[i].offset, tokens[i].length);
+        } else {
+            // Lists and groups are the script compiler's business
+            std::cerr << "MyShell: syntax error near unexpected token '" 
+                      << operatorText(type) << "'\n";
+            return false;
         }
     }
     
+    // Lay out an exec-ready argv for every stage and point the stages at
+    // their slices; the tables are complete, so the pointers stay valid
+    for (size_t s = 0; s < cmd.stages.size(); s++) {
+        PipelineStage& stage = cmd.stages[s];
+        size_t end = s + 1 < cmd.stages.size() ? cmd.stages[s + 1].argStart 
+                                               : cmd.argViews.size();
+        for (size_t i = stage.argStart; i < end; i++) {
+            cmd.argPointers.push_back(const_cast<char*>(cmd.argViews[i].data()));
+        }
+        cmd.argPointers.push_back(nullptr);
+    }
+    for (size_t s = 0, pointer = 0; s < cmd.stages.size(); s++) {
+        PipelineStage& stage = cmd.stages[s];
+        size_t end = s + 1 < cmd.stages.size() ? cmd.stages[s + 1].argStart 
+                                               : cmd.argViews.size();
+        stage.args = ArgList(cmd.argViews.data() + stage.argStart, 
+                             cmd.argPointers.data() + pointer, end - stage.argStart);
+        pointer += end - stage.argStart + 1;
+    }
+    
+    return true;
+}
+
+bool CommandParser::parse(const std::string& commandLine, ParsedCommand& cmd) {
+    if (!lex(commandLine, lineTemplate)) {
+        cmd.clear();
+        return false;
+    }
+    return expand(lineTemplate, cmd);
+}
+
+ParsedCommand CommandParser::parse(const std::string& commandLine) {
+    ParsedCommand cmd;
+    parse(commandLine, cmd);
     return cmd;
 }
 
 bool CommandParser::isEmpty(const std::string& input) {
     return std::all_of(input.begin(), input.end(), 
                       [](char c) { return std::isspace(c); });
-}
\ No newline at end of file
+}
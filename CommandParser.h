@@ -2,52 +2,648 @@
 #define COMMAND_PARSER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include "Arithmetic.h"
+#include "Glob.h"
 using namespace std;
+/**
+ * Arguments of one command, as views for the shell and as an exec-ready argv
+ * Both point into the owning ParsedCommand's arena. Every view is followed
+ * by a NUL byte, so data() can be handed to system calls directly.
+ */
+class ArgList {
+private:
+    const string_view* views;
+    char* const* cArgs;             // nullptr-terminated
+    size_t count;
+
+public:
+    ArgList() : views(nullptr), cArgs(nullptr), count(0) {}
+    ArgList(const string_view* argViews, char* const* argPointers, size_t argCount)
+        : views(argViews), cArgs(argPointers), count(argCount) {}
+    
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    string_view operator[](size_t i) const { return views[i]; }
+    const string_view* begin() const { return views; }
+    const string_view* end() const { return views + count; }
+    
+    /**
+     * Get the arguments in the form execv expects
+     * @return nullptr-terminated array of C strings
+     */
+    char* const* argv() const { return cArgs; }
+    
+    /**
+     * Drop leading arguments (e.g. a prefix builtin such as `time`)
+     * @param n Number of arguments to skip
+     * @return The remaining arguments, sharing the same storage
+     */
+    ArgList skip(size_t n) const {
+        return n >= count ? ArgList() : ArgList(views + n, cArgs + n, count - n);
+    }
+};
+
+/**
+ * One command in a pipeline, with its own I/O redirection
+ */
+struct PipelineStage {
+    ArgList args;                       // Command and its arguments
+    string_view inputFile;              // Input redirection file (empty: none)
+    string_view outputFile;             // Output redirection file (empty: none)
+    bool appendOutput;                       // Whether to append (>>) or overwrite (>)
+    string_view hereString;             // Here-string text; a newline is added when fed (data() nullptr: none)
+    int hereDocFd;                      // Here-document body, filled in by the shell (-1: none)
+    size_t argStart;                    // Index of the first argument in the arena tables
+    
+    PipelineStage() : appendOutput(false), hereDocFd(-1), argStart(0) {}
+    
+    bool hasHereInput() const { return hereDocFd != -1 || hereString.data() != nullptr; }
+};
+
+/**
+ * A here-document (<<WORD) whose body still has to be read
+ * The body is the lines following the command line, up to a line equal to
+ * the delimiter; the shell reads them and sets the stage's hereDocFd.
+ */
+struct HereDocument {
+    size_t stage;                       // Stage it feeds (npos: overridden by a later <)
+    string_view delimiter;              // Line that ends the body
+    bool expand;                        // Expand $VAR in the body (delimiter unquoted)
+    bool stripTabs;                     // <<- : drop leading tabs from body lines
+};
+
 /**
  * Structure to hold parsed command information
- * Contains all necessary data for command execution including
- * I/O redirection, pipes, and background execution flags
+ * A command line is a pipeline of one or more stages connected by pipes,
+ * optionally run in the background.
+ *
+ * All text lives in one per-line arena owned by the command; stages only
+ * hold views into it. Reusing a ParsedCommand for the next line keeps the
+ * arena's capacity, so steady-state parsing does not allocate. Moving is
+ * fine (the buffers move with it), copying is not.
  */
 struct ParsedCommand {
-    vector<string> args;           // Command and its arguments
-    string inputFile;                   // Input redirection file
-    string outputFile;                  // Output redirection file
-    bool appendOutput;                       // Whether to append (>>) or overwrite (>)
+    vector<PipelineStage> stages;   // Stages in pipeline order (at least one)
     bool background;                         // Whether to run in background (&)
-    bool hasPipe;                           // Whether command has pipe (|)
-    vector<string> pipeCommand;    // Command after pipe
     
-    ParsedCommand() : appendOutput(false), background(false), hasPipe(false) {}
+    vector<char> arena;                 // Token text, each token NUL-terminated
+    vector<string_view> argViews;       // Arguments of all stages, stage after stage
+    vector<char*> argPointers;          // Same, with a nullptr closing each stage
+    vector<HereDocument> hereDocs;      // Here-documents in the order their bodies follow
+    
+    ParsedCommand() : stages(1), background(false) {}
+    ~ParsedCommand() { closeHereDocs(); }
+    ParsedCommand(const ParsedCommand&) = delete;
+    ParsedCommand& operator=(const ParsedCommand&) = delete;
+    ParsedCommand(ParsedCommand&&) = default;
+    ParsedCommand& operator=(ParsedCommand&&) = default;
+    
+    bool hasPipe() const { return stages.size() > 1; }
+    
+    /**
+     * Empty the command for reuse, keeping allocated capacity
+     * Here-document descriptors are closed.
+     */
+    void clear();
+    
+    /**
+     * Close every stage's here-document descriptor
+     */
+    void closeHereDocs();
+};
+
+/**
+ * Kinds of token produced by the lexer
+ * Operators are only recognised when unquoted, so '|' or "a > b" stay words
+ */
+enum class TokenType {
+    Word,           // Argument text with quotes removed and variables expanded
+    Pipe,           // |
+    Input,          // <
+    Output,         // >
+    Append,         // >>
+    HereDoc,        // <<
+    HereDocStrip,   // <<-
+    HereString,     // <<<
+    Background,     // &
+    Semicolon,      // ;
+    AndIf,          // &&
+    OrIf,           // ||
+    Newline,        // End of a line inside a multi-line command
+    OpenParen,      // (
+    CloseParen      // )
+};
+
+struct Token {
+    TokenType type;
+    size_t offset;          // Start of the word's text in the arena (in a
+                            // template: index of the word's first part)
+    size_t length;          // Text length (in a template: number of parts)
+    bool quoted;            // The word contained quotes
+    bool glob = false;      // Has unquoted *, ? or [...]: expands to matching paths
+};
+
+/**
+ * A ${...} expansion with an operator, split up when the line was lexed
+ * The text between the braces is kept in the template's text; the name and
+ * operands are ranges within it. Operands are expanded (variables, quotes,
+ * substitutions) every time the expansion is.
+ */
+struct ParameterExpansion {
+    enum Operation : unsigned char {
+        Value,              // ${NAME}
+        Length,             // ${#NAME}
+        Default,            // ${NAME:-word}
+        Assign,             // ${NAME:=word}
+        Alternative,        // ${NAME:+word}
+        Check,              // ${NAME:?message}
+        Substring,          // ${NAME:offset} or ${NAME:offset:length}
+        RemoveShortPrefix,  // ${NAME#pattern}
+        RemoveLongPrefix,   // ${NAME##pattern}
+        RemoveShortSuffix,  // ${NAME%pattern}
+        RemoveLongSuffix,   // ${NAME%%pattern}
+        ReplaceFirst,       // ${NAME/pattern/string}
+        ReplaceAll,         // ${NAME//pattern/string}
+        ReplacePrefix,      // ${NAME/#pattern/string}
+        ReplaceSuffix       // ${NAME/%pattern/string}
+    };
+    
+    Operation operation;
+    bool colon;             // :- := :+ :? treat an empty value like an unset one
+    bool hasSecond;         // A second operand was given
+    uint32_t offset;        // Text between the braces, in the template's text
+    uint32_t length;
+    uint32_t name;          // Ranges within that text
+    uint32_t nameLength;
+    uint32_t subscript;     // NAME[subscript]: an array element, or @ or * for all
+    uint32_t subscriptLength;
+    uint32_t word;          // Word, message, pattern or offset expression
+    uint32_t wordLength;
+    uint32_t second;        // Replacement or length expression
+    uint32_t secondLength;
+};
+
+/**
+ * A piece of a word in a command template: literal text, the name of a
+ * variable whose value is substituted each time the template is expanded,
+ * a $(( )) expression compiled when the line was lexed, the text of a
+ * $( ) or `...` command run on every expansion, or a ${...} operator
+ */
+struct WordPart {
+    enum Kind : unsigned char { 
+        Literal, Variable, Arithmetic, Command, Parameter,
+        ArithmeticText      // $(( )) with quotes, ${...}, $( ) or `...`: expanded
+                            // as text first, then evaluated
+    };
+    
+    // How a variable's value is escaped inside [[ ]], where the condition
+    // has to tell quoted pattern characters from pattern syntax
+    enum Escape : unsigned char {
+        NoEscape,
+        EscapeSpecial,      // Quoted: pattern and regex characters get a backslash
+        EscapeBackslash     // Unquoted: only backslashes are doubled
+    };
+    
+    Kind kind;
+    bool quoted;            // Inside quotes: a variable's value is not split
+    Escape escape;
+    uint32_t offset;        // Text (variable name, command, expression) in the template's text;
+                            // Arithmetic: first operation in the template's code;
+                            // Parameter: index in the template's parameters
+    uint32_t length;        // Arithmetic: number of operations
+};
+
+/**
+ * A lexed command line whose variables have not been expanded yet
+ * Expanding a template only copies text and looks up variables, so a loop
+ * body lexed once can be run any number of times without re-scanning its
+ * source. Clearing keeps capacity, like ParsedCommand.
+ */
+struct CommandTemplate {
+    vector<Token> tokens;
+    vector<WordPart> parts;
+    vector<char> text;
+    vector<ArithOp> arithmetic;     // Compiled $(( )) expressions; names in text
+    vector<ParameterExpansion> parameters;      // ${...} operators
+    
+    void clear() {
+        tokens.clear();
+        parts.clear();
+        text.clear();
+        arithmetic.clear();
+        parameters.clear();
+    }
+    
+    /**
+     * Copy a range of another template's tokens to the end of this one
+     * @param source Template to copy from
+     * @param first Index of the first token
+     * @param last Index one past the last token
+     */
+    void append(const CommandTemplate& source, size_t first, size_t last);
+    
+    /**
+     * Get a word's text if it is plain unquoted text (a keyword candidate)
+     * @param index Token index
+     * @return The text, or an empty view if the token is not such a word
+     */
+    string_view literal(size_t index) const;
 };
 
 /**
  * CommandParser class handles all command line parsing logic
  * Responsibilities:
- * - Split command line into tokens
- * - Handle variable expansion ($VAR)
- * - Parse I/O redirection operators (<, >, >>)
- * - Parse pipe operators (|)
+ * - Split command line into tokens in a single pass
+ * - Handle quoting ('single', "double", backslash)
+ * - Handle variable expansion ($VAR) while tokens are built
+ * - Keep [[ ... ]] together as one command: its operators become words
+ *   and quoted pattern characters are escaped for the condition builtin
+ * - Expand words with unquoted *, ? and [...] (and ** levels) into the
+ *   paths they match, reading each directory once per command
+ * - Compile arithmetic expansion ($(( ))) when lexing and evaluate it on
+ *   expansion, assigning variables through the shell
+ * - Keep command substitution ($( ) and `...`) as text and have the shell
+ *   run it on expansion
+ * - Parameter expansion (${NAME}, ${NAME:-word}, ${#NAME}, ${NAME#pattern},
+ *   ${NAME/pattern/string}, ${NAME:offset:length}, ...) without forking
+ * - Parse I/O redirection operators (<, >, >>, <<, <<-, <<<)
+ * - Parse pipe operators (|) into pipeline stages
  * - Parse background execution (&)
+ * - Recognise list and grouping operators (;, &&, ||, newline, parentheses)
+ *   for the script compiler
+ *
+ * Lexing produces a CommandTemplate; expanding it fills a ParsedCommand.
+ * parse() does both for one-off lines.
  */
 class CommandParser {
+public:
+    // Sets a shell variable (name, value) on behalf of an expression
+    using Assigner = function<void(const string&, const string&)>;
+    
+    // Runs a substituted command and returns its output with trailing
+    // newlines removed (nullptr on a syntax error, already reported)
+    using Substituter = function<const char*(string_view)>;
+    
+    // Deepest nesting of variables whose values are expressions themselves
+    static const size_t MAX_ARITHMETIC_DEPTH = 1024;
+
 private:
+    /**
+     * Buffers for one level of nested ${...} expansion
+     */
+    struct ParameterScratch {
+        string name;        // Variable or element name
+        string value;       // The variable's value
+        string word;        // Expanded operand
+        string second;      // Expanded replacement
+        string result;      // Value of a template's ${...} part
+    };
+    
+    /**
+     * How expandText() treats quotes and backslashes
+     * - Word: an operand of ${...}; quotes are removed
+     * - Pattern: the same, with quoted characters escaped so that they
+     *   match literally
+     * - HereDocument: quotes are plain text; a backslash only escapes
+     *   $, ` and another backslash
+     */
+    enum class TextMode { Word, Pattern, HereDocument };
+    
+    /**
+     * Expansion state parked while a substituted command is expanded by
+     * this same parser; one per nesting level, so capacity is kept
+     */
+    struct ExpansionState {
+        vector<Token> tokens;
+        vector<char> pattern;
+    };
+    
+    /**
+     * A compiled expression kept for `let` and for variable values that are
+     * expressions, keyed by its text
+     */
+    struct CachedExpression {
+        vector<ArithOp> code;
+        vector<char> names;
+    };
+    
+    // Cached expressions before the cache starts over
+    static const size_t EXPRESSION_CACHE_SIZE = 256;
+    
     const map<string, string>* shellVariables;
+    Assigner assigner;
+    Substituter substituter;
+    string nameScratch;     // Reused buffer for variable names during expansion
+    string joinScratch;     // Reused buffer for $@ and $* joined into one word
+    vector<Token> tokens;   // Reused token list, words pointing into the arena
+    CommandTemplate lineTemplate;   // Reused by parse()
+    unordered_map<string, CachedExpression> expressionCache;
+    string expressionKey;           // Reused buffer for cache lookups
+    vector<int64_t> arithmeticStack;    // Shared by nested evaluations
+    size_t arithmeticDepth;
+    char numberScratch[24];         // Text of the last $(( )) value
+    Glob glob;                      // Directory listings live for one command
+    vector<char> patternScratch;    // Reused buffer for a word's glob pattern
+    vector<ExpansionState> savedExpansions;     // Indexed by substitution depth
+    size_t substitutionDepth;
+    vector<unique_ptr<ParameterScratch>> parameterScratch;  // One per nesting level
+    size_t parameterDepth;
+    bool checkFailed;       // The last expansion failed on ${NAME:?}
+    GlobPattern parameterPattern;   // Compiled pattern of the innermost ${...}
     
-    vector<string> tokenize(const string& input);
-    string expandVariables(const string& input);
+    /**
+     * Find the end of the variable name starting at input[pos]
+     * @param input The text being scanned
+     * @param pos Index just past the '$'
+     * @return Index past the name (pos if no name follows the '$')
+     */
+    static size_t nameEnd(string_view input, size_t pos);
+    
+    /**
+     * Split the text between ${ and } into a name, operator and operands
+     * @param inner The text between the braces
+     * @param expansion Receives the operator; ranges are relative to inner
+     * @return false if it is not a valid expansion
+     */
+    static bool parseParameter(string_view inner, ParameterExpansion& expansion);
     
+    /**
+     * Look up a variable (environment first, then shell variables)
+     * $@ and $* join the positional parameters with spaces.
+     * @param name The variable name
+     * @return The value, or nullptr if unset
+     */
+    const char* lookupVariable(const string& name);
+    
+    /**
+     * Look up an array element, NAME[index]
+     * Arrays are dense: elements are the variables NAME[0], NAME[1], ...
+     * up to the first unset one. A subscript of @ or * joins every
+     * element with spaces; a negative index counts from the end.
+     * @param name The array name
+     * @param subscript The index expression (expanded, then evaluated)
+     * @param key Receives the element's variable name
+     * @param count Receives the number of elements, for @ and *
+     * @param value Receives the value, or nullptr if unset
+     * @return false if the subscript is not a valid expression (reported)
+     */
+    bool lookupElement(string_view name, string_view subscript, string& key, 
+                       size_t& count, const char*& value);
+    
+    /**
+     * Evaluate an arithmetic expression after expanding any ${...}, $( ),
+     * `...` and quotes in it; blank text is 0
+     * @param scratch Storage for the expanded text
+     * @return false on an error (already reported)
+     */
+    bool evaluateOperand(string_view expression, string& scratch, int64_t& value);
+    
+    /**
+     * Look up the variable a template part names
+     * @return The value ("" if unset)
+     */
+    const char* partValue(const CommandTemplate& tpl, const WordPart& part);
+    
+    /**
+     * Evaluate the $(( )) expression a template part holds, compiled or
+     * (ArithmeticText) as text to expand first
+     * @return The value as decimal text (valid until the next call), or
+     *         nullptr on an error (already reported)
+     */
+    const char* arithmeticValue(const CommandTemplate& tpl, const WordPart& part);
+    
+    /**
+     * Run the command a template part holds, through the substituter
+     * @return Its output, or nullptr on an error (already reported)
+     */
+    const char* commandValue(const CommandTemplate& tpl, const WordPart& part) {
+        return runSubstitution(string_view(tpl.text.data() + part.offset, part.length));
+    }
+    
+    /**
+     * Run command text through the substituter
+     * @return Its output, or nullptr on an error (already reported)
+     */
+    const char* runSubstitution(string_view command);
+    
+    /**
+     * Expand the ${...} a template part holds
+     * @return The value (valid until the next call at the same depth), or
+     *         nullptr on an error (already reported)
+     */
+    const char* parameterValue(const CommandTemplate& tpl, const WordPart& part);
+    
+    /**
+     * Get the value of any part that is not literal text
+     * @return The value, or nullptr on an error (already reported)
+     */
+    const char* expandPart(const CommandTemplate& tpl, const WordPart& part);
+    
+    /**
+     * Apply a ${...} operator
+     * @param expansion The operator and its ranges
+     * @param text The text between the braces
+     * @param out Receives the value, after what it already holds
+     * @return false on an error (already reported)
+     */
+    bool expandParameter(const ParameterExpansion& expansion, const char* text, string& out);
+    
+    /**
+     * Remove the shortest or longest match of parameterPattern from either
+     * end of a value, or replace matches, for the pattern operators
+     * @param operation Which operator
+     * @param value The variable's value
+     * @param pattern The expanded pattern (escapes intact)
+     * @param replacement Replacement text for the / operators
+     * @param out Receives the result, after what it already holds
+     */
+    void applyPattern(ParameterExpansion::Operation operation, string_view value,
+                      string_view pattern, string_view replacement, string& out);
+    
+    /**
+     * Expand $NAME, ${...}, $(( )), $( ) and `...` in text, in one pass
+     * @param text The text
+     * @param out Receives the expansion, after what it already holds
+     * @param mode How quotes and backslashes are treated
+     * @return false on an error (already reported)
+     */
+    bool expandText(string_view text, string& out, TextMode mode);
+    
+    /**
+     * Add a word part's text to the word's glob pattern; quoted text is
+     * escaped so that it matches literally
+     */
+    void appendPattern(const WordPart& part, const char* value, size_t length);
+    
+    /**
+     * Expand the glob pattern built in patternScratch
+     * @return true if anything matched; the paths are in glob.matches()
+     */
+    bool expandPattern() {
+        return glob.expand(string_view(patternScratch.data(), patternScratch.size()));
+    }
+    
+    /**
+     * Run compiled arithmetic
+     * @param code The expression's operations
+     * @param count Number of operations
+     * @param names Text the operations' names point into
+     * @param result Receives the value
+     * @return false on an error such as division by zero (already reported)
+     */
+    bool evaluate(const ArithOp* code, size_t count, const char* names, int64_t& result);
+    
+    /**
+     * Get a variable's value as a number for an expression
+     * Unset and empty variables are 0; a value that is not a number is
+     * evaluated as an expression itself.
+     * @return false if that fails
+     */
+    bool variableNumber(const char* names, const ArithOp& op, int64_t& value);
+    
+    /**
+     * Assign a number to a variable named by an operation
+     * @return false if the shell did not provide a way to assign
+     */
+    bool assignNumber(const char* names, const ArithOp& op, int64_t value);
+    
+    /**
+     * Check whether a word is exactly "$@", which expands to one word per
+     * positional parameter
+     */
+    static bool isAllParameters(const CommandTemplate& tpl, const Token& word);
+    
+    /**
+     * Get the number of positional parameters ($#)
+     */
+    size_t parameterCount() const;
+    
+    /**
+     * Turn the expanded token list into pipeline stages
+     * @param cmd Command whose arena holds the words' text
+     * @return false on a syntax error (already reported)
+     */
+    bool build(ParsedCommand& cmd);
+
 public:
     CommandParser(const map<string, string>* variables);
     
+    /**
+     * Let expressions assign variables (x = 1, i++); without an assigner
+     * they can only read them
+     * @param setVariable Called with the name and the new value
+     */
+    void setAssigner(Assigner setVariable) { assigner = std::move(setVariable); }
+    
+    /**
+     * Let $( ) and `...` run commands; without a substituter they are errors
+     * @param runCommand Called with the command text; may expand templates
+     *                   with this parser again
+     */
+    void setSubstituter(Substituter runCommand) { substituter = std::move(runCommand); }
+    
+    /**
+     * Evaluate an arithmetic expression given as text, as `let` does
+     * The compiled form is cached, so a loop evaluating the same text again
+     * does not parse it again.
+     * @param expression The expression
+     * @param result Receives the value
+     * @return false on a syntax or evaluation error (already reported)
+     */
+    bool evaluateArithmetic(string_view expression, int64_t& result);
+    
+    /**
+     * Split command text into tokens without expanding variables
+     * Values are substituted when the template is expanded and are never
+     * re-scanned, so a value containing spaces or operators stays part of a
+     * single word. $(( )) expressions are compiled here, once per place
+     * they appear; ${...} is split into name, operator and operands, and
+     * $( ) and `...` keep their command text. Text may span
+     * several lines; a comment runs to the end of its line.
+     * @param input The raw text
+     * @param tpl Receives the tokens; its storage is reused
+     * @return false on a syntax error (already reported)
+     */
+    bool lex(const string& input, CommandTemplate& tpl);
+    
+    /**
+     * Expand a template into a command ready to run
+     * Words that expand to nothing are dropped unless they were quoted.
+     * @param tpl A template holding a single pipeline
+     * @param cmd Receives the command; its storage is reused
+     * @return false on a syntax error (cmd is left empty)
+     */
+    bool expand(const CommandTemplate& tpl, ParsedCommand& cmd);
+    
+    /**
+     * Whether the last failed expand() or expandWords() stopped at a
+     * ${NAME:?} whose variable was missing (status 1, not a syntax error)
+     */
+    bool failedCheck() const { return checkFailed; }
+    
+    /**
+     * Expand a range of template words into separate strings
+     * Unquoted variable values and command output are split at blanks, as
+     * for a `for` list.
+     * @param tpl The template
+     * @param first Index of the first word token
+     * @param last Index one past the last word token
+     * @param words Receives the words (cleared first)
+     * @return false if an arithmetic expansion or command substitution
+     *         failed (already reported)
+     */
+    bool expandWords(const CommandTemplate& tpl, size_t first, size_t last, 
+                     vector<string>& words);
+    
+    /**
+     * Check whether a template is a single pipeline that needs no compiling
+     * (no list operators, and no keyword where a command name goes)
+     * @param tpl The lexed line
+     */
+    bool isSimple(const CommandTemplate& tpl) const;
+    
+    /**
+     * Check whether a word is reserved for the shell's grammar
+     * @param word The word, as CommandTemplate::literal() gives it
+     */
+    static bool isReservedWord(string_view word);
+    
+    /**
+     * Get an operator's text for error messages
+     * @param type The token type ("word" for words)
+     */
+    static const char* operatorText(TokenType type);
+    
     /**
      * Parse a command line string into structured command information
      * @param commandLine The raw command line input
+     * @param cmd Receives the parsed command; its storage is reused
+     * @return false on a syntax error (cmd is left empty)
+     */
+    bool parse(const string& commandLine, ParsedCommand& cmd);
+    
+    /**
+     * Parse a command line string into a fresh ParsedCommand
+     * @param commandLine The raw command line input
      * @return ParsedCommand structure with all parsed information
      */
     ParsedCommand parse(const string& commandLine);
     
+    /**
+     * Expand a here-document line in one pass: $VAR, ${...}, $(( )),
+     * $( ) and `...`, with quotes left as they are
+     * @param input The text to expand
+     * @return The expanded text (as far as it got, if an expansion failed)
+     */
+    string expandVariables(const string& input);
+    
     /**
      * Check if input is empty or whitespace only
      * @param input The string to check
@@ -0,0 +1,93 @@
+#include "FdStream.h"
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+
+FdStreamBuf::FdStreamBuf(int descriptor) : fd(descriptor) {}
+
+FdStreamBuf::~FdStreamBuf() {
+    if (pbase()) {
+        flushBuffer();
+    }
+}
+
+bool FdStreamBuf::writeAll(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool FdStreamBuf::flushBuffer() {
+    bool ok = writeAll(pbase(), pptr() - pbase());
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return ok;
+}
+
+FdStreamBuf::int_type FdStreamBuf::overflow(int_type c) {
+    if (!pbase()) {
+        buffer.resize(BUFFER_SIZE);
+        setp(buffer.data(), buffer.data() + buffer.size());
+    } else if (!flushBuffer()) {
+        return traits_type::eof();
+    }
+    
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize FdStreamBuf::xsputn(const char* data, std::streamsize size) {
+    if (!pbase() || size > epptr() - pptr()) {
+        // Doesn't fit: write out what is buffered, and send large blocks
+        // straight to the descriptor
+        if (pbase() && !flushBuffer()) {
+            return 0;
+        }
+        if (size >= static_cast<std::streamsize>(BUFFER_SIZE)) {
+            return writeAll(data, size) ? size : 0;
+        }
+        if (!pbase()) {
+            buffer.resize(BUFFER_SIZE);
+            setp(buffer.data(), buffer.data() + buffer.size());
+        }
+    }
+    
+    std::copy(data, data + size, pptr());
+    pbump(static_cast<int>(size));
+    return size;
+}
+
+FdStreamBuf::int_type FdStreamBuf::underflow() {
+    if (buffer.empty()) {
+        buffer.resize(BUFFER_SIZE);
+    }
+    
+    ssize_t count;
+    do {
+        count = read(fd, buffer.data(), buffer.size());
+    } while (count == -1 && errno == EINTR);
+    
+    if (count <= 0) {
+        return traits_type::eof();
+    }
+    setg(buffer.data(), buffer.data(), buffer.data() + count);
+    return traits_type::to_int_type(*gptr());
+}
+
+int FdStreamBuf::sync() {
+    if (pbase() && !flushBuffer()) {
+        return -1;
+    }
+    return 0;
+}
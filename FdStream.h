@@ -0,0 +1,110 @@
+#ifndef FD_STREAM_H
+#define FD_STREAM_H
+
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * FdStreamBuf is a buffered stream buffer over a raw file descriptor
+ * Lets builtins write to pipes and redirection targets, and read from
+ * them, through the same std::ostream/std::istream interface as
+ * std::cout/std::cin, without forking.
+ *
+ * The descriptor is borrowed, never closed. The buffer is only allocated
+ * on first use, so an unused stream costs nothing.
+ */
+class FdStreamBuf : public std::streambuf {
+private:
+    int fd;
+    std::vector<char> buffer;
+    
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    
+    /**
+     * Write out everything in the put area
+     * @return true if successful, false on a write error (e.g. EPIPE)
+     */
+    bool flushBuffer();
+    
+    /**
+     * Write a block directly, retrying short writes
+     * @return true if every byte was written
+     */
+    bool writeAll(const char* data, size_t size);
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* data, std::streamsize size) override;
+    int_type underflow() override;
+    int sync() override;
+
+public:
+    explicit FdStreamBuf(int descriptor);
+    ~FdStreamBuf() override;
+    
+    FdStreamBuf(const FdStreamBuf&) = delete;
+    FdStreamBuf& operator=(const FdStreamBuf&) = delete;
+};
+
+/**
+ * Output stream writing to a file descriptor
+ */
+class FdOStream : public std::ostream {
+private:
+    FdStreamBuf buf;
+
+public:
+    explicit FdOStream(int fd) : std::ostream(nullptr), buf(fd) { rdbuf(&buf); }
+};
+
+/**
+ * Input stream reading from a file descriptor
+ */
+class FdIStream : public std::istream {
+private:
+    FdStreamBuf buf;
+
+public:
+    explicit FdIStream(int fd) : std::istream(nullptr), buf(fd) { rdbuf(&buf); }
+};
+
+/**
+ * Stream buffer appending to a borrowed string
+ */
+class StringStreamBuf : public std::streambuf {
+private:
+    std::string* target;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            target->push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+    
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        target->append(data, static_cast<size_t>(size));
+        return size;
+    }
+
+public:
+    explicit StringStreamBuf(std::string& text) : target(&text) {}
+};
+
+/**
+ * Output stream appending to a string, for capturing a builtin's output
+ * in memory; the string's capacity carries over between captures
+ */
+class StringOStream : public std::ostream {
+private:
+    StringStreamBuf buf;
+
+public:
+    explicit StringOStream(std::string& text) : std::ostream(nullptr), buf(text) { rdbuf(&buf); }
+};
+
+#endif // FD_STREAM_H
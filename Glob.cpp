@@ -0,0 +1,403 @@
+#include "Glob.h"
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace {
+    /**
+     * Character classes allowed inside brackets ([[:digit:]] and so on)
+     */
+    struct CharacterClass {
+        const char* name;
+        int (*test)(int);
+    };
+    
+    const CharacterClass characterClasses[] = {
+        {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank}, {"cntrl", iscntrl},
+        {"digit", isdigit}, {"graph", isgraph}, {"lower", islower}, {"print", isprint},
+        {"punct", ispunct}, {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+    };
+    
+    /**
+     * Parse a bracket expression starting at pattern[start] == '['
+     * @param end Receives the index of the closing ']'
+     * @return false if the bracket is not closed (it is then a literal '[')
+     */
+    bool parseSet(std::string_view pattern, size_t start, std::bitset<256>& set, size_t& end) {
+        size_t i = start + 1;
+        bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+        if (negate) {
+            i++;
+        }
+        size_t first = i;
+        
+        for (; i < pattern.size(); i++) {
+            unsigned char c = pattern[i];
+            if (c == ']' && i > first) {
+                if (negate) {
+                    set.flip();
+                }
+                end = i;
+                return true;
+            }
+            if (c == '[' && i + 1 < pattern.size() && pattern[i + 1] == ':') {
+                size_t close = pattern.find(":]", i + 2);
+                if (close != std::string_view::npos) {
+                    std::string_view name = pattern.substr(i + 2, close - i - 2);
+                    for (const CharacterClass& characterClass : characterClasses) {
+                        if (name == characterClass.name) {
+                            for (int b = 0; b < 256; b++) {
+                                if (characterClass.test(b)) {
+                                    set.set(b);
+                                }
+                            }
+                        }
+                    }
+                    i = close + 1;
+                    continue;
+                }
+            }
+            if (c == '\\' && i + 1 < pattern.size()) {
+                c = pattern[++i];
+            }
+            // a-z; a '-' first or last is literal
+            if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+                unsigned char last = pattern[i + 2];
+                size_t skip = 2;
+                if (last == '\\' && i + 3 < pattern.size()) {
+                    last = pattern[i + 3];
+                    skip = 3;
+                }
+                for (unsigned b = c; b <= last; b++) {
+                    set.set(b);
+                }
+                i += skip;
+                continue;
+            }
+            set.set(c);
+        }
+        return false;
+    }
+    
+    bool isDotOrDotDot(const char* name) {
+        return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+    }
+}
+
+bool GlobPattern::hasWildcards(std::string_view text) {
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '\\') {
+            i++;
+        } else if (text[i] == '*' || text[i] == '?' || text[i] == '[') {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GlobPattern::compile(std::string_view pattern) {
+    elements.clear();
+    literals.clear();
+    sets.clear();
+    minLength = 0;
+    
+    auto addLiteral = [this](char c) {
+        if (!elements.empty() && elements.back().kind == Element::Literal) {
+            elements.back().length++;
+        } else {
+            elements.push_back(Element{Element::Literal, static_cast<uint32_t>(literals.size()), 1});
+        }
+        literals += c;
+        minLength++;
+    };
+    
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            addLiteral(pattern[++i]);
+        } else if (c == '*') {
+            // Consecutive stars are one star
+            if (elements.empty() || elements.back().kind != Element::Star) {
+                elements.push_back(Element{Element::Star, 0, 0});
+            }
+        } else if (c == '?') {
+            elements.push_back(Element{Element::Any, 0, 0});
+            minLength++;
+        } else if (c == '[') {
+            std::bitset<256> set;
+            size_t end;
+            if (parseSet(pattern, i, set, end)) {
+                elements.push_back(Element{Element::Set, static_cast<uint32_t>(sets.size()), 0});
+                sets.push_back(set);
+                minLength++;
+                i = end;
+            } else {
+                addLiteral(c);
+            }
+        } else {
+            addLiteral(c);
+        }
+    }
+    
+    leadingDot = !elements.empty() && elements[0].kind == Element::Literal &&
+                 literals[elements[0].offset] == '.';
+}
+
+bool GlobPattern::elementMatches(const Element& element, const char* name, size_t length,
+                                 size_t at, size_t& width) const {
+    switch (element.kind) {
+        case Element::Literal:
+            width = element.length;
+            return at + width <= length &&
+                   std::memcmp(name + at, literals.data() + element.offset, width) == 0;
+        case Element::Any:
+            width = 1;
+            return at < length;
+        case Element::Set:
+            width = 1;
+            return at < length && sets[element.offset].test(static_cast<unsigned char>(name[at]));
+        case Element::Star:
+            break;
+    }
+    return false;
+}
+
+bool GlobPattern::matches(std::string_view name) const {
+    if (!name.empty() && name[0] == '.' && !leadingDot) {
+        return false;
+    }
+    return matchesText(name);
+}
+
+bool GlobPattern::matchesText(std::string_view name) const {
+    if (name.size() < minLength) {
+        return false;
+    }
+    
+    const size_t count = elements.size();
+    const size_t length = name.size();
+    const size_t NONE = static_cast<size_t>(-1);
+    size_t e = 0;
+    size_t i = 0;
+    size_t resumeElement = NONE;    // Element after the last star seen
+    size_t resumeAt = 0;            // Where that star's match currently ends
+    
+    for (;;) {
+        if (e < count) {
+            const Element& element = elements[e];
+            if (element.kind == Element::Star) {
+                if (e + 1 == count) {
+                    return true;    // A final star takes the rest
+                }
+                resumeElement = ++e;
+                resumeAt = i;
+                continue;
+            }
+            size_t width;
+            if (elementMatches(element, name.data(), length, i, width)) {
+                i += width;
+                e++;
+                continue;
+            }
+        } else if (i == length) {
+            return true;
+        }
+        
+        // Mismatch: let the last star take one more character and retry
+        if (resumeElement == NONE || resumeAt >= length) {
+            return false;
+        }
+        resumeAt++;
+        const Element& after = elements[resumeElement];
+        if (after.kind == Element::Literal) {
+            // Skip straight to the next place the literal can start
+            const void* found = std::memchr(name.data() + resumeAt, literals[after.offset],
+                                            length - resumeAt);
+            if (!found) {
+                return false;
+            }
+            resumeAt = static_cast<const char*>(found) - name.data();
+        }
+        i = resumeAt;
+        e = resumeElement;
+    }
+}
+
+const Glob::Listing& Glob::list(const std::string& directory) {
+    auto it = listings.find(directory);
+    if (it != listings.end()) {
+        return it->second;
+    }
+    Listing& listing = listings[directory];
+    
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    listing.readable = fd != -1;
+    if (fd == -1) {
+        return listing;
+    }
+    
+    // Many entries per system call; the buffer is kept for the next directory
+    readBuffer.resize(READ_BATCH);
+    for (;;) {
+        long bytes = syscall(SYS_getdents64, fd, readBuffer.data(), readBuffer.size());
+        if (bytes <= 0) {
+            break;
+        }
+        for (long at = 0; at < bytes;) {
+            const struct dirent64* entry = reinterpret_cast<const struct dirent64*>(readBuffer.data() + at);
+            at += entry->d_reclen;
+            if (isDotOrDotDot(entry->d_name)) {
+                continue;
+            }
+            size_t nameLength = std::strlen(entry->d_name);
+            listing.offsets.push_back(static_cast<uint32_t>(listing.names.size()));
+            listing.types.push_back(entry->d_type);
+            listing.names.insert(listing.names.end(), entry->d_name, entry->d_name + nameLength + 1);
+        }
+    }
+    close(fd);
+    return listing;
+}
+
+bool Glob::isDirectory(const std::string& directory, const Listing& listing, size_t index) {
+    unsigned char type = listing.types[index];
+    if (type == DT_DIR) {
+        return true;
+    }
+    if (type != DT_LNK && type != DT_UNKNOWN) {
+        return false;
+    }
+    std::string path = directory + (listing.names.data() + listing.offsets[index]);
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+void Glob::addSubdirectories(const std::string& directory, std::vector<std::string>& out) {
+    // Breadth first; out doubles as the queue. Links are not followed, so
+    // a cycle cannot make this run forever.
+    size_t queued = out.size();
+    std::string parent = directory;
+    for (;;) {
+        const Listing& listing = list(parent);
+        for (size_t k = 0; k < listing.offsets.size(); k++) {
+            const char* name = listing.names.data() + listing.offsets[k];
+            if (name[0] == '.') {
+                continue;
+            }
+            unsigned char type = listing.types[k];
+            if (type == DT_UNKNOWN) {
+                struct stat info;
+                std::string path = parent + name;
+                type = lstat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode) ? DT_DIR : DT_REG;
+            }
+            if (type == DT_DIR) {
+                out.push_back(parent + name + "/");
+            }
+        }
+        if (queued == out.size()) {
+            break;
+        }
+        parent = out[queued++];
+    }
+}
+
+void Glob::addResult(std::string_view directory, std::string_view name) {
+    resultSpans.emplace_back(resultText.size(), directory.size() + name.size());
+    resultText.insert(resultText.end(), directory.begin(), directory.end());
+    resultText.insert(resultText.end(), name.begin(), name.end());
+}
+
+bool Glob::expand(std::string_view text) {
+    results.clear();
+    resultText.clear();
+    resultSpans.clear();
+    current.clear();
+    current.emplace_back(!text.empty() && text[0] == '/' ? "/" : "");
+    size_t pos = current[0].size();
+    bool wildcards = false;
+    std::string literal;
+    
+    for (;;) {
+        size_t slash = text.find('/', pos);
+        bool last = slash == std::string_view::npos;
+        std::string_view component = text.substr(pos, last ? std::string_view::npos : slash - pos);
+        next.clear();
+        
+        if (component == "**") {
+            // Any number of directory levels, this one included; at the
+            // end, everything below
+            wildcards = true;
+            size_t count = current.size();
+            for (size_t d = 0; d < count; d++) {
+                if (last && !current[d].empty()) {
+                    addResult(current[d], "");
+                }
+                addSubdirectories(std::string(current[d]), current);
+            }
+            if (!last) {
+                pos = slash + 1;
+                continue;
+            }
+            component = "*";
+        }
+        
+        if (!GlobPattern::hasWildcards(component)) {
+            literal.clear();
+            for (size_t i = 0; i < component.size(); i++) {
+                if (component[i] == '\\' && i + 1 < component.size()) {
+                    i++;
+                }
+                literal += component[i];
+            }
+            for (const std::string& directory : current) {
+                if (!last) {
+                    next.push_back(directory + literal + "/");
+                    continue;
+                }
+                std::string path = directory + literal;
+                struct stat info;
+                if (lstat(path.empty() ? "." : path.c_str(), &info) == 0) {
+                    addResult(directory, literal);
+                }
+            }
+        } else {
+            wildcards = true;
+            pattern.compile(component);
+            for (const std::string& directory : current) {
+                const Listing& listing = list(directory);
+                for (size_t k = 0; k < listing.offsets.size(); k++) {
+                    const char* name = listing.names.data() + listing.offsets[k];
+                    if (!pattern.matches(name)) {
+                        continue;
+                    }
+                    if (last) {
+                        addResult(directory, name);
+                    } else if (isDirectory(directory, listing, k)) {
+                        next.push_back(directory + name + "/");
+                    }
+                }
+            }
+        }
+        
+        if (last || next.empty()) {
+            break;
+        }
+        current.swap(next);
+        pos = slash + 1;
+    }
+    
+    if (!wildcards || resultSpans.empty()) {
+        return false;
+    }
+    results.reserve(resultSpans.size());
+    for (const auto& span : resultSpans) {
+        results.emplace_back(resultText.data() + span.first, span.second);
+    }
+    std::sort(results.begin(), results.end());
+    return true;
+}
@@ -0,0 +1,158 @@
+#ifndef GLOB_H
+#define GLOB_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <bitset>
+#include <cstdint>
+
+/**
+ * A compiled pattern for one path component (*, ?, [...], \x escapes)
+ * Compiling turns the pattern into a list of elements once; matching a
+ * name walks them with a single resume point for the last '*', so it never
+ * backtracks more than one star and takes at most O(name x pattern).
+ */
+class GlobPattern {
+private:
+    struct Element {
+        enum Kind : uint8_t { Literal, Any, Set, Star };
+        Kind kind;
+        uint32_t offset;    // Literal: text in literals; Set: index in sets
+        uint32_t length;    // Literal: text length
+    };
+    
+    std::vector<Element> elements;
+    std::string literals;
+    std::vector<std::bitset<256>> sets;     // Bytes each [...] accepts (negation applied)
+    size_t minLength;                       // Shortest name that can match
+    bool leadingDot;                        // Starts with a literal '.'
+    
+    bool elementMatches(const Element& element, const char* name, size_t length,
+                        size_t at, size_t& width) const;
+
+public:
+    GlobPattern() : minLength(0), leadingDot(false) {}
+    
+    /**
+     * Check whether text contains unescaped pattern characters
+     */
+    static bool hasWildcards(std::string_view text);
+    
+    /**
+     * Compile a pattern
+     * @param pattern One path component, with backslash escapes
+     */
+    void compile(std::string_view pattern);
+    
+    /**
+     * Match a name
+     * Names starting with '.' only match a pattern that starts with '.'.
+     */
+    bool matches(std::string_view name) const;
+    
+    /**
+     * Match any text, such as a variable's value; unlike a name, a
+     * leading '.' needs no explicit match
+     */
+    bool matchesText(std::string_view text) const;
+    
+    /**
+     * Check whether the pattern is plain text, without wildcards
+     * @param text Receives the text, escapes removed
+     */
+    bool literalText(std::string_view& text) const {
+        if (elements.empty() || (elements.size() == 1 && elements[0].kind == Element::Literal)) {
+            text = literals;
+            return true;
+        }
+        return false;
+    }
+};
+
+/**
+ * Glob expands pathname patterns into the matching paths
+ * Responsibilities:
+ * - Split a pattern into components; match wildcard components against
+ *   directory listings, keep literal ones as they are
+ * - `**` as a whole component matches any number of directory levels
+ * - Read directories with large getdents64 batches into flat listings
+ * - Keep listings until clearCache(), so several patterns over the same
+ *   directory read it once
+ *
+ * Matches are sorted in byte order. Hidden names need an explicit leading
+ * '.', and . and .. are never matched.
+ */
+class Glob {
+public:
+    // Bytes requested per getdents64 call
+    static const size_t READ_BATCH = 1 << 20;
+
+private:
+    /**
+     * A directory's entries, names back to back (each NUL-terminated)
+     */
+    struct Listing {
+        std::vector<char> names;
+        std::vector<uint32_t> offsets;
+        std::vector<unsigned char> types;   // d_type of each entry
+        bool readable;
+    };
+    
+    std::unordered_map<std::string, Listing> listings;
+    std::vector<char> readBuffer;
+    std::vector<char> resultText;
+    std::vector<std::pair<size_t, size_t>> resultSpans;
+    std::vector<std::string_view> results;
+    std::vector<std::string> current;       // Directories matched so far
+    std::vector<std::string> next;
+    GlobPattern pattern;
+    
+    /**
+     * Get a directory's listing, reading it on first use
+     * @param directory Path with a trailing '/', or empty for the current one
+     */
+    const Listing& list(const std::string& directory);
+    
+    /**
+     * Check whether an entry is a directory, following symbolic links
+     */
+    bool isDirectory(const std::string& directory, const Listing& listing, size_t index);
+    
+    /**
+     * Add every directory below a directory, for `**`
+     */
+    void addSubdirectories(const std::string& directory, std::vector<std::string>& out);
+    
+    void addResult(std::string_view directory, std::string_view name);
+
+public:
+    Glob() = default;
+    Glob(const Glob&) = delete;
+    Glob& operator=(const Glob&) = delete;
+    
+    /**
+     * Expand a pattern
+     * @param text The pattern, with backslash escapes for characters that
+     *             must match literally
+     * @return true if anything matched; the paths are in matches()
+     */
+    bool expand(std::string_view text);
+    
+    /**
+     * Paths found by the last expand(), valid until the next call
+     */
+    const std::vector<std::string_view>& matches() const { return results; }
+    
+    /**
+     * Forget cached directory listings
+     */
+    void clearCache() {
+        if (!listings.empty()) {
+            listings.clear();
+        }
+    }
+};
+
+#endif // GLOB_H
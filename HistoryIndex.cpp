@@ -0,0 +1,54 @@
+#include "HistoryIndex.h"
+#include <algorithm>
+
+HistoryIndex::HistoryIndex() : postingCount(0) {}
+
+void HistoryIndex::add(uint32_t sequence, std::string_view text) {
+    if (text.size() < MIN_PATTERN) return;
+    
+    for (size_t pos = 0; pos + MIN_PATTERN <= text.size(); pos++) {
+        PostingList& list = postings[trigramAt(text, pos)];
+        
+        // A trigram repeated within one entry is only recorded once
+        if (list.empty() || list.back() != sequence) {
+            list.push_back(sequence);
+            postingCount++;
+        }
+    }
+}
+
+void HistoryIndex::prune(uint32_t firstLive) {
+    for (auto it = postings.begin(); it != postings.end();) {
+        PostingList& list = it->second;
+        auto live = std::lower_bound(list.begin(), list.end(), firstLive);
+        postingCount -= live - list.begin();
+        list.erase(list.begin(), live);
+        
+        if (list.empty()) {
+            it = postings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HistoryIndex::clear() {
+    postings.clear();
+    postingCount = 0;
+}
+
+const HistoryIndex::PostingList* HistoryIndex::candidates(std::string_view pattern) const {
+    const PostingList* best = nullptr;
+    
+    for (size_t pos = 0; pos + MIN_PATTERN <= pattern.size(); pos++) {
+        auto it = postings.find(trigramAt(pattern, pos));
+        if (it == postings.end()) {
+            return nullptr;
+        }
+        if (!best || it->second.size() < best->size()) {
+            best = &it->second;
+        }
+    }
+    
+    return best;
+}
@@ -0,0 +1,73 @@
+#ifndef HISTORY_INDEX_H
+#define HISTORY_INDEX_H
+
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * HistoryIndex maps every 3-byte substring (trigram) to the history
+ * entries containing it, so substring searches only look at entries that
+ * can possibly match.
+ * Responsibilities:
+ * - Index entries as they are added, by increasing sequence number
+ * - Drop postings for entries that have left the history
+ * - Pick the shortest candidate list for a search pattern
+ *
+ * Posting lists are sorted by sequence number because entries are always
+ * added in order, so newest-first searches walk a list backwards.
+ */
+class HistoryIndex {
+public:
+    typedef std::vector<uint32_t> PostingList;
+    
+    // Patterns shorter than this cannot use the index
+    static constexpr size_t MIN_PATTERN = 3;
+
+private:
+    std::unordered_map<uint32_t, PostingList> postings;
+    size_t postingCount;
+    
+    static uint32_t trigramAt(std::string_view text, size_t pos) {
+        return (static_cast<uint32_t>(static_cast<unsigned char>(text[pos])) << 16) |
+               (static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 1])) << 8) |
+               static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 2]));
+    }
+
+public:
+    HistoryIndex();
+    
+    /**
+     * Index an entry; sequence numbers must increase from call to call
+     * @param sequence The entry's sequence number
+     * @param text The entry's text
+     */
+    void add(uint32_t sequence, std::string_view text);
+    
+    /**
+     * Remove postings for entries older than firstLive
+     * @param firstLive Sequence number of the oldest entry still held
+     */
+    void prune(uint32_t firstLive);
+    
+    /**
+     * Forget everything
+     */
+    void clear();
+    
+    /**
+     * Get the candidate list for a substring search
+     * Every entry containing the pattern is in the returned list; entries in
+     * the list may still need to be checked.
+     * @param pattern The substring to look for (at least 3 bytes)
+     * @return The shortest posting list among the pattern's trigrams, or
+     *         nullptr if some trigram never occurs (nothing can match)
+     */
+    const PostingList* candidates(std::string_view pattern) const;
+    
+    size_t getPostingCount() const { return postingCount; }
+};
+
+#endif // HISTORY_INDEX_H
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "HistoryStore.h"
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+HistoryStore::HistoryStore(size_t maxEntries)
+    : ring(maxEntries > 0 ? maxEntries : 1), capacity(maxEntries > 0 ? maxEntries : 1),
+      head(0), count(0), added(0), indexedUpTo(0), prunedUpTo(0),
+      fileFd(-1), mapping(nullptr), mappingSize(0) {}
+
+HistoryStore::~HistoryStore() {
+    if (mapping) {
+        munmap(const_cast<char*>(mapping), mappingSize);
+    }
+    if (fileFd != -1) {
+        close(fileFd);
+    }
+}
+
+void HistoryStore::push(std::string_view command, bool owned) {
+    size_t position;
+    if (count < capacity) {
+        position = (head + count) % capacity;
+        count++;
+    } else {
+        // Full: overwrite the oldest entry and move the head forward
+        position = head;
+        head = (head + 1) % capacity;
+    }
+    
+    added++;
+    
+    Slot& slot = ring[position];
+    if (owned) {
+        slot.owned.assign(command.data(), command.size());
+        slot.view = slot.owned;
+    } else {
+        slot.view = command;
+    }
+}
+
+bool HistoryStore::open(const std::string& path) {
+    fileFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fileFd == -1) {
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fileFd, &st) != 0 || st.st_size == 0) {
+        return true;
+    }
+    
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fileFd, 0);
+    if (addr == MAP_FAILED) {
+        return true;
+    }
+    mapping = static_cast<const char*>(addr);
+    mappingSize = st.st_size;
+    
+    // Walk back from the end to find the newest `capacity` lines; older
+    // entries are never touched
+    std::vector<std::string_view> newest;
+    newest.reserve(capacity);
+    size_t end = mappingSize;
+    while (end > 0 && newest.size() < capacity) {
+        size_t lineEnd = mapping[end - 1] == '\n' ? end - 1 : end;
+        const void* newline = lineEnd > 0 ? memrchr(mapping, '\n', lineEnd) : nullptr;
+        size_t lineStart = newline ? static_cast<const char*>(newline) - mapping + 1 : 0;
+        
+        if (lineEnd > lineStart) {
+            newest.emplace_back(mapping + lineStart, lineEnd - lineStart);
+        }
+        end = lineStart;
+    }
+    
+    for (auto it = newest.rbegin(); it != newest.rend(); ++it) {
+        push(*it, false);
+    }
+    
+    // Mostly stale lines ahead of what we kept: rewrite the file
+    if (end > mappingSize - end) {
+        compact(path);
+    } else if (mapping[mappingSize - 1] != '\n') {
+        // Terminate a line cut short by a crash so the next entry starts fresh
+        if (write(fileFd, "\n", 1) != 1) {
+            return true;
+        }
+    }
+    
+    return true;
+}
+
+void HistoryStore::compact(const std::string& path) {
+    std::string tmpPath = path + ".tmp";
+    int tmpFd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (tmpFd == -1) {
+        return;
+    }
+    
+    bool ok = true;
+    for (size_t i = 0; ok && i < count; i++) {
+        std::string_view entry = at(i);
+        struct iovec parts[2] = {
+            {const_cast<char*>(entry.data()), entry.size()},
+            {const_cast<char*>("\n"), 1}
+        };
+        ok = writev(tmpFd, parts, 2) == static_cast<ssize_t>(entry.size() + 1);
+    }
+    
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        close(tmpFd);
+        unlink(tmpPath.c_str());
+        return;
+    }
+    
+    // The mapping keeps the old file's data alive, so loaded views stay valid
+    close(tmpFd);
+    close(fileFd);
+    fileFd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+}
+
+void HistoryStore::add(std::string_view command) {
+    if (command.empty() || (count > 0 && at(count - 1) == command)) {
+        return;
+    }
+    
+    push(command, true);
+    
+    if (fileFd != -1) {
+        struct iovec parts[2] = {
+            {const_cast<char*>(command.data()), command.size()},
+            {const_cast<char*>("\n"), 1}
+        };
+        if (writev(fileFd, parts, 2) == -1) {
+            // Stop persisting rather than failing on every command
+            close(fileFd);
+            fileFd = -1;
+        }
+    }
+}
+
+void HistoryStore::clear() {
+    head = 0;
+    count = 0;
+    index.clear();
+    indexedUpTo = prunedUpTo = added;
+}
+
+void HistoryStore::syncIndex() {
+    size_t first = firstSequence();
+    
+    // Entries that were evicted before being indexed never need to be
+    for (size_t seq = std::max(indexedUpTo, first); seq < added; seq++) {
+        index.add(static_cast<uint32_t>(seq), at(seq - first));
+    }
+    indexedUpTo = added;
+    
+    // Dropping evicted postings walks every list, so only do it once a
+    // full history's worth of entries has gone
+    if (first - prunedUpTo >= capacity) {
+        index.prune(static_cast<uint32_t>(first));
+        prunedUpTo = first;
+    }
+}
+
+bool HistoryStore::findPrevious(std::string_view pattern, size_t& position) {
+    size_t before = std::min(position, count);
+    
+    if (pattern.size() < HistoryIndex::MIN_PATTERN) {
+        // Too short for trigrams: scan backwards
+        while (before > 0) {
+            before--;
+            if (at(before).find(pattern) != std::string_view::npos) {
+                position = before;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    syncIndex();
+    const HistoryIndex::PostingList* list = index.candidates(pattern);
+    if (!list) {
+        return false;
+    }
+    
+    // Walk the candidates newest first, starting below the limit
+    size_t first = firstSequence();
+    auto it = std::lower_bound(list->begin(), list->end(), 
+                               static_cast<uint32_t>(first + before));
+    while (it != list->begin()) {
+        --it;
+        if (*it < first) {
+            break;
+        }
+        size_t candidate = *it - first;
+        if (at(candidate).find(pattern) != std::string_view::npos) {
+            position = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void HistoryStore::findAll(std::string_view pattern, std::vector<size_t>& matches) {
+    matches.clear();
+    
+    if (pattern.size() < HistoryIndex::MIN_PATTERN) {
+        for (size_t i = 0; i < count; i++) {
+            if (at(i).find(pattern) != std::string_view::npos) {
+                matches.push_back(i);
+            }
+        }
+        return;
+    }
+    
+    syncIndex();
+    const HistoryIndex::PostingList* list = index.candidates(pattern);
+    if (!list) {
+        return;
+    }
+    
+    size_t first = firstSequence();
+    auto it = std::lower_bound(list->begin(), list->end(), static_cast<uint32_t>(first));
+    for (; it != list->end(); ++it) {
+        size_t candidate = *it - first;
+        if (at(candidate).find(pattern) != std::string_view::npos) {
+            matches.push_back(candidate);
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include "HistoryIndex.h"
+
+/**
+ * HistoryStore keeps the most recent commands in a fixed-size ring buffer
+ * Responsibilities:
+ * - Add commands in O(1) without shifting older entries
+ * - Append every new command to a persistent history file
+ * - Load the tail of that file at startup by mapping it, without
+ *   copying or parsing entries that will never be kept
+ * - Answer substring searches through a trigram index
+ *
+ * Entries loaded from the file are views into the mapping; entries added
+ * during the session own their text, reusing the slot's buffer.
+ */
+class HistoryStore {
+private:
+    struct Slot {
+        std::string_view view;      // Text of the entry
+        std::string owned;          // Storage for entries added this session
+    };
+    
+    std::vector<Slot> ring;
+    size_t capacity;
+    size_t head;            // Index of the oldest entry
+    size_t count;           // Number of entries held
+    size_t added;           // Entries ever added; the newest has sequence added - 1
+    
+    HistoryIndex index;
+    size_t indexedUpTo;     // Sequence number of the first entry not yet indexed
+    size_t prunedUpTo;      // Oldest sequence number the index may still hold
+    
+    int fileFd;             // Append-only history file (-1: not persisted)
+    const char* mapping;    // Mapped history file loaded at startup
+    size_t mappingSize;
+    
+    void push(std::string_view command, bool owned);
+    
+    /**
+     * Bring the index up to date with the entries held
+     * Indexing happens on the first search after new entries arrive, so
+     * adding commands and loading a large file stay cheap.
+     */
+    void syncIndex();
+    
+    size_t firstSequence() const { return added - count; }
+    
+    /**
+     * Rewrite the history file to hold only the loaded entries
+     * Keeps an append-only file from growing without bound across sessions.
+     * @param path The history file
+     */
+    void compact(const std::string& path);
+
+public:
+    /**
+     * @param maxEntries Number of entries kept in memory
+     */
+    explicit HistoryStore(size_t maxEntries);
+    ~HistoryStore();
+    
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+    
+    /**
+     * Load the newest entries of a history file and append to it from now on
+     * @param path The history file (created if missing)
+     * @return true if successful, false if the file could not be opened
+     */
+    bool open(const std::string& path);
+    
+    /**
+     * Add a command, skipping empty lines and immediate repeats
+     * @param command The command line
+     */
+    void add(std::string_view command);
+    
+    /**
+     * Get an entry
+     * @param index 0 for the oldest entry held, size() - 1 for the newest
+     * @return The command text
+     */
+    std::string_view at(size_t index) const {
+        return ring[(head + index) % capacity].view;
+    }
+    
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t getCapacity() const { return capacity; }
+    
+    /**
+     * Forget all entries held in memory (the file is left alone)
+     */
+    void clear();
+    
+    /**
+     * Reverse search: find the newest entry before a position containing pattern
+     * Call again with the returned index to step to older matches.
+     * @param pattern The substring to look for
+     * @param position In: search entries before this index (size() for all);
+     *                 out: index of the match
+     * @return true if a match was found
+     */
+    bool findPrevious(std::string_view pattern, size_t& position);
+    
+    /**
+     * Find every entry containing pattern
+     * @param pattern The substring to look for
+     * @param matches Receives entry indexes, oldest first
+     */
+    void findAll(std::string_view pattern, std::vector<size_t>& matches);
+};
+
+#endif // HISTORY_STORE_H
\ No newline at end of file
@@ -4,16 +4,45 @@
 #include <unistd.h>
 #include <errno.h>
 #include <cstring>
+#include <climits>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 
-IORedirection::IORedirection() {}
+IORedirection::IORedirection() : lastCopyMethod(CopyMethod::None) {}
 
 IORedirection::~IORedirection() {}
 
-bool IORedirection::redirectInput(const std::string& filename) {
-    int fd = open(filename.c_str(), O_RDONLY);
+int IORedirection::openInputFile(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
     if (fd == -1) {
         std::cerr << "MyShell Error: Cannot open input file '" << filename 
                   << "': " << strerror(errno) << "\n";
+    }
+    return fd;
+}
+
+int IORedirection::openOutputFile(const std::string& filename, bool append) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    if (append) {
+        flags |= O_APPEND;
+    } else {
+        flags |= O_TRUNC;
+    }
+    
+    int fd = open(filename.c_str(), flags, 0644);
+    if (fd == -1) {
+        std::cerr << "MyShell Error: Cannot open output file '" << filename 
+                  << "': " << strerror(errno) << "\n";
+    }
+    return fd;
+}
+
+bool IORedirection::redirectInput(const std::string& filename) {
+    int fd = openInputFile(filename);
+    if (fd == -1) {
         return false;
     }
     
@@ -29,17 +58,8 @@ bool IORedirection::redirectInput(const std::string& filename) {
 }
 
 bool IORedirection::redirectOutput(const std::string& filename, bool append) {
-    int flags = O_WRONLY | O_CREAT;
-    if (append) {
-        flags |= O_APPEND;
-    } else {
-        flags |= O_TRUNC;
-    }
-    
-    int fd = open(filename.c_str(), flags, 0644);
+    int fd = openOutputFile(filename, append);
     if (fd == -1) {
-        std::cerr << "MyShell Error: Cannot open output file '" << filename 
-                  << "': " << strerror(errno) << "\n";
         return false;
     }
     
@@ -54,6 +74,68 @@ bool IORedirection::redirectOutput(const std::string& filename, bool append) {
     return true;
 }
 
+namespace {
+    /**
+     * Write a whole block, retrying short and interrupted writes
+     * @return true if successful, false on error (errno is set)
+     */
+    bool writeFully(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+}
+
+int IORedirection::createHereDocument() {
+    int fd = memfd_create("heredoc", MFD_CLOEXEC);
+    if (fd == -1) {
+        std::cerr << "MyShell Error: Cannot create here-document: " 
+                  << strerror(errno) << "\n";
+    }
+    return fd;
+}
+
+int IORedirection::openHereString(std::string_view text) {
+    struct iovec parts[2] = {
+        {const_cast<char*>(text.data()), text.size()},
+        {const_cast<char*>("\n"), 1}
+    };
+    size_t total = text.size() + 1;
+    
+    // A pipe is cheapest when the whole string fits without blocking
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == 0) {
+        int capacity = fcntl(pipefd[1], F_GETPIPE_SZ);
+        if (capacity > 0 && total <= static_cast<size_t>(capacity) && 
+            writev(pipefd[1], parts, 2) == static_cast<ssize_t>(total)) {
+            close(pipefd[1]);
+            return pipefd[0];
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+    
+    int fd = createHereDocument();
+    if (fd == -1) {
+        return -1;
+    }
+    if (!writeFully(fd, text.data(), text.size()) || !writeFully(fd, "\n", 1)) {
+        std::cerr << "MyShell Error: Cannot write here-string: " 
+                  << strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
 bool IORedirection::setupInputRedirection(const std::string& inputFile) {
     if (inputFile.empty()) return true;
     return redirectInput(inputFile);
@@ -82,6 +164,21 @@ bool IORedirection::createPipe(int pipefd[2]) {
     return true;
 }
 
+bool IORedirection::setPipeCapacity(int pipefd[2], size_t bytes) {
+#ifdef F_SETPIPE_SZ
+    if (fcntl(pipefd[1], F_SETPIPE_SZ, static_cast<int>(bytes)) == -1) {
+        std::cerr << "MyShell Error: Cannot resize pipe to " << bytes 
+                  << " bytes: " << strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+#else
+    (void)pipefd;
+    (void)bytes;
+    return false;
+#endif
+}
+
 void IORedirection::setupPipe(int pipefd[2], bool isWriter) {
     if (isWriter) {
         // Writer process: close read end, redirect stdout to write end
@@ -99,4 +196,180 @@ void IORedirection::setupPipe(int pipefd[2], bool isWriter) {
 void IORedirection::closePipe(int pipefd[2]) {
     close(pipefd[0]);
     close(pipefd[1]);
-}
\ No newline at end of file
+}
+
+bool IORedirection::setupStream(int fd, int target) {
+    if (fd == -1 || fd == target) return true;
+    
+    if (dup2(fd, target) == -1) {
+        std::cerr << "MyShell Error: Cannot redirect stream: " 
+                  << strerror(errno) << "\n";
+        return false;
+    }
+    
+    close(fd);
+    return true;
+}
+
+bool IORedirection::addSpawnStream(posix_spawn_file_actions_t* actions, int fd, int target) {
+    if (fd == -1 || fd == target) return true;
+    
+    int err = posix_spawn_file_actions_adddup2(actions, fd, target);
+    if (err == 0) {
+        err = posix_spawn_file_actions_addclose(actions, fd);
+    }
+    
+    if (err != 0) {
+        std::cerr << "MyShell Error: Cannot redirect stream: " 
+                  << strerror(err) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool IORedirection::addSpawnRedirection(posix_spawn_file_actions_t* actions,
+                                        const char* inputFile,
+                                        const char* outputFile, bool append) {
+    int err = 0;
+    
+    if (inputFile) {
+        err = posix_spawn_file_actions_addopen(actions, STDIN_FILENO, 
+                                               inputFile, O_RDONLY, 0);
+    }
+    
+    if (err == 0 && outputFile) {
+        int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+        err = posix_spawn_file_actions_addopen(actions, STDOUT_FILENO, 
+                                               outputFile, flags, 0644);
+    }
+    
+    if (err != 0) {
+        std::cerr << "MyShell Error: Cannot set up redirection: " 
+                  << strerror(err) << "\n";
+        return false;
+    }
+    return true;
+}
+
+namespace {
+    // Largest request per call; the kernel caps each transfer anyway
+    const size_t COPY_CHUNK = 1 << 20;
+    
+    /**
+     * Outcome of one zero-copy strategy
+     * - Done: everything was copied
+     * - Unsupported: the kernel refused this pair of descriptors; any bytes
+     *   already moved advanced the offsets, so the next strategy carries on
+     * - Failed: a real error (errno is set)
+     */
+    enum class CopyResult { Done, Unsupported, Failed };
+    
+    bool unsupported(int err) {
+        return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP ||
+               err == EBADF || err == ESPIPE;
+    }
+    
+    CopyResult copyFileRange(int in, int out) {
+        while (true) {
+            ssize_t n = copy_file_range(in, nullptr, out, nullptr, COPY_CHUNK, 0);
+            if (n == 0) return CopyResult::Done;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return unsupported(errno) ? CopyResult::Unsupported : CopyResult::Failed;
+            }
+        }
+    }
+    
+    CopyResult spliceAll(int in, int out) {
+        while (true) {
+            ssize_t n = splice(in, nullptr, out, nullptr, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n == 0) return CopyResult::Done;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return unsupported(errno) ? CopyResult::Unsupported : CopyResult::Failed;
+            }
+        }
+    }
+    
+    CopyResult sendfileAll(int in, int out) {
+        while (true) {
+            ssize_t n = sendfile(out, in, nullptr, COPY_CHUNK);
+            if (n == 0) return CopyResult::Done;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return unsupported(errno) ? CopyResult::Unsupported : CopyResult::Failed;
+            }
+        }
+    }
+    
+    bool readWriteAll(int in, int out) {
+        static char buffer[128 * 1024];
+        while (true) {
+            ssize_t n = read(in, buffer, sizeof(buffer));
+            if (n == 0) return true;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (!writeFully(out, buffer, n)) {
+                return false;
+            }
+        }
+    }
+}
+
+bool IORedirection::copyData(int inputFd, int outputFd) {
+    struct stat inStat, outStat;
+    if (fstat(inputFd, &inStat) == -1 || fstat(outputFd, &outStat) == -1) {
+        return false;
+    }
+    bool inFile = S_ISREG(inStat.st_mode);
+    bool inPipe = S_ISFIFO(inStat.st_mode);
+    bool outFile = S_ISREG(outStat.st_mode);
+    bool outPipe = S_ISFIFO(outStat.st_mode);
+    
+    // Each strategy is tried only where it can apply; an Unsupported result
+    // (e.g. copy_file_range onto an O_APPEND file) moves on to the next one
+    CopyResult result = CopyResult::Unsupported;
+    
+    if (inFile && outFile) {
+        lastCopyMethod = CopyMethod::CopyFileRange;
+        result = copyFileRange(inputFd, outputFd);
+    }
+    if (result == CopyResult::Unsupported && (inPipe || outPipe)) {
+        lastCopyMethod = CopyMethod::Splice;
+        result = spliceAll(inputFd, outputFd);
+    }
+    if (result == CopyResult::Unsupported && inFile) {
+        lastCopyMethod = CopyMethod::Sendfile;
+        result = sendfileAll(inputFd, outputFd);
+    }
+    if (result == CopyResult::Unsupported) {
+        lastCopyMethod = CopyMethod::ReadWrite;
+        return readWriteAll(inputFd, outputFd);
+    }
+    
+    return result == CopyResult::Done;
+}
+
+bool IORedirection::readAll(int fd, std::string& buffer) {
+    size_t used = buffer.size();
+    buffer.resize(std::max(buffer.capacity(), used + READ_CHUNK));
+    while (true) {
+        if (buffer.size() - used < READ_CHUNK) {
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t n = read(fd, &buffer[used], buffer.size() - used);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            buffer.resize(used);
+            errno = err;
+            return false;
+        }
+        used += n;
+    }
+    buffer.resize(used);
+    return true;
+}
@@ -2,17 +2,33 @@
 #define IO_REDIRECTION_H
 
 #include <string>
+#include <string_view>
+#include <spawn.h>
 
 /**
  * IORedirection handles all file I/O redirection operations
  * Responsibilities:
  * - Handle input redirection (<)
  * - Handle output redirection (>, >>)
+ * - Hold here-documents and here-strings in memory (<<, <<<)
  * - Create and manage pipes for inter-process communication
  * - Manage file descriptors safely
+ * - Express the same redirections as posix_spawn file actions
+ * - Copy between descriptors inside the kernel where the file types allow
  */
+/**
+ * How copyData moved the bytes, for benchmarks and diagnostics
+ */
+enum class CopyMethod { None, CopyFileRange, Splice, Sendfile, ReadWrite };
+
 class IORedirection {
+public:
+    // Smallest read readAll() asks for: a default pipe's whole buffer
+    static const size_t READ_CHUNK = 64 * 1024;
+
 private:
+    CopyMethod lastCopyMethod;
+    
     /**
      * Redirect standard input from a file
      * @param filename The file to redirect from
@@ -32,6 +48,21 @@ public:
     IORedirection();
     ~IORedirection();
     
+    /**
+     * Open a file for input redirection, reporting failures
+     * @param filename The file to read from
+     * @return The descriptor (close-on-exec), or -1 on error
+     */
+    int openInputFile(const std::string& filename);
+    
+    /**
+     * Open a file for output redirection, reporting failures
+     * @param filename The file to write to
+     * @param append Whether to append (true) or overwrite (false)
+     * @return The descriptor (close-on-exec), or -1 on error
+     */
+    int openOutputFile(const std::string& filename, bool append);
+    
     /**
      * Setup input redirection for a command
      * @param inputFile The file to redirect input from
@@ -54,6 +85,14 @@ public:
      */
     bool createPipe(int pipefd[2]);
     
+    /**
+     * Resize a pipe's kernel buffer (Linux F_SETPIPE_SZ)
+     * @param pipefd The pipe file descriptors
+     * @param bytes Requested capacity in bytes
+     * @return true if successful, false if the size was refused or unsupported
+     */
+    bool setPipeCapacity(int pipefd[2], size_t bytes);
+    
     /**
      * Setup pipe for command execution
      * @param pipefd The pipe file descriptors
@@ -66,6 +105,78 @@ public:
      * @param pipefd The pipe file descriptors to close
      */
     void closePipe(int pipefd[2]);
+    
+    /**
+     * Make a descriptor the target standard stream and close the original
+     * @param fd The descriptor to move (ignored if -1 or already the target)
+     * @param target STDIN_FILENO or STDOUT_FILENO
+     * @return true if successful, false if error occurred
+     */
+    bool setupStream(int fd, int target);
+    
+    /**
+     * Add file actions that move a descriptor onto a standard stream
+     * @param actions The spawn file actions being built
+     * @param fd The descriptor to move (ignored if -1 or already the target)
+     * @param target STDIN_FILENO or STDOUT_FILENO
+     * @return true if successful, false if error occurred
+     */
+    bool addSpawnStream(posix_spawn_file_actions_t* actions, int fd, int target);
+    
+    /**
+     * Add file actions for input/output file redirection (<, >, >>)
+     * @param actions The spawn file actions being built
+     * @param inputFile The file to redirect input from (nullptr for none)
+     * @param outputFile The file to redirect output to (nullptr for none)
+     * @param append Whether to append to the output file or overwrite
+     * @return true if successful, false if error occurred
+     */
+    bool addSpawnRedirection(posix_spawn_file_actions_t* actions,
+                             const char* inputFile,
+                             const char* outputFile, bool append);
+    
+    /**
+     * Create an anonymous in-memory file to hold a here-document body
+     * @return The descriptor (close-on-exec), or -1 on error
+     */
+    int createHereDocument();
+    
+    /**
+     * Make a descriptor a command can read a here-string from
+     * Text that fits in a pipe's buffer is written to a pipe; anything larger
+     * goes to an in-memory file, so nothing touches the filesystem.
+     * @param text The string (a newline is added)
+     * @return The read descriptor (close-on-exec), or -1 on error
+     */
+    int openHereString(std::string_view text);
+    
+    /**
+     * Copy everything from one descriptor to another without passing the
+     * data through user space when possible
+     * Tries copy_file_range (file to file), splice (either side a pipe) and
+     * sendfile (file to anything), falling back to read/write. Copying
+     * starts and ends at the descriptors' current offsets.
+     * @param inputFd Descriptor to read until end of file
+     * @param outputFd Descriptor to write to
+     * @return true if successful, false on error (errno is set)
+     */
+    bool copyData(int inputFd, int outputFd);
+    
+    /**
+     * Read a descriptor to end of file, appending to a buffer
+     * Reads go straight into the buffer's spare room, at least READ_CHUNK
+     * bytes at a time, and the buffer doubles when it fills up.
+     * @param fd Descriptor to read (e.g. the read end of a pipe)
+     * @param buffer Receives the data after what it already holds
+     * @return true if successful, false on a read error (errno is set)
+     */
+    bool readAll(int fd, std::string& buffer);
+    
+    /**
+     * Get the method the last copyData call finished with
+     * @return The method that moved the final bytes
+     */
+    CopyMethod getLastCopyMethod() const { return lastCopyMethod; }
 };
 
 #endif // IO_REDIRECTION_H
\ No newline at end of file
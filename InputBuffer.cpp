@@ -0,0 +1,82 @@
+#include "InputBuffer.h"
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+bool InputBuffer::fill() {
+    if (fd == -1) {
+        return false;
+    }
+    
+    // Keep only the unused bytes, at the front
+    if (pos > 0) {
+        buffer.erase(0, pos);
+        pos = 0;
+    }
+    
+    size_t old = buffer.size();
+    buffer.resize(old + CHUNK_SIZE);
+    ssize_t n;
+    do {
+        n = read(fd, &buffer[old], CHUNK_SIZE);
+    } while (n == -1 && errno == EINTR);
+    buffer.resize(old + (n > 0 ? n : 0));
+    return n > 0;
+}
+
+bool InputBuffer::nextRecord(char delimiter, size_t limit, std::string_view& record,
+                             bool& terminated) {
+    size_t scanned = 0;     // Bytes past pos known not to be the delimiter
+    for (;;) {
+        size_t available = buffer.size() - pos;
+        size_t window = available < limit ? available : limit;
+        const char* start = buffer.data() + pos;
+        const void* found = scanned < window
+            ? std::memchr(start + scanned, delimiter, window - scanned)
+            : nullptr;
+        
+        if (found) {
+            size_t length = static_cast<const char*>(found) - start;
+            record = std::string_view(start, length);
+            pos += length + 1;
+            terminated = true;
+            return true;
+        }
+        if (available >= limit) {
+            record = std::string_view(start, limit);
+            pos += limit;
+            terminated = false;
+            return true;
+        }
+        
+        scanned = available;
+        if (!fill()) {
+            // The last record has no delimiter
+            terminated = false;
+            record = std::string_view(buffer.data() + pos, buffer.size() - pos);
+            pos = buffer.size();
+            return !record.empty();
+        }
+    }
+}
+
+bool InputBuffer::nextLine(std::string& line) {
+    std::string_view record;
+    bool terminated;
+    if (!nextRecord('\n', std::string::npos, record, terminated)) {
+        return false;
+    }
+    line.assign(record.data(), record.size());
+    return true;
+}
+
+void InputBuffer::release() {
+    size_t unused = pending();
+    if (unused == 0 || fd == -1) {
+        return;
+    }
+    if (lseek(fd, -static_cast<off_t>(unused), SEEK_CUR) != -1) {
+        buffer.clear();
+        pos = 0;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef INPUT_BUFFER_H
+#define INPUT_BUFFER_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+/**
+ * InputBuffer reads a descriptor in large chunks and hands out records
+ * Responsibilities:
+ * - Split input on a delimiter without a system call per byte or line
+ * - Keep the bytes read past the last record for the next call, so every
+ *   reader of the descriptor in the shell sees the same stream
+ * - Give unused bytes back (by seeking) before another process reads the
+ *   descriptor
+ *
+ * Records are views into the buffer, valid until the next call. The
+ * descriptor is borrowed, never closed.
+ */
+class InputBuffer {
+public:
+    // Bytes requested per read()
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+    int fd;
+    std::string buffer;     // Bytes read; [pos, buffer.size()) are unused
+    size_t pos;
+    
+    /**
+     * Read another chunk, after dropping the bytes already handed out
+     * @return true if any bytes were added
+     */
+    bool fill();
+
+public:
+    explicit InputBuffer(int descriptor = -1) : fd(descriptor), pos(0) {}
+    
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+    
+    /**
+     * Read another descriptor, forgetting unused bytes
+     */
+    void reset(int descriptor) {
+        fd = descriptor;
+        buffer.clear();
+        pos = 0;
+    }
+    
+    int descriptor() const { return fd; }
+    
+    /**
+     * Bytes read and not handed out yet
+     */
+    size_t pending() const { return buffer.size() - pos; }
+    
+    /**
+     * Get the next record
+     * @param delimiter Byte that ends a record (not included in it)
+     * @param limit Longest record; a longer one is split
+     * @param record Receives the record, valid until the next call
+     * @param terminated Receives whether the delimiter was found (false at
+     *                   end of input or when the limit was reached)
+     * @return false at end of input with nothing left
+     */
+    bool nextRecord(char delimiter, size_t limit, std::string_view& record, bool& terminated);
+    
+    /**
+     * Get the next line without its newline, as a copy
+     * @return false at end of input
+     */
+    bool nextLine(std::string& line);
+    
+    /**
+     * Give unused bytes back to a seekable descriptor, so a command that
+     * inherits it continues where the shell stopped; a pipe cannot take
+     * them back, so they stay for the shell's next read
+     */
+    void release();
+};
+
+#endif // INPUT_BUFFER_H
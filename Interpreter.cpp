@@ -0,0 +1,237 @@
+#include "Interpreter.h"
+#include "Shell.h"
+#include "Tracer.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
+
+Interpreter::Interpreter(Shell* shellInstance)
+    : shell(shellInstance), loopCount(0), depth(0), running(0), aborted(false) {}
+
+Interpreter::Loop& Interpreter::pushLoop() {
+    if (loopCount == loops.size()) {
+        loops.emplace_back();
+    }
+    Loop& loop = loops[loopCount++];
+    loop.status = 0;
+    loop.items.clear();
+    loop.next = 0;
+    loop.redirected = false;
+    return loop;
+}
+
+void Interpreter::closeLoops(size_t base) {
+    while (loopCount > base) {
+        if (loops[--loopCount].redirected) {
+            shell->restoreInput();
+        }
+    }
+}
+
+void Interpreter::setStatus(int status) {
+    shell->setLastStatus(status);
+}
+
+int Interpreter::run(const std::shared_ptr<const Program>& program) {
+    return execute(program, 0);
+}
+
+int Interpreter::execute(const std::shared_ptr<const Program>& program, size_t pc) {
+    const std::vector<Instruction>& code = program->code;
+    CommandParser& parser = shell->getParser();
+    size_t loopBase = loopCount;
+    running++;
+    
+    if (commands.size() <= depth) {
+        commands.push_back(std::make_unique<ParsedCommand>());
+    }
+    ParsedCommand& cmd = *commands[depth];
+    
+    // Until something runs, the status is whatever $? was
+    int status = std::atoi(shell->getVariables()["?"].c_str());
+    
+    while (pc < code.size() && !aborted) {
+        const Instruction& instruction = code[pc++];
+        switch (instruction.op) {
+            case Instruction::Run:
+                if (!parser.expand(program->commands[instruction.a], cmd)) {
+                    status = shell->failExpansion();
+                } else if (!cmd.hereDocs.empty() && 
+                           !shell->attachHereDocuments(cmd, *program, instruction.a)) {
+                    status = 1;
+                } else {
+                    status = shell->runCommand(cmd);
+                }
+                // Ctrl+C stops the whole program, not just the command
+                if (status == 128 + SIGINT || !shell->isRunning()) {
+                    aborted = true;
+                }
+                break;
+            case Instruction::Jump:
+                pc = instruction.a;
+                break;
+            case Instruction::JumpIfFalse:
+                if (status != 0) {
+                    pc = instruction.a;
+                }
+                break;
+            case Instruction::JumpIfTrue:
+                if (status == 0) {
+                    pc = instruction.a;
+                }
+                break;
+            case Instruction::Not:
+                status = status == 0 ? 1 : 0;
+                setStatus(status);
+                break;
+            case Instruction::SetStatus:
+                status = static_cast<int>(instruction.a);
+                setStatus(status);
+                break;
+            case Instruction::LoopEnter:
+                pushLoop();
+                break;
+            case Instruction::LoopInput: {
+                Loop& loop = loops[loopCount - 1];
+                if (parser.expand(program->commands[instruction.a], cmd)) {
+                    const ArgList& words = cmd.stages[0].args;
+                    if (words.size() == 1) {
+                        loop.redirected = shell->redirectInput(std::string(words[0]));
+                    } else {
+                        std::cerr << "MyShell: ambiguous redirect\n";
+                    }
+                }
+                if (!loop.redirected) {
+                    // The body never runs; the loop fails
+                    loop.status = 1;
+                    pc = instruction.b;
+                }
+                break;
+            }
+            case Instruction::ForEnter: {
+                Loop& loop = pushLoop();
+                if (instruction.a != Program::NONE) {
+                    const CommandTemplate& words = program->commands[instruction.a];
+                    if (!parser.expandWords(words, 0, words.tokens.size(), loop.items)) {
+                        // Nothing to loop over; the failure is the loop's status
+                        loop.items.clear();
+                        loop.status = 1;
+                        shell->failExpansion();
+                        aborted = !shell->isRunning();
+                    }
+                } else {
+                    // No list: the positional parameters
+                    const std::map<std::string, std::string>& variables = shell->getVariables();
+                    auto count = variables.find("#");
+                    size_t n = count == variables.end() ? 0 : std::strtoul(count->second.c_str(), nullptr, 10);
+                    for (size_t i = 1; i <= n; i++) {
+                        auto it = variables.find(std::to_string(i));
+                        loop.items.push_back(it == variables.end() ? std::string() : it->second);
+                    }
+                }
+                break;
+            }
+            case Instruction::ForNext: {
+                Loop& loop = loops[loopCount - 1];
+                if (loop.next == loop.items.size()) {
+                    pc = instruction.b;
+                } else {
+                    shell->setVariable(program->names[instruction.a], loop.items[loop.next++]);
+                }
+                break;
+            }
+            case Instruction::LoopKeep:
+                loops[loopCount - 1].status = status;
+                break;
+            case Instruction::LoopLeave:
+                closeLoops(loopCount - 1);
+                status = loops[loopCount].status;
+                setStatus(status);
+                break;
+            case Instruction::Unwind:
+                closeLoops(loopCount - instruction.a);
+                break;
+            case Instruction::Define:
+                functions[program->names[instruction.a]] = Function{program, instruction.b};
+                status = 0;
+                setStatus(status);
+                break;
+            case Instruction::Return:
+                if (instruction.a != Program::NONE &&
+                    parser.expand(program->commands[instruction.a], cmd) &&
+                    cmd.stages[0].args.size() > 1) {
+                    std::string_view arg = cmd.stages[0].args[1];
+                    char* end;
+                    long value = std::strtol(arg.data(), &end, 10);
+                    if (arg.empty() || *end != '\0') {
+                        std::cerr << "MyShell: return: " << arg << ": numeric argument required\n";
+                        value = 2;
+                    }
+                    status = static_cast<int>(value & 0xff);
+                }
+                setStatus(status);
+                pc = code.size();
+                break;
+        }
+    }
+    
+    // Loops left by return (or an abort) are closed with the call
+    closeLoops(loopBase);
+    if (--running == 0) {
+        aborted = false;
+    }
+    return status;
+}
+
+int Interpreter::callFunction(const ArgList& args) {
+    auto it = functions.find(args[0]);
+    if (it == functions.end()) {
+        return 127;
+    }
+    if (depth >= MAX_DEPTH) {
+        std::cerr << "MyShell: " << args[0] << ": maximum function nesting level exceeded ("
+                  << MAX_DEPTH << ")\n";
+        aborted = running > 0;
+        return 1;
+    }
+    TraceScope trace("function", args[0]);
+    
+    // Hold on to the definition; the body may redefine the function
+    Function function = it->second;
+    
+    // The arguments replace $1, $2, ... and $# for the call
+    std::map<std::string, std::string>& variables = shell->getVariables();
+    size_t savedCount = std::strtoul(variables["#"].c_str(), nullptr, 10);
+    size_t callCount = args.size() - 1;
+    std::vector<std::string> saved(savedCount);
+    for (size_t i = 1; i <= std::max(savedCount, callCount); i++) {
+        std::string name = std::to_string(i);
+        if (i <= savedCount) {
+            auto found = variables.find(name);
+            if (found != variables.end()) {
+                saved[i - 1] = std::move(found->second);
+            }
+        }
+        if (i <= callCount) {
+            variables[name] = args[i];
+        } else {
+            variables.erase(name);
+        }
+    }
+    variables["#"] = std::to_string(callCount);
+    
+    depth++;
+    int status = execute(function.program, function.entry);
+    depth--;
+    
+    for (size_t i = 1; i <= std::max(savedCount, callCount); i++) {
+        if (i <= savedCount) {
+            variables[std::to_string(i)] = std::move(saved[i - 1]);
+        } else {
+            variables.erase(std::to_string(i));
+        }
+    }
+    variables["#"] = std::to_string(savedCount);
+    return status;
+}
@@ -0,0 +1,108 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include "ScriptCompiler.h"
+
+class Shell;
+
+/**
+ * Interpreter runs compiled programs inside the shell process
+ * Responsibilities:
+ * - Execute bytecode: jumps on the last status, loop frames with their
+ *   word lists and input files, and function definitions
+ * - Expand each command's template into a reused ParsedCommand and hand it
+ *   to the shell, as if the command had been typed
+ * - Call shell functions with their own positional parameters
+ *
+ * Loop frames and parsed commands are kept between runs, so a loop that
+ * only runs builtins settles into not allocating at all.
+ */
+class Interpreter {
+public:
+    // Deepest function call nesting before the call fails
+    static const size_t MAX_DEPTH = 1000;
+
+private:
+    /**
+     * A defined function: where its body is, in the program that defined it
+     */
+    struct Function {
+        std::shared_ptr<const Program> program;
+        uint32_t entry;
+    };
+    
+    /**
+     * State of a loop being run
+     */
+    struct Loop {
+        int status;                         // Status of the last body run
+        std::vector<std::string> items;     // for: words still to assign
+        size_t next;                        // for: index of the next word
+        bool redirected;                    // stdin comes from the loop's `< file`
+    };
+    
+    Shell* shell;
+    std::map<std::string, Function, std::less<>> functions;
+    std::vector<Loop> loops;                // Open loops are [0, loopCount)
+    size_t loopCount;
+    std::vector<std::unique_ptr<ParsedCommand>> commands;   // One per call depth
+    size_t depth;                           // Function calls in progress
+    size_t running;                         // Nested execute() calls
+    bool aborted;                           // Unwind every running program (interrupt)
+    
+    /**
+     * Run bytecode until the end of the program or a Return
+     * @param program The program
+     * @param pc Index of the first instruction
+     * @return Exit status of the last command run
+     */
+    int execute(const std::shared_ptr<const Program>& program, size_t pc);
+    
+    /**
+     * Open a loop frame, reusing a previous frame's storage
+     */
+    Loop& pushLoop();
+    
+    /**
+     * Close the innermost loop frames, giving back stdin taken by `< file`
+     * @param base Number of frames to keep open
+     */
+    void closeLoops(size_t base);
+    
+    /**
+     * Set $? for statuses that do not come from running a command
+     */
+    void setStatus(int status);
+
+public:
+    explicit Interpreter(Shell* shellInstance);
+    
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+    
+    /**
+     * Run a compiled command line
+     * @param program The program; functions it defines keep it alive
+     * @return Exit status of the last command run
+     */
+    int run(const std::shared_ptr<const Program>& program);
+    
+    bool hasFunction(std::string_view name) const {
+        return !functions.empty() && functions.find(name) != functions.end();
+    }
+    
+    /**
+     * Call a shell function
+     * @param args Function name and arguments, which become $1, $2, ...
+     * @return The function's exit status
+     */
+    int callFunction(const ArgList& args);
+};
+
+#endif // INTERPRETER_H
@@ -0,0 +1,191 @@
+#include "JobTable.h"
+#include "Tracer.h"
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace {
+    // Self-pipe written by the SIGCHLD handler: [0] read end, [1] write end
+    int childPipe[2] = {-1, -1};
+    
+    void onChildSignal(int) {
+        int savedErrno = errno;
+        // A full pipe already means "something to reap", so a failed write is fine
+        ssize_t ignored = write(childPipe[1], "", 1);
+        (void)ignored;
+        errno = savedErrno;
+    }
+    
+    void installChildHandler() {
+        if (childPipe[0] != -1) {
+            return;
+        }
+        if (pipe2(childPipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+            return;
+        }
+        
+        // SA_RESTART keeps blocking reads and foreground waits from failing
+        // with EINTR whenever a background job exits
+        struct sigaction action;
+        action.sa_handler = onChildSignal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigaction(SIGCHLD, &action, nullptr);
+    }
+    
+    /**
+     * Drain the self-pipe
+     * @return true if SIGCHLD arrived since the last call
+     */
+    bool childSignalled() {
+        char buffer[64];
+        bool signalled = false;
+        while (read(childPipe[0], buffer, sizeof(buffer)) > 0) {
+            signalled = true;
+        }
+        return signalled;
+    }
+}
+
+JobTable::JobTable() : liveJobs(0) {
+    installChildHandler();
+}
+
+int JobTable::add(const std::vector<pid_t>& pids, const std::string& command) {
+    slots.emplace_back();
+    Job& job = slots.back();
+    job.id = static_cast<int>(slots.size());
+    job.pids = pids;
+    job.running = pids.size();
+    job.command = command;
+    
+    for (pid_t pid : pids) {
+        pidJobs[pid] = job.id;
+    }
+    liveJobs++;
+    
+    // A job whose processes all failed to start is finished already
+    if (job.done()) {
+        finished.push_back(job.id);
+    }
+    return job.id;
+}
+
+bool JobTable::recordExit(pid_t pid, int status) {
+    auto it = pidJobs.find(pid);
+    if (it == pidJobs.end()) {
+        // Not a job process (e.g. already waited for by fg)
+        return false;
+    }
+    
+    Job& job = slots[it->second - 1];
+    pidJobs.erase(it);
+    
+    if (pid == job.pids.back()) {
+        job.status = status;
+    }
+    if (--job.running == 0) {
+        finished.push_back(job.id);
+    }
+    return true;
+}
+
+void JobTable::recordStray(pid_t pid, int status, const struct rusage& usage) {
+    strays[pid] = Stray{status, usage};
+}
+
+bool JobTable::takeStray(pid_t pid, int& status, struct rusage& usage) {
+    if (strays.empty()) {
+        return false;
+    }
+    auto it = strays.find(pid);
+    if (it == strays.end()) {
+        return false;
+    }
+    status = it->second.status;
+    usage = it->second.usage;
+    strays.erase(it);
+    return true;
+}
+
+bool JobTable::reap() {
+    // Also reap if the pipe could not be created, so children never pile up
+    if (childPipe[0] != -1 && !childSignalled()) {
+        return false;
+    }
+    
+    size_t finishedBefore = finished.size();
+    int status;
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+        Tracer::record(Tracer::End, "process", std::string_view(), pid);
+        // A builtin in a pipeline (e.g. jobs) reaps while the other stages
+        // are still being waited for; keep their statuses for the waiter
+        if (!recordExit(pid, status)) {
+            recordStray(pid, status, usage);
+        }
+    }
+    return finished.size() > finishedBefore;
+}
+
+void JobTable::remove(int id) {
+    Job* job = find(id);
+    if (!job) {
+        return;
+    }
+    
+    for (pid_t pid : job->pids) {
+        auto it = pidJobs.find(pid);
+        if (it != pidJobs.end() && it->second == id) {
+            pidJobs.erase(it);
+        }
+    }
+    *job = Job();
+    liveJobs--;
+    
+    // The id may be reused, so it must not be reported as finished later
+    auto pending = std::find(finished.begin(), finished.end(), id);
+    if (pending != finished.end()) {
+        finished.erase(pending);
+    }
+    
+    // Free trailing slots so the next job takes the lowest id above the rest
+    while (!slots.empty() && slots.back().id == 0) {
+        slots.pop_back();
+    }
+}
+
+JobTable::Job* JobTable::find(int id) {
+    if (id < 1 || id > static_cast<int>(slots.size()) || slots[id - 1].id == 0) {
+        return nullptr;
+    }
+    return &slots[id - 1];
+}
+
+JobTable::Job* JobTable::findByPid(pid_t pid) {
+    auto it = pidJobs.find(pid);
+    return it == pidJobs.end() ? nullptr : &slots[it->second - 1];
+}
+
+void JobTable::takeFinished(std::vector<int>& ids) {
+    ids.clear();
+    ids.swap(finished);
+}
+
+std::string JobTable::statusText(const Job& job) {
+    if (!job.done()) {
+        return "Running";
+    }
+    if (WIFSIGNALED(job.status)) {
+        return strsignal(WTERMSIG(job.status));
+    }
+    if (WIFEXITED(job.status) && WEXITSTATUS(job.status) != 0) {
+        return "Exit " + std::to_string(WEXITSTATUS(job.status));
+    }
+    return "Done";
+}
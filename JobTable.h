@@ -0,0 +1,153 @@
+#ifndef JOB_TABLE_H
+#define JOB_TABLE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/**
+ * JobTable tracks background jobs and reaps them when SIGCHLD arrives
+ * Responsibilities:
+ * - Number jobs and look them up by job id or pid in O(1)
+ * - Reap every finished child exactly once with waitpid(-1), and only
+ *   after SIGCHLD says there is something to reap
+ * - Remember exit statuses until the shell has reported them
+ *
+ * The SIGCHLD handler only writes a byte to a self-pipe; all waiting
+ * happens in reap(), so a prompt with no child activity costs one
+ * non-blocking read regardless of how many jobs are running.
+ * Foreground commands are normally waited for by pid before reap() runs
+ * again; one collected here anyway (by a builtin that reaps while its
+ * pipeline is running) is kept with recordStray() for its waiter.
+ */
+class JobTable {
+public:
+    struct Job {
+        int id;                         // Job number shown to the user (0: free slot)
+        std::vector<pid_t> pids;        // Every process in the job, first stage first
+        size_t running;                 // Processes not yet reaped
+        int status;                     // Wait status of the last stage once reaped
+        std::string command;            // Command text for messages
+        
+        Job() : id(0), running(0), status(0) {}
+        bool done() const { return running == 0; }
+    };
+
+private:
+    std::vector<Job> slots;                     // Job id n lives at slots[n - 1]
+    std::unordered_map<pid_t, int> pidJobs;     // Running pid -> job id
+    std::vector<int> finished;                  // Jobs completed since the last report
+    
+    struct Stray {
+        int status;
+        struct rusage usage;
+    };
+    std::unordered_map<pid_t, Stray> strays;    // Reaped by someone other than their waiter
+    size_t liveJobs;
+    
+
+public:
+    /**
+     * Install the SIGCHLD handler (once per process)
+     */
+    JobTable();
+    
+    JobTable(const JobTable&) = delete;
+    JobTable& operator=(const JobTable&) = delete;
+    
+    /**
+     * Add a background job
+     * @param pids The job's processes, first stage first
+     * @param command Command text for messages
+     * @return The new job id
+     */
+    int add(const std::vector<pid_t>& pids, const std::string& command);
+    
+    /**
+     * Reap every child that has exited since the last call
+     * Returns immediately when no SIGCHLD has arrived. Children that are
+     * not jobs are kept for takeStray().
+     * @return true if any job finished
+     */
+    bool reap();
+    
+    /**
+     * Record the wait status of a child reaped elsewhere
+     * Anything that waits with waitpid(-1) must pass on children it does
+     * not own, or their jobs would never finish.
+     * @param pid The child
+     * @param status Its wait status
+     * @return true if the pid belonged to a job
+     */
+    bool recordExit(pid_t pid, int status);
+    
+    /**
+     * Keep the status of a non-job child that was reaped by a waitpid(-1)
+     * meant for other children, so whoever waits for it can still have it
+     * @param pid The child
+     * @param status Its wait status
+     * @param usage Its resource usage
+     */
+    void recordStray(pid_t pid, int status, const struct rusage& usage);
+    
+    /**
+     * Claim a child's status recorded by recordStray
+     * @param pid The child
+     * @param status Receives its wait status
+     * @param usage Receives its resource usage
+     * @return true if the child had already been reaped
+     */
+    bool takeStray(pid_t pid, int& status, struct rusage& usage);
+    
+    /**
+     * Forget a job (its processes must already have been reaped or waited for)
+     * @param id The job id
+     */
+    void remove(int id);
+    
+    /**
+     * Look up a job
+     * @param id The job id
+     * @return The job, or nullptr if there is none with that id
+     */
+    Job* find(int id);
+    
+    /**
+     * Look up the job a running process belongs to
+     * @param pid The process
+     * @return The job, or nullptr if the pid is not a running job process
+     */
+    Job* findByPid(pid_t pid);
+    
+    /**
+     * Get the most recently started job
+     * @return The job, or nullptr if there are no jobs
+     */
+    Job* newest() { return slots.empty() ? nullptr : &slots.back(); }
+    
+    /**
+     * Jobs completed since the last call, oldest first
+     * The caller reports them and removes them from the table.
+     * @param ids Receives the finished job ids
+     */
+    void takeFinished(std::vector<int>& ids);
+    
+    /**
+     * Describe a job's state the way `jobs` shows it
+     * @param job The job
+     * @return "Running", "Done", "Exit N" or the terminating signal's name
+     */
+    static std::string statusText(const Job& job);
+    
+    size_t size() const { return liveJobs; }
+    bool empty() const { return liveJobs == 0; }
+    
+    /**
+     * Highest job id in use; ids 1..getHighestId() may include free slots
+     */
+    int getHighestId() const { return static_cast<int>(slots.size()); }
+};
+
+#endif // JOB_TABLE_H
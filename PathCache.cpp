@@ -0,0 +1,103 @@
+#include "PathCache.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+
+PathCache::PathCache() {}
+
+std::string PathCache::search(const std::string& command, bool& cacheable) const {
+    cacheable = true;
+
+    const char* pathEnv = getenv("PATH");
+    std::string pathList = pathEnv ? pathEnv : "/usr/local/bin:/usr/bin:/bin";
+
+    size_t start = 0;
+    while (start <= pathList.length()) {
+        size_t end = pathList.find(':', start);
+        if (end == std::string::npos) {
+            end = pathList.length();
+        }
+
+        // An empty PATH entry means the current directory
+        std::string dir = pathList.substr(start, end - start);
+        if (dir.empty()) {
+            dir = ".";
+        }
+
+        std::string candidate = dir + "/" + command;
+        struct stat st;
+        if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+            access(candidate.c_str(), X_OK) == 0) {
+            cacheable = dir[0] == '/';
+            return candidate;
+        }
+
+        start = end + 1;
+    }
+
+    return "";
+}
+
+const char* PathCache::resolve(const char* command) {
+    if (command[0] == '\0' || std::strchr(command, '/') != nullptr) {
+        return command;
+    }
+
+    // Assigning into a reused buffer keeps lookups allocation-free
+    lookupKey.assign(command);
+    auto it = entries.find(lookupKey);
+    if (it != entries.end()) {
+        it->second.hits++;
+        return it->second.path.c_str();
+    }
+
+    bool cacheable;
+    std::string path = search(lookupKey, cacheable);
+    if (path.empty()) {
+        return nullptr;
+    }
+    if (!cacheable) {
+        uncachedPath = path;
+        return uncachedPath.c_str();
+    }
+
+    Entry& entry = entries[lookupKey];
+    entry = Entry{path, 1};
+    return entry.path.c_str();
+}
+
+bool PathCache::add(const std::string& command) {
+    if (command.find('/') != std::string::npos) {
+        return false;
+    }
+
+    bool cacheable;
+    std::string path = search(command, cacheable);
+    if (path.empty()) {
+        return false;
+    }
+
+    if (cacheable) {
+        entries[command] = Entry{path, 0};
+    }
+    return true;
+}
+
+bool PathCache::remove(const std::string& command) {
+    return entries.erase(command) > 0;
+}
+
+void PathCache::clear() {
+    entries.clear();
+}
+
+std::vector<std::pair<std::string, PathCache::Entry>> PathCache::getEntries() const {
+    std::vector<std::pair<std::string, Entry>> sorted(entries.begin(), entries.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const std::pair<std::string, Entry>& a, const std::pair<std::string, Entry>& b) {
+                  return a.first < b.first;
+              });
+    return sorted;
+}
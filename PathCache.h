@@ -0,0 +1,76 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * PathCache remembers where external commands live on $PATH
+ * Responsibilities:
+ * - Resolve a command name to an absolute path once, in the shell process
+ * - Count how often each remembered path is reused (like bash's `hash`)
+ * - Forget everything when PATH changes
+ *
+ * Names containing a '/' are never cached, and neither are matches found
+ * through a relative PATH entry, since those depend on the current directory.
+ */
+class PathCache {
+public:
+    struct Entry {
+        std::string path;       // Absolute path of the executable
+        unsigned long hits;     // Number of times the entry was used
+    };
+
+private:
+    std::unordered_map<std::string, Entry> entries;
+    std::string lookupKey;      // Reused key buffer for lookups
+    std::string uncachedPath;   // Storage for a match that may not be cached
+
+    /**
+     * Walk $PATH looking for an executable regular file
+     * @param command The command name (no '/')
+     * @param cacheable Set to false if the match came from a relative PATH entry
+     * @return Path of the executable, or empty string if not found
+     */
+    std::string search(const std::string& command, bool& cacheable) const;
+
+public:
+    PathCache();
+
+    /**
+     * Resolve a command to the path that should be exec'd
+     * Cached entries are returned directly and have their hit count bumped.
+     * The result stays valid until the next call or until the cache changes.
+     * @param command The command name as typed
+     * @return Path to exec, or nullptr if the command was not found
+     */
+    const char* resolve(const char* command);
+
+    /**
+     * Look up a command and remember it without counting a hit
+     * @param command The command name
+     * @return true if the command was found on PATH
+     */
+    bool add(const std::string& command);
+
+    /**
+     * Forget a single command
+     * @param command The command name
+     * @return true if the command was cached
+     */
+    bool remove(const std::string& command);
+
+    /**
+     * Forget all remembered locations (called when PATH changes)
+     */
+    void clear();
+
+    /**
+     * Get the cached entries sorted by command name
+     * @return vector of (command, entry) pairs
+     */
+    std::vector<std::pair<std::string, Entry>> getEntries() const;
+};
+
+#endif // PATH_CACHE_H
@@ -0,0 +1,686 @@
+#include "ScriptCompiler.h"
+#include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace {
+    // Reserved words, as bits so a parse can stop at any of several
+    namespace Word {
+        enum : unsigned {
+            If = 1 << 0,
+            Then = 1 << 1,
+            Elif = 1 << 2,
+            Else = 1 << 3,
+            Fi = 1 << 4,
+            While = 1 << 5,
+            Until = 1 << 6,
+            For = 1 << 7,
+            In = 1 << 8,
+            Do = 1 << 9,
+            Done = 1 << 10,
+            Function = 1 << 11,
+            LeftBrace = 1 << 12,
+            RightBrace = 1 << 13,
+            Bang = 1 << 14,
+            
+            // Words that start a compound command
+            Compound = If | While | Until | For | LeftBrace
+        };
+    }
+    
+    const struct {
+        const char* text;
+        unsigned word;
+    } keywords[] = {
+        {"if", Word::If}, {"then", Word::Then}, {"elif", Word::Elif}, {"else", Word::Else},
+        {"fi", Word::Fi}, {"while", Word::While}, {"until", Word::Until}, {"for", Word::For},
+        {"in", Word::In}, {"do", Word::Do}, {"done", Word::Done}, {"function", Word::Function},
+        {"{", Word::LeftBrace}, {"}", Word::RightBrace}, {"!", Word::Bang}
+    };
+    
+    bool isName(std::string_view text) {
+        if (text.empty() || std::isdigit(static_cast<unsigned char>(text[0]))) {
+            return false;
+        }
+        return std::all_of(text.begin(), text.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        });
+    }
+    
+    bool isHereDoc(TokenType type) {
+        return type == TokenType::HereDoc || type == TokenType::HereDocStrip;
+    }
+    
+    bool isRedirection(TokenType type) {
+        return type == TokenType::Input || type == TokenType::Output ||
+               type == TokenType::Append || type == TokenType::HereString ||
+               type == TokenType::HereDoc || type == TokenType::HereDocStrip;
+    }
+}
+
+ScriptCompiler::ScriptCompiler()
+    : source(nullptr), pos(0), status(Status::Ok), program(nullptr), inFunction(false) {}
+
+ScriptCompiler::Status ScriptCompiler::compile(const CommandTemplate& tpl, Program& out) {
+    source = &tpl;
+    pos = 0;
+    status = Status::Ok;
+    program = &out;
+    out.code.clear();
+    out.commands.clear();
+    out.names.clear();
+    out.hereStart.clear();
+    loops.clear();
+    inFunction = false;
+    
+    NodePtr tree = parseList(0);
+    if (tree) {
+        emit(*tree);
+    }
+    return status;
+}
+
+unsigned ScriptCompiler::keyword(size_t i) const {
+    if (i >= source->tokens.size()) {
+        return 0;
+    }
+    std::string_view text = source->literal(i);
+    for (const auto& entry : keywords) {
+        if (text == entry.text) {
+            return entry.word;
+        }
+    }
+    return 0;
+}
+
+bool ScriptCompiler::expect(unsigned word) {
+    if (atEnd()) {
+        status = Status::Incomplete;
+        return false;
+    }
+    if (keyword(pos) != word) {
+        unexpected();
+        return false;
+    }
+    pos++;
+    return true;
+}
+
+void ScriptCompiler::skipNewlines() {
+    while (!atEnd() && peek() == TokenType::Newline) {
+        pos++;
+    }
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::unexpected() {
+    if (atEnd()) {
+        status = Status::Incomplete;
+        return nullptr;
+    }
+    
+    std::string_view text = source->literal(pos);
+    std::cerr << "MyShell: syntax error near unexpected token '"
+              << (text.empty() ? std::string_view(CommandParser::operatorText(peek())) : text)
+              << "'\n";
+    status = Status::Error;
+    return nullptr;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::fail(const std::string& message) {
+    std::cerr << "MyShell: syntax error: " << message << "\n";
+    status = Status::Error;
+    return nullptr;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseList(unsigned stops) {
+    NodePtr list = std::make_unique<Node>(Node::List);
+    
+    while (true) {
+        skipNewlines();
+        if (atEnd()) {
+            // Inside a compound command the closing word is still to come
+            if (stops != 0) {
+                status = Status::Incomplete;
+                return nullptr;
+            }
+            return list;
+        }
+        if (keyword(pos) & stops) {
+            // `if then`, `while do`, `{ }`: the list may not be empty
+            return list->children.empty() ? unexpected() : std::move(list);
+        }
+        
+        NodePtr item = parseAndOr();
+        if (!item) {
+            return nullptr;
+        }
+        list->children.push_back(std::move(item));
+        
+        // A command ends at ; or a line break, or at & (already consumed)
+        if (atEnd() || source->tokens[pos - 1].type == TokenType::Background) {
+            continue;
+        }
+        if (peek() != TokenType::Semicolon && peek() != TokenType::Newline) {
+            return unexpected();
+        }
+        pos++;
+    }
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseAndOr() {
+    NodePtr left = parsePipeline();
+    
+    while (left && !atEnd() && (peek() == TokenType::AndIf || peek() == TokenType::OrIf)) {
+        if (source->tokens[pos - 1].type == TokenType::Background) {
+            return unexpected();
+        }
+        NodePtr node = std::make_unique<Node>(peek() == TokenType::AndIf ? Node::AndIf : Node::OrIf);
+        pos++;
+        
+        // The right-hand side may be on the next line
+        skipNewlines();
+        NodePtr right = parsePipeline();
+        if (!right) {
+            return nullptr;
+        }
+        node->children.push_back(std::move(left));
+        node->children.push_back(std::move(right));
+        left = std::move(node);
+    }
+    
+    if (left && left->kind != Node::Command &&
+        source->tokens[pos - 1].type == TokenType::Background) {
+        return fail("'&' after a && or || list is not supported");
+    }
+    return left;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parsePipeline() {
+    if (keyword(pos) != Word::Bang) {
+        return parseCommand();
+    }
+    
+    pos++;
+    NodePtr child = parsePipeline();
+    if (!child) {
+        return nullptr;
+    }
+    NodePtr node = std::make_unique<Node>(Node::Not);
+    node->children.push_back(std::move(child));
+    return node;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseCommand() {
+    if (atEnd()) {
+        status = Status::Incomplete;
+        return nullptr;
+    }
+    
+    NodePtr node;
+    switch (keyword(pos)) {
+        case Word::If:
+            node = parseIf();
+            break;
+        case Word::While:
+            node = parseLoop(Node::While);
+            break;
+        case Word::Until:
+            node = parseLoop(Node::Until);
+            break;
+        case Word::For:
+            node = parseFor();
+            break;
+        case Word::LeftBrace:
+            node = parseGroup();
+            break;
+        case Word::Function:
+            pos++;
+            if (atEnd()) {
+                status = Status::Incomplete;
+                return nullptr;
+            }
+            node = parseFunction(pos, true);
+            break;
+        case 0:
+            if (peek() == TokenType::OpenParen) {
+                return fail("subshells ( ... ) are not supported");
+            }
+            if (peek() == TokenType::Word && pos + 1 < source->tokens.size() &&
+                source->tokens[pos + 1].type == TokenType::OpenParen) {
+                node = parseFunction(pos, false);
+                break;
+            }
+            return parseSimple();
+        default:
+            return unexpected();
+    }
+    if (!node) {
+        return nullptr;
+    }
+    
+    // A loop may read its input from a file: while read l; do ...; done < file
+    bool loop = node->kind == Node::While || node->kind == Node::Until || node->kind == Node::For;
+    if (loop && !atEnd() && peek() == TokenType::Input) {
+        pos++;
+        if (atEnd() || peek() != TokenType::Word) {
+            return unexpected();
+        }
+        node->input = pos++;
+    }
+    
+    // Compound commands only run in the shell, as a whole
+    if (!atEnd()) {
+        if (peek() == TokenType::Pipe) {
+            return fail("compound commands cannot be used in pipelines");
+        }
+        if (peek() == TokenType::Background) {
+            return fail("compound commands cannot run in the background");
+        }
+        if (isRedirection(peek())) {
+            return fail("redirections on compound commands are not supported "
+                        "(loops take `< file`)");
+        }
+    }
+    return node;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseSimple() {
+    NodePtr node = std::make_unique<Node>(Node::Command);
+    node->first = pos;
+    
+    while (!atEnd()) {
+        TokenType type = peek();
+        if (type == TokenType::Word || isRedirection(type)) {
+            pos++;
+        } else if (type == TokenType::Pipe && pos > node->first) {
+            // The next stage may be on the next line
+            pos++;
+            skipNewlines();
+            if (atEnd()) {
+                status = Status::Incomplete;
+                return nullptr;
+            }
+            if (keyword(pos) & (Word::Compound | Word::Function)) {
+                return fail("compound commands cannot be used in pipelines");
+            }
+            if (peek() != TokenType::Word && !isRedirection(peek())) {
+                return unexpected();
+            }
+        } else if (type == TokenType::Background && pos > node->first) {
+            pos++;
+            node->background = true;
+            break;
+        } else {
+            break;
+        }
+    }
+    
+    node->last = pos;
+    if (node->last == node->first) {
+        return unexpected();
+    }
+    return node;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseIf() {
+    // Also parses `elif ...`, which ends at the same `fi`
+    pos++;
+    NodePtr node = std::make_unique<Node>(Node::If);
+    
+    NodePtr condition = parseList(Word::Then);
+    if (!condition || !expect(Word::Then)) {
+        return nullptr;
+    }
+    NodePtr body = parseList(Word::Elif | Word::Else | Word::Fi);
+    if (!body) {
+        return nullptr;
+    }
+    node->children.push_back(std::move(condition));
+    node->children.push_back(std::move(body));
+    
+    unsigned word = keyword(pos);
+    if (word == Word::Elif) {
+        NodePtr rest = parseIf();
+        if (!rest) {
+            return nullptr;
+        }
+        node->children.push_back(std::move(rest));
+    } else if (word == Word::Else) {
+        pos++;
+        NodePtr rest = parseList(Word::Fi);
+        if (!rest || !expect(Word::Fi)) {
+            return nullptr;
+        }
+        node->children.push_back(std::move(rest));
+    } else {
+        pos++;
+    }
+    return node;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseLoop(Node::Kind kind) {
+    pos++;
+    NodePtr node = std::make_unique<Node>(kind);
+    
+    NodePtr condition = parseList(Word::Do);
+    if (!condition || !expect(Word::Do)) {
+        return nullptr;
+    }
+    NodePtr body = parseList(Word::Done);
+    if (!body || !expect(Word::Done)) {
+        return nullptr;
+    }
+    node->children.push_back(std::move(condition));
+    node->children.push_back(std::move(body));
+    return node;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseFor() {
+    pos++;
+    NodePtr node = std::make_unique<Node>(Node::For);
+    
+    if (atEnd()) {
+        status = Status::Incomplete;
+        return nullptr;
+    }
+    if (!isName(source->literal(pos))) {
+        return fail("'for' needs a variable name");
+    }
+    node->name = pos++;
+    
+    // `for NAME in WORDS;` or `for NAME;` (the positional parameters)
+    skipNewlines();
+    if (atEnd()) {
+        status = Status::Incomplete;
+        return nullptr;
+    }
+    if (keyword(pos) == Word::In) {
+        pos++;
+        node->hasWords = true;
+        node->first = pos;
+        while (!atEnd() && peek() == TokenType::Word) {
+            pos++;
+        }
+        node->last = pos;
+        if (atEnd()) {
+            status = Status::Incomplete;
+            return nullptr;
+        }
+        if (peek() != TokenType::Semicolon && peek() != TokenType::Newline) {
+            return unexpected();
+        }
+        pos++;
+    } else if (peek() == TokenType::Semicolon) {
+        pos++;
+    }
+    
+    skipNewlines();
+    if (!expect(Word::Do)) {
+        return nullptr;
+    }
+    NodePtr body = parseList(Word::Done);
+    if (!body || !expect(Word::Done)) {
+        return nullptr;
+    }
+    node->children.push_back(std::move(body));
+    return node;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseGroup() {
+    pos++;
+    NodePtr body = parseList(Word::RightBrace);
+    if (!body || !expect(Word::RightBrace)) {
+        return nullptr;
+    }
+    return body;
+}
+
+ScriptCompiler::NodePtr ScriptCompiler::parseFunction(size_t name, bool keyword) {
+    std::string_view text = source->literal(name);
+    if (text.empty() || CommandParser::isReservedWord(text) ||
+        text.find_first_of("=/$") != std::string_view::npos) {
+        return fail("invalid function name");
+    }
+    pos = name + 1;
+    
+    // NAME () BODY, or function NAME [()] BODY
+    if (!atEnd() && peek() == TokenType::OpenParen) {
+        pos++;
+        if (atEnd()) {
+            status = Status::Incomplete;
+            return nullptr;
+        }
+        if (peek() != TokenType::CloseParen) {
+            return unexpected();
+        }
+        pos++;
+    } else if (!keyword) {
+        return unexpected();
+    }
+    
+    skipNewlines();
+    if (atEnd()) {
+        status = Status::Incomplete;
+        return nullptr;
+    }
+    if (!(this->keyword(pos) & Word::Compound)) {
+        return fail("a function body must be a compound command such as { ...; }");
+    }
+    
+    NodePtr body = parseCommand();
+    if (!body) {
+        return nullptr;
+    }
+    NodePtr node = std::make_unique<Node>(Node::Function);
+    node->name = name;
+    node->children.push_back(std::move(body));
+    return node;
+}
+
+size_t ScriptCompiler::append(Instruction::Op op, uint32_t a, uint32_t b) {
+    program->code.push_back(Instruction{op, a, b});
+    return program->code.size() - 1;
+}
+
+uint32_t ScriptCompiler::addCommand(size_t first, size_t last) {
+    program->commands.emplace_back();
+    CommandTemplate& command = program->commands.back();
+    bool hasHereDoc = false;
+    for (size_t i = first; i < last; i++) {
+        // Line breaks after a pipe are only layout
+        if (source->tokens[i].type != TokenType::Newline) {
+            command.append(*source, i, i + 1);
+        }
+        hasHereDoc |= isHereDoc(source->tokens[i].type);
+    }
+    
+    // Bodies are numbered by where their << appears in the source
+    uint32_t hereStart = 0;
+    for (size_t i = 0; hasHereDoc && i < first; i++) {
+        hereStart += isHereDoc(source->tokens[i].type);
+    }
+    program->hereStart.push_back(hereStart);
+    return static_cast<uint32_t>(program->commands.size() - 1);
+}
+
+uint32_t ScriptCompiler::addName(std::string_view name) {
+    program->names.emplace_back(name);
+    return static_cast<uint32_t>(program->names.size() - 1);
+}
+
+void ScriptCompiler::emit(const Node& node) {
+    switch (node.kind) {
+        case Node::Command:
+            emitCommand(node);
+            break;
+        case Node::List:
+            for (const NodePtr& child : node.children) {
+                emit(*child);
+            }
+            break;
+        case Node::AndIf:
+        case Node::OrIf: {
+            emit(*node.children[0]);
+            size_t skip = append(node.kind == Node::AndIf ? Instruction::JumpIfFalse
+                                                          : Instruction::JumpIfTrue);
+            emit(*node.children[1]);
+            patch(skip, here());
+            break;
+        }
+        case Node::Not:
+            emit(*node.children[0]);
+            append(Instruction::Not);
+            break;
+        case Node::If: {
+            emit(*node.children[0]);
+            size_t toElse = append(Instruction::JumpIfFalse);
+            emit(*node.children[1]);
+            size_t toEnd = append(Instruction::Jump);
+            patch(toElse, here());
+            if (node.children.size() > 2) {
+                emit(*node.children[2]);
+            } else {
+                // No branch taken: the if succeeds
+                append(Instruction::SetStatus, 0);
+            }
+            patch(toEnd, here());
+            break;
+        }
+        case Node::While:
+        case Node::Until:
+        case Node::For:
+            emitLoop(node);
+            break;
+        case Node::Function:
+            emitFunction(node);
+            break;
+    }
+}
+
+void ScriptCompiler::emitCommand(const Node& node) {
+    std::string_view word = source->literal(node.first);
+    if (word == "break" || word == "continue") {
+        emitLoopJump(node, word == "break");
+        return;
+    }
+    if (word == "return") {
+        if (!inFunction) {
+            std::cerr << "MyShell: return: can only be used in a function\n";
+            status = Status::Error;
+            return;
+        }
+        append(Instruction::Return,
+               node.last - node.first > 1 ? addCommand(node.first, node.last) : Program::NONE);
+        return;
+    }
+    append(Instruction::Run, addCommand(node.first, node.last));
+}
+
+void ScriptCompiler::emitLoopJump(const Node& node, bool isBreak) {
+    const char* name = isBreak ? "break" : "continue";
+    if (loops.empty()) {
+        std::cerr << "MyShell: " << name << ": only meaningful in a loop\n";
+        status = Status::Error;
+        return;
+    }
+    
+    // `break N` leaves N loops; the count must be a literal number
+    size_t count = 1;
+    if (node.last - node.first > 1) {
+        std::string_view arg = source->literal(node.first + 1);
+        if (arg.empty() || arg.find_first_not_of("0123456789") != std::string_view::npos) {
+            std::cerr << "MyShell: " << name << ": numeric argument required\n";
+            status = Status::Error;
+            return;
+        }
+        count = std::strtoul(std::string(arg).c_str(), nullptr, 10);
+        if (count == 0) {
+            std::cerr << "MyShell: " << name << ": loop count out of range\n";
+            status = Status::Error;
+            return;
+        }
+    }
+    count = std::min(count, loops.size());
+    
+    if (count > 1) {
+        append(Instruction::Unwind, static_cast<uint32_t>(count - 1));
+    }
+    size_t jump = append(Instruction::Jump);
+    Loop& target = loops[loops.size() - count];
+    (isBreak ? target.breaks : target.continues).push_back(jump);
+}
+
+void ScriptCompiler::emitLoop(const Node& node) {
+    // Layout (while/until; for replaces the condition with ForNext):
+    //       LoopEnter
+    //       LoopInput exit (only with `< file`)
+    // next: <condition>; JumpIfFalse exit
+    //       <body>
+    // cont: LoopKeep; Jump next
+    // brk:  LoopKeep
+    // exit: LoopLeave
+    size_t next;
+    size_t exitJump;
+    size_t input = 0;
+    if (node.kind == Node::For) {
+        append(Instruction::ForEnter,
+               node.hasWords ? addCommand(node.first, node.last) : Program::NONE);
+        if (node.input) {
+            input = append(Instruction::LoopInput, addCommand(node.input, node.input + 1));
+        }
+        next = append(Instruction::ForNext, addName(source->literal(node.name)));
+        exitJump = next;
+    } else {
+        append(Instruction::LoopEnter);
+        if (node.input) {
+            input = append(Instruction::LoopInput, addCommand(node.input, node.input + 1));
+        }
+        next = here();
+        emit(*node.children[0]);
+        exitJump = append(node.kind == Node::While ? Instruction::JumpIfFalse
+                                                   : Instruction::JumpIfTrue);
+    }
+    
+    loops.emplace_back();
+    emit(*node.children.back());
+    size_t keep = append(Instruction::LoopKeep);
+    append(Instruction::Jump, static_cast<uint32_t>(next));
+    size_t broken = append(Instruction::LoopKeep);
+    size_t exit = append(Instruction::LoopLeave);
+    
+    if (node.kind == Node::For) {
+        program->code[exitJump].b = static_cast<uint32_t>(exit);
+    } else {
+        patch(exitJump, exit);
+    }
+    if (input) {
+        program->code[input].b = static_cast<uint32_t>(exit);
+    }
+    for (size_t at : loops.back().breaks) {
+        patch(at, broken);
+    }
+    for (size_t at : loops.back().continues) {
+        patch(at, keep);
+    }
+    loops.pop_back();
+}
+
+void ScriptCompiler::emitFunction(const Node& node) {
+    // The body is compiled in place and jumped over; Define records where
+    // it starts. Loops outside the definition are not the body's loops.
+    size_t skip = append(Instruction::Jump);
+    size_t entry = here();
+    
+    std::vector<Loop> outer;
+    outer.swap(loops);
+    bool wasInFunction = inFunction;
+    inFunction = true;
+    emit(*node.children[0]);
+    append(Instruction::Return, Program::NONE);
+    inFunction = wasInFunction;
+    loops.swap(outer);
+    
+    patch(skip, here());
+    append(Instruction::Define, addName(source->literal(node.name)), static_cast<uint32_t>(entry));
+}
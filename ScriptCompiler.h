@@ -0,0 +1,190 @@
+#ifndef SCRIPT_COMPILER_H
+#define SCRIPT_COMPILER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "CommandParser.h"
+
+/**
+ * One bytecode instruction
+ * The meaning of the operands depends on the operation.
+ */
+struct Instruction {
+    enum Op : uint8_t {
+        Run,            // Expand and run command a; its exit status becomes the status
+        Jump,           // Continue at a
+        JumpIfFalse,    // Continue at a if the status is non-zero
+        JumpIfTrue,     // Continue at a if the status is zero
+        Not,            // Invert the status (zero becomes 1, anything else 0)
+        SetStatus,      // Set the status to a
+        LoopEnter,      // Open a while/until loop
+        LoopInput,      // Read the innermost loop's stdin from the file named by
+                        // command a, or give the loop status 1 and continue at b
+        ForEnter,       // Open a for loop over the words of command a (NONE: "$@")
+        ForNext,        // Assign the next word to variable names[a], or continue at b
+        LoopKeep,       // Remember the status as the innermost loop's result
+        LoopLeave,      // Close the innermost loop; its result becomes the status
+        Unwind,         // Close a loops without touching the status (break/continue N)
+        Define,         // Define function names[a] whose body starts at b
+        Return          // Leave the function; the status comes from command a's
+                        // argument (NONE: keep the status)
+    };
+    
+    Op op;
+    uint32_t a;
+    uint32_t b;
+};
+
+/**
+ * A compiled command line: bytecode plus the command templates it runs
+ * Templates are expanded each time they run, never re-lexed.
+ */
+struct Program {
+    static constexpr uint32_t NONE = UINT32_MAX;
+    
+    std::vector<Instruction> code;
+    std::vector<CommandTemplate> commands;
+    std::vector<std::string> names;     // Loop variables and function names
+    std::vector<uint32_t> hereStart;    // Per command: index of its first here-document body
+    std::vector<std::string> hereBodies;    // Here-document bodies in source order, as
+                                            // read by the shell (compile() keeps them)
+};
+
+/**
+ * ScriptCompiler turns a lexed command line with lists and compound
+ * commands into a Program
+ * Responsibilities:
+ * - Parse the tokens into a syntax tree: ; && || ! lists, if/elif/else,
+ *   while, until, for ... in (with an optional `< file` after done),
+ *   { } groups and function definitions
+ * - Tell a syntax error from input that only needs more lines
+ * - Generate bytecode for the tree, resolving break, continue and return
+ *   to jumps at compile time
+ *
+ * Simple commands and pipelines inside are kept as templates and run as
+ * the shell runs any other command. Here-document bodies are not part of
+ * the tokens; the shell reads them after each line and keeps them in the
+ * Program.
+ */
+class ScriptCompiler {
+public:
+    enum class Status {
+        Ok,
+        Incomplete,     // A compound command or list is still open; add lines
+        Error           // Syntax error (already reported)
+    };
+
+private:
+    /**
+     * A node of the syntax tree
+     */
+    struct Node {
+        enum Kind {
+            Command,    // Simple command or pipeline, tokens [first, last)
+            List,       // Children run one after another
+            AndIf,      // Right child runs if the left one succeeded
+            OrIf,       // Right child runs if the left one failed
+            Not,        // Inverts its child's status
+            If,         // Condition, then-branch, optional else-branch
+            While,      // Condition, body
+            Until,      // Condition, body
+            For,        // Body; variable at token name, words [first, last)
+            Function    // Body; name at token name
+        };
+        
+        Kind kind;
+        std::vector<std::unique_ptr<Node>> children;
+        size_t first;
+        size_t last;
+        size_t name;
+        size_t input;       // Loops: token of the `< file` word (0: none)
+        bool hasWords;      // For: an `in` list was given
+        bool background;    // Command: ends with &
+        
+        explicit Node(Kind nodeKind)
+            : kind(nodeKind), first(0), last(0), name(0), input(0), hasWords(false),
+              background(false) {}
+    };
+    using NodePtr = std::unique_ptr<Node>;
+    
+    /**
+     * Jumps out of a loop being compiled, patched once its end is known
+     */
+    struct Loop {
+        std::vector<size_t> breaks;
+        std::vector<size_t> continues;
+    };
+    
+    const CommandTemplate* source;
+    size_t pos;                 // Next token to parse
+    Status status;
+    Program* program;
+    std::vector<Loop> loops;    // Enclosing loops, innermost last
+    bool inFunction;
+    
+    // Parsing; each returns nullptr once status is no longer Ok
+    NodePtr parseList(unsigned stops);
+    NodePtr parseAndOr();
+    NodePtr parsePipeline();
+    NodePtr parseCommand();
+    NodePtr parseSimple();
+    NodePtr parseIf();
+    NodePtr parseLoop(Node::Kind kind);
+    NodePtr parseFor();
+    NodePtr parseGroup();
+    NodePtr parseFunction(size_t name, bool keyword);
+    
+    /**
+     * Classify the token at index i as a reserved word
+     * @return The keyword, or 0 if it is not one (or i is past the end)
+     */
+    unsigned keyword(size_t i) const;
+    
+    /**
+     * Consume a reserved word that must come next
+     * @return false if it is missing (incomplete or a syntax error)
+     */
+    bool expect(unsigned word);
+    
+    bool atEnd() const { return pos >= source->tokens.size(); }
+    TokenType peek() const { return source->tokens[pos].type; }
+    void skipNewlines();
+    
+    /**
+     * Report a syntax error near the current token (or the end of input,
+     * which only means more lines are needed)
+     * @return nullptr, for returning from parse functions
+     */
+    NodePtr unexpected();
+    
+    NodePtr fail(const std::string& message);
+    
+    // Code generation
+    void emit(const Node& node);
+    void emitCommand(const Node& node);
+    void emitLoopJump(const Node& node, bool isBreak);
+    void emitLoop(const Node& node);
+    void emitFunction(const Node& node);
+    
+    size_t append(Instruction::Op op, uint32_t a = 0, uint32_t b = 0);
+    size_t here() const { return program->code.size(); }
+    void patch(size_t at, size_t target) { program->code[at].a = static_cast<uint32_t>(target); }
+    uint32_t addCommand(size_t first, size_t last);
+    uint32_t addName(std::string_view name);
+
+public:
+    ScriptCompiler();
+    
+    /**
+     * Compile a lexed command line
+     * @param tpl Tokens of one or more complete lines
+     * @param out Receives the program (cleared first)
+     * @return Ok, Incomplete if more lines are needed, or Error
+     */
+    Status compile(const CommandTemplate& tpl, Program& out);
+};
+
+#endif // SCRIPT_COMPILER_H
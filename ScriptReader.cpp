@@ -0,0 +1,105 @@
+#include "ScriptReader.h"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    const size_t CHUNK_SIZE = 64 * 1024;
+}
+
+ScriptReader::ScriptReader() 
+    : fd(-1), data(nullptr), size(0), pos(0), mapped(false), eof(true) {}
+
+ScriptReader::~ScriptReader() {
+    if (mapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+bool ScriptReader::openFile(const std::string& path) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(addr);
+            size = st.st_size;
+            mapped = true;
+            close(fd);
+            fd = -1;
+            return true;
+        }
+    }
+    
+    // Pipes, character devices and empty files are read in chunks instead
+    eof = false;
+    return true;
+}
+
+void ScriptReader::openString(const std::string& text) {
+    buffer = text;
+    data = buffer.data();
+    size = buffer.size();
+    pos = 0;
+}
+
+bool ScriptReader::fill() {
+    if (eof || fd == -1) return false;
+    
+    // Drop the consumed prefix so the buffer only holds the partial line
+    buffer.erase(0, pos);
+    pos = 0;
+    
+    size_t old = buffer.size();
+    buffer.resize(old + CHUNK_SIZE);
+    ssize_t n;
+    do {
+        n = read(fd, &buffer[old], CHUNK_SIZE);
+    } while (n == -1 && errno == EINTR);
+    
+    buffer.resize(old + (n > 0 ? n : 0));
+    data = buffer.data();
+    size = buffer.size();
+    
+    if (n <= 0) {
+        eof = true;
+        return false;
+    }
+    return true;
+}
+
+bool ScriptReader::nextLine(std::string& line) {
+    while (true) {
+        const char* start = data + pos;
+        const char* newline = pos < size 
+            ? static_cast<const char*>(memchr(start, '\n', size - pos)) 
+            : nullptr;
+        
+        if (newline) {
+            line.assign(start, newline - start);
+            pos = newline - data + 1;
+            return true;
+        }
+        
+        if (!fill()) {
+            // Last line without a trailing newline
+            if (pos < size) {
+                line.assign(data + pos, size - pos);
+                pos = size;
+                return true;
+            }
+            return false;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SCRIPT_READER_H
+#define SCRIPT_READER_H
+
+#include <string>
+#include <cstddef>
+
+/**
+ * ScriptReader hands out the lines of a script without per-line syscalls
+ * Responsibilities:
+ * - Map regular files into memory and split them in place
+ * - Read pipes and other non-mappable inputs in large chunks
+ * - Serve an in-memory string (for -c) through the same interface
+ */
+class ScriptReader {
+private:
+    int fd;
+    const char* data;       // Mapped file or in-memory text
+    size_t size;
+    size_t pos;
+    bool mapped;
+    std::string buffer;     // Chunk buffer for non-mappable input or owned text
+    bool eof;
+    
+    /**
+     * Read another chunk from a non-mappable descriptor
+     * @return true if any bytes were added
+     */
+    bool fill();
+
+public:
+    ScriptReader();
+    ~ScriptReader();
+    
+    ScriptReader(const ScriptReader&) = delete;
+    ScriptReader& operator=(const ScriptReader&) = delete;
+    
+    /**
+     * Open a script file, mapping it when possible
+     * @param path The script path
+     * @return true if successful, false if error occurred (errno is set)
+     */
+    bool openFile(const std::string& path);
+    
+    /**
+     * Serve lines from a string instead of a file
+     * @param text The script text
+     */
+    void openString(const std::string& text);
+    
+    /**
+     * Get the next line without its trailing newline
+     * @param line Receives the line
+     * @return false once the input is exhausted
+     */
+    bool nextLine(std::string& line);
+};
+
+#endif // SCRIPT_READER_H
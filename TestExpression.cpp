@@ -0,0 +1,319 @@
+#include "TestExpression.h"
+#include <iostream>
+#include <cerrno>
+#include <cstdlib>
+#include <fnmatch.h>
+#include <regex.h>
+#include <unistd.h>
+
+namespace {
+    /**
+     * Check whether a file's modification time is later than another's
+     */
+    bool modifiedAfter(const struct stat& a, const struct stat& b) {
+        if (a.st_mtim.tv_sec != b.st_mtim.tv_sec) {
+            return a.st_mtim.tv_sec > b.st_mtim.tv_sec;
+        }
+        return a.st_mtim.tv_nsec > b.st_mtim.tv_nsec;
+    }
+}
+
+TestExpression::TestExpression(const ArgList& arguments, size_t first, size_t last, Syntax kind,
+                               CommandParser* arithmetic)
+    : args(arguments), pos(first), end(last), syntax(kind),
+      name(arguments.empty() ? "test" : arguments[0].data()), parser(arithmetic),
+      failed(false), skipping(0), statCount(0) {}
+
+bool TestExpression::fail(std::string_view subject, const char* message) {
+    if (!failed) {
+        std::cerr << "MyShell: " << name << ": ";
+        if (!subject.empty()) {
+            std::cerr << subject << ": ";
+        }
+        std::cerr << message << "\n";
+    }
+    failed = true;
+    return false;
+}
+
+bool TestExpression::isOr(std::string_view word) const {
+    return word == (syntax == Syntax::Test ? "-o" : "||");
+}
+
+bool TestExpression::isAnd(std::string_view word) const {
+    return word == (syntax == Syntax::Test ? "-a" : "&&");
+}
+
+bool TestExpression::isUnaryOperator(std::string_view word) const {
+    if (word.size() != 2 || word[0] != '-') {
+        return false;
+    }
+    // -a is "and" for test, "exists" for [[
+    if (word[1] == 'a') {
+        return syntax == Syntax::DoubleBracket;
+    }
+    return std::string_view("bcdefghknprstuwxzLS").find(word[1]) != std::string_view::npos;
+}
+
+bool TestExpression::isBinaryOperator(std::string_view word) const {
+    static const char* const operators[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"
+    };
+    for (const char* op : operators) {
+        if (word == op) {
+            return true;
+        }
+    }
+    return syntax == Syntax::DoubleBracket && word == "=~";
+}
+
+std::string_view TestExpression::operand(std::string_view raw, std::string& scratch) const {
+    if (syntax == Syntax::Test || raw.find('\\') == std::string_view::npos) {
+        return raw;
+    }
+    scratch.clear();
+    for (size_t i = 0; i < raw.size(); i++) {
+        if (raw[i] == '\\' && i + 1 < raw.size()) {
+            i++;
+        }
+        scratch += raw[i];
+    }
+    return scratch;
+}
+
+bool TestExpression::integer(std::string_view text, int64_t& value) {
+    if (parser) {
+        // [[ operands are arithmetic expressions
+        if (!parser->evaluateArithmetic(text, value)) {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+    
+    // text is NUL-terminated (an argument or a scratch string)
+    const char* start = text.data();
+    while (*start == ' ' || *start == '\t') {
+        start++;
+    }
+    char* stop;
+    errno = 0;
+    long long number = std::strtoll(start, &stop, 10);
+    while (*stop == ' ' || *stop == '\t') {
+        stop++;
+    }
+    if (stop == start || *stop != '\0' || errno == ERANGE) {
+        return fail(text, "integer expression expected");
+    }
+    value = number;
+    return true;
+}
+
+const struct stat* TestExpression::fileStatus(std::string_view raw, const char* path, bool follow) {
+    size_t cached = statCount < STAT_CACHE_SIZE ? statCount : STAT_CACHE_SIZE;
+    for (size_t i = 0; i < cached; i++) {
+        StatEntry& entry = statCache[i];
+        if (entry.follow == follow && entry.path == raw) {
+            return entry.error == 0 ? &entry.info : nullptr;
+        }
+    }
+    
+    StatEntry& entry = statCache[statCount++ % STAT_CACHE_SIZE];
+    entry.path = raw;
+    entry.follow = follow;
+    int result = follow ? stat(path, &entry.info) : lstat(path, &entry.info);
+    entry.error = result == 0 ? 0 : errno;
+    return result == 0 ? &entry.info : nullptr;
+}
+
+bool TestExpression::unary(std::string_view op, std::string_view raw) {
+    if (skipping) {
+        return false;
+    }
+    std::string_view text = operand(raw, leftScratch);
+    
+    switch (op[1]) {
+        case 'z': return text.empty();
+        case 'n': return !text.empty();
+        case 'r': return access(text.data(), R_OK) == 0;
+        case 'w': return access(text.data(), W_OK) == 0;
+        case 'x': return access(text.data(), X_OK) == 0;
+        case 't': {
+            int64_t fd;
+            return integer(text, fd) && fd >= 0 && fd <= INT32_MAX && isatty(static_cast<int>(fd));
+        }
+        default:
+            break;
+    }
+    
+    // Everything else looks at the file's status
+    bool link = op[1] == 'L' || op[1] == 'h';
+    const struct stat* info = fileStatus(raw, text.data(), !link);
+    if (!info) {
+        return false;
+    }
+    switch (op[1]) {
+        case 'a':
+        case 'e': return true;
+        case 'f': return S_ISREG(info->st_mode);
+        case 'd': return S_ISDIR(info->st_mode);
+        case 's': return info->st_size > 0;
+        case 'b': return S_ISBLK(info->st_mode);
+        case 'c': return S_ISCHR(info->st_mode);
+        case 'p': return S_ISFIFO(info->st_mode);
+        case 'S': return S_ISSOCK(info->st_mode);
+        case 'L':
+        case 'h': return S_ISLNK(info->st_mode);
+        case 'g': return (info->st_mode & S_ISGID) != 0;
+        case 'u': return (info->st_mode & S_ISUID) != 0;
+        case 'k': return (info->st_mode & S_ISVTX) != 0;
+    }
+    return false;
+}
+
+bool TestExpression::binary(std::string_view rawLeft, std::string_view op, std::string_view rawRight) {
+    if (skipping) {
+        return false;
+    }
+    
+    // [[ matches the right side of == != =~ as a pattern, escapes intact
+    bool pattern = syntax == Syntax::DoubleBracket &&
+                   (op == "=" || op == "==" || op == "!=" || op == "=~");
+    std::string_view left = operand(rawLeft, leftScratch);
+    std::string_view right = pattern ? rawRight : operand(rawRight, rightScratch);
+    
+    if (op == "=" || op == "==") {
+        return pattern ? fnmatch(right.data(), left.data(), 0) == 0 : left == right;
+    }
+    if (op == "!=") {
+        return pattern ? fnmatch(right.data(), left.data(), 0) != 0 : left != right;
+    }
+    if (op == "=~") {
+        regex_t regex;
+        if (regcomp(&regex, right.data(), REG_EXTENDED | REG_NOSUB) != 0) {
+            return fail(right, "invalid regular expression");
+        }
+        bool matched = regexec(&regex, left.data(), 0, nullptr, 0) == 0;
+        regfree(&regex);
+        return matched;
+    }
+    if (op == "<") {
+        return left < right;
+    }
+    if (op == ">") {
+        return left > right;
+    }
+    
+    if (op == "-nt" || op == "-ot" || op == "-ef") {
+        const struct stat* a = fileStatus(rawLeft, left.data(), true);
+        const struct stat* b = fileStatus(rawRight, right.data(), true);
+        if (op == "-nt") {
+            return a && (!b || modifiedAfter(*a, *b));
+        }
+        if (op == "-ot") {
+            return b && (!a || modifiedAfter(*b, *a));
+        }
+        return a && b && a->st_dev == b->st_dev && a->st_ino == b->st_ino;
+    }
+    
+    // Integer comparisons
+    int64_t l, r;
+    if (!integer(left, l) || !integer(right, r)) {
+        return false;
+    }
+    if (op == "-eq") return l == r;
+    if (op == "-ne") return l != r;
+    if (op == "-lt") return l < r;
+    if (op == "-le") return l <= r;
+    if (op == "-gt") return l > r;
+    return l >= r;
+}
+
+bool TestExpression::parseOr() {
+    bool result = parseAnd();
+    while (!failed && pos < end && isOr(args[pos])) {
+        pos++;
+        // Once true, the rest only has to be parsed
+        skipping += result;
+        bool right = parseAnd();
+        skipping -= result;
+        result = result || right;
+    }
+    return result;
+}
+
+bool TestExpression::parseAnd() {
+    bool result = parseNot();
+    while (!failed && pos < end && isAnd(args[pos])) {
+        pos++;
+        skipping += !result;
+        bool right = parseNot();
+        skipping -= !result;
+        result = result && right;
+    }
+    return result;
+}
+
+bool TestExpression::parseNot() {
+    // `! = x` compares "!", as POSIX has it for three arguments
+    if (pos + 1 < end && args[pos] == "!" &&
+        !(pos + 2 < end && isBinaryOperator(args[pos + 1]))) {
+        pos++;
+        bool result = !parseNot();
+        return skipping ? false : result;
+    }
+    return parsePrimary();
+}
+
+bool TestExpression::parsePrimary() {
+    if (pos >= end) {
+        return fail("", "argument expected");
+    }
+    std::string_view word = args[pos];
+    
+    if (pos + 2 < end && isBinaryOperator(args[pos + 1])) {
+        pos += 3;
+        return binary(word, args[pos - 2], args[pos - 1]);
+    }
+    
+    if (word == "(" && pos + 1 < end) {
+        pos++;
+        bool result = parseOr();
+        if (failed) {
+            return false;
+        }
+        if (pos >= end || args[pos] != ")") {
+            return fail("", "`)' expected");
+        }
+        pos++;
+        return result;
+    }
+    
+    if (isUnaryOperator(word) && pos + 1 < end) {
+        pos += 2;
+        return unary(word, args[pos - 1]);
+    }
+    
+    // A lone word is true if it is not empty
+    pos++;
+    if (syntax == Syntax::DoubleBracket &&
+        (word == "&&" || word == "||" || word == "(" || word == ")" || word == "!")) {
+        return fail(word, "unexpected operator");
+    }
+    return !skipping && !word.empty();
+}
+
+int TestExpression::evaluate() {
+    // No expression at all is false
+    if (pos >= end) {
+        return 1;
+    }
+    bool result = parseOr();
+    if (!failed && pos < end) {
+        fail(args[pos], isBinaryOperator(args[pos]) ? "argument expected" : "unexpected argument");
+    }
+    if (failed) {
+        return 2;
+    }
+    return result ? 0 : 1;
+}
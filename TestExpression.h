@@ -0,0 +1,133 @@
+#ifndef TEST_EXPRESSION_H
+#define TEST_EXPRESSION_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <sys/stat.h>
+#include "CommandParser.h"
+
+/**
+ * TestExpression evaluates the conditions of `test`, `[` and `[[`
+ * Responsibilities:
+ * - Parse the arguments by recursive descent: ! ( ) and -a/-o for test,
+ *   ! ( ) && || for [[
+ * - File tests (-e -f -d -s -r -w -x -L -p -S -b -c -g -u -k -t, and
+ *   -nt -ot -ef), string tests and comparisons, integer comparisons
+ * - [[ only: pattern matching for == and !=, regular expressions for =~,
+ *   and arithmetic operands for the integer comparisons
+ *
+ * Status results are kept for the whole expression, so `-e f && -f f &&
+ * -s f` costs one stat(). Operands skipped by && and || (or -a and -o)
+ * are parsed but not evaluated.
+ *
+ * Inside [[ ]] the lexer escapes quoted pattern characters with a
+ * backslash; operands that are not patterns are unescaped here.
+ */
+class TestExpression {
+public:
+    enum class Syntax {
+        Test,           // test and [
+        DoubleBracket   // [[
+    };
+
+private:
+    /**
+     * A remembered stat() or lstat() result
+     */
+    struct StatEntry {
+        std::string_view path;      // The argument, as given
+        bool follow;                // stat (true) or lstat (false)
+        int error;                  // errno of the call (0: info is valid)
+        struct stat info;
+    };
+    
+    // Paths remembered per expression; older entries are replaced in turn
+    static const size_t STAT_CACHE_SIZE = 4;
+    
+    ArgList args;
+    size_t pos;                 // Next argument to parse
+    size_t end;                 // One past the last argument of the expression
+    Syntax syntax;
+    const char* name;           // Command name for error messages
+    CommandParser* parser;      // Evaluates [[ integer operands
+    bool failed;                // An error was reported
+    unsigned skipping;          // Inside operands && / || do not need
+    StatEntry statCache[STAT_CACHE_SIZE];
+    size_t statCount;
+    std::string leftScratch;    // Unescaped operands
+    std::string rightScratch;
+    
+    bool parseOr();
+    bool parseAnd();
+    bool parseNot();
+    bool parsePrimary();
+    
+    bool isOr(std::string_view word) const;
+    bool isAnd(std::string_view word) const;
+    bool isUnaryOperator(std::string_view word) const;
+    bool isBinaryOperator(std::string_view word) const;
+    
+    /**
+     * Apply a unary operator (-f, -z, ...)
+     * @param op The operator
+     * @param raw The operand as given
+     */
+    bool unary(std::string_view op, std::string_view raw);
+    
+    /**
+     * Apply a binary operator (=, -eq, -nt, ...)
+     */
+    bool binary(std::string_view rawLeft, std::string_view op, std::string_view rawRight);
+    
+    /**
+     * Get a file's status, at most once per path and kind of call
+     * @param raw The path argument as given (the cache key)
+     * @param path The path to pass to the system (NUL-terminated)
+     * @param follow Follow a final symbolic link (stat rather than lstat)
+     * @return The status, or nullptr if the call failed
+     */
+    const struct stat* fileStatus(std::string_view raw, const char* path, bool follow);
+    
+    /**
+     * Get an operand's text: inside [[ ]], with the lexer's escapes removed
+     * @param raw The argument
+     * @param scratch Storage for the unescaped text
+     * @return The text (NUL-terminated)
+     */
+    std::string_view operand(std::string_view raw, std::string& scratch) const;
+    
+    /**
+     * Convert an integer operand
+     * @return false on an invalid operand (reported)
+     */
+    bool integer(std::string_view text, int64_t& value);
+    
+    /**
+     * Report an error; the expression's status becomes 2
+     * @return false, for returning from parse functions
+     */
+    bool fail(std::string_view subject, const char* message);
+
+public:
+    /**
+     * @param arguments The command's arguments
+     * @param first Index of the first argument of the expression
+     * @param last One past its last argument (without ] or ]])
+     * @param kind test/[ or [[ rules
+     * @param arithmetic Parser for [[ integer operands (nullptr: plain integers)
+     */
+    TestExpression(const ArgList& arguments, size_t first, size_t last, Syntax kind,
+                   CommandParser* arithmetic);
+    
+    TestExpression(const TestExpression&) = delete;
+    TestExpression& operator=(const TestExpression&) = delete;
+    
+    /**
+     * Evaluate the expression
+     * @return 0 if true, 1 if false, 2 on an error (already reported)
+     */
+    int evaluate();
+};
+
+#endif // TEST_EXPRESSION_H
@@ -0,0 +1,243 @@
+#include "Tracer.h"
+#include "FdStream.h"
+#include <atomic>
+#include <new>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct Tracer::Ring {
+    struct Event {
+        std::atomic<uint64_t> sequence;     // Index + 1 once the event is complete
+        uint64_t nanos;
+        const char* name;
+        pid_t pid;
+        char phase;
+        char detail[DETAIL_SIZE];
+    };
+    
+    std::atomic<uint64_t> next;             // Index the next event will take
+    std::atomic<uint64_t> flushed;          // Events before this index are in the file
+    std::atomic<uint64_t> dropped;
+    uint64_t origin;                        // Timestamps are written relative to this
+    Event events[CAPACITY];
+};
+
+Tracer::Ring* Tracer::ring = nullptr;
+int Tracer::fileFd = -1;
+std::string Tracer::path;
+pid_t Tracer::shellPid = 0;
+size_t Tracer::written = 0;
+
+namespace {
+    /**
+     * Copy text into a fixed buffer, cutting it at a character boundary
+     * @param dest Buffer of size bytes, always NUL-terminated
+     */
+    void copyDetail(char* dest, size_t size, std::string_view text) {
+        size_t length = text.size();
+        if (length >= size) {
+            // Don't leave half a UTF-8 sequence at the end
+            length = size - 1;
+            while (length > 0 && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80) {
+                length--;
+            }
+        }
+        memcpy(dest, text.data(), length);
+        dest[length] = '\0';
+    }
+    
+    void writeJsonString(std::ostream& out, const char* text) {
+        out << '"';
+        for (const char* p = text; *p; p++) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c == '"' || c == '\\') {
+                out << '\\' << *p;
+            } else if (c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out << escaped;
+            } else {
+                out << *p;
+            }
+        }
+        out << '"';
+    }
+}
+
+uint64_t Tracer::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+bool Tracer::start(const std::string& file) {
+    if (ring) {
+        stop();
+    }
+    
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    
+    // Shared so that children record into the same ring after fork; pages
+    // are only touched as events fill them
+    void* addr = mmap(nullptr, sizeof(Ring), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return false;
+    }
+    
+    static const char header[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    if (write(fd, header, sizeof(header) - 1) != static_cast<ssize_t>(sizeof(header) - 1)) {
+        int err = errno;
+        munmap(addr, sizeof(Ring));
+        close(fd);
+        errno = err;
+        return false;
+    }
+    
+    // `exit` leaves without unwinding, so the file is also finished at exit
+    static bool finishAtExit = false;
+    if (!finishAtExit) {
+        atexit(stop);
+        finishAtExit = true;
+    }
+    
+    ring = new (addr) Ring;
+    ring->next.store(0);
+    ring->flushed.store(0);
+    ring->dropped.store(0);
+    ring->origin = now();
+    fileFd = fd;
+    path = file;
+    shellPid = getpid();
+    written = 0;
+    
+    record(ProcessName, "process_name", "myshell");
+    return true;
+}
+
+void Tracer::stop() {
+    // A forked child exiting before exec must leave the shell's trace alone
+    if (!ring || getpid() != shellPid) {
+        return;
+    }
+    
+    drain(true);
+    
+    char footer[96];
+    int length = snprintf(footer, sizeof(footer), "\n],\"otherData\":{\"dropped\":\"%llu\"}}\n",
+                          static_cast<unsigned long long>(ring->dropped.load()));
+    // Nothing more can be done about a failed write at this point
+    ssize_t ignored = write(fileFd, footer, length);
+    (void)ignored;
+    
+    close(fileFd);
+    munmap(ring, sizeof(Ring));
+    ring = nullptr;
+    fileFd = -1;
+}
+
+void Tracer::record(Phase phase, const char* name, std::string_view detail,
+                    pid_t pid, uint64_t nanos) {
+    if (!ring) {
+        return;
+    }
+    
+    // Claim a slot, unless that would overwrite one not yet flushed
+    uint64_t index = ring->next.load(std::memory_order_relaxed);
+    do {
+        if (index - ring->flushed.load(std::memory_order_acquire) >= CAPACITY) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!ring->next.compare_exchange_weak(index, index + 1, std::memory_order_relaxed));
+    
+    Ring::Event& event = ring->events[index % CAPACITY];
+    event.nanos = nanos ? nanos : now();
+    event.name = name;
+    event.pid = pid ? pid : shellPid;
+    event.phase = phase;
+    copyDetail(event.detail, DETAIL_SIZE, detail);
+    event.sequence.store(index + 1, std::memory_order_release);
+    
+    // A long compound command or parallel run never reaches the flush
+    // between command lines; rather than drop events, the shell flushes
+    // as soon as the ring is half full (getpid only runs past that mark)
+    if (index + 1 - ring->flushed.load(std::memory_order_relaxed) > CAPACITY / 2 &&
+        getpid() == shellPid) {
+        int savedErrno = errno;
+        drain(false);
+        errno = savedErrno;
+    }
+}
+
+void Tracer::drain(bool all) {
+    uint64_t end = ring->next.load(std::memory_order_acquire);
+    uint64_t index = ring->flushed.load(std::memory_order_relaxed);
+    if (index == end) {
+        return;
+    }
+    
+    FdOStream out(fileFd);
+    for (; index < end; index++) {
+        const Ring::Event& event = ring->events[index % CAPACITY];
+        if (event.sequence.load(std::memory_order_acquire) != index + 1) {
+            // Claimed but still being written
+            if (!all) {
+                break;
+            }
+            continue;
+        }
+        
+        // Chrome trace timestamps are microseconds
+        uint64_t relative = event.nanos > ring->origin ? event.nanos - ring->origin : 0;
+        char timestamp[32];
+        snprintf(timestamp, sizeof(timestamp), "%llu.%03llu",
+                 static_cast<unsigned long long>(relative / 1000),
+                 static_cast<unsigned long long>(relative % 1000));
+        
+        out << (written++ > 0 ? ",\n" : "") << "{\"name\":";
+        writeJsonString(out, event.name);
+        out << ",\"ph\":\"" << event.phase << "\",\"ts\":" << timestamp
+            << ",\"pid\":" << event.pid << ",\"tid\":" << event.pid;
+        if (event.phase == Instant) {
+            out << ",\"s\":\"p\"";
+        }
+        if (event.detail[0] != '\0') {
+            out << ",\"args\":{" << (event.phase == ProcessName ? "\"name\":" : "\"detail\":");
+            writeJsonString(out, event.detail);
+            out << "}";
+        }
+        out << "}";
+    }
+    out.flush();
+    
+    // The slots may now be reused
+    ring->flushed.store(index, std::memory_order_release);
+}
+
+void Tracer::flushIfFull() {
+    if (ring && ring->next.load(std::memory_order_relaxed) -
+                ring->flushed.load(std::memory_order_relaxed) > CAPACITY / 2) {
+        drain(false);
+    }
+}
+
+size_t Tracer::getRecorded() {
+    return ring ? ring->next.load(std::memory_order_relaxed) : 0;
+}
+
+size_t Tracer::getDropped() {
+    return ring ? ring->dropped.load(std::memory_order_relaxed) : 0;
+}
@@ -0,0 +1,144 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+/**
+ * Tracer records timestamped events for every phase of running a command
+ * and writes them out as Chrome Trace Event JSON (loadable in Perfetto or
+ * chrome://tracing).
+ * Responsibilities:
+ * - Record events into a fixed-size in-memory ring without locks or
+ *   allocation, from the shell and from forked children before they exec
+ * - Stream recorded events to the trace file as the ring fills, and
+ *   finish the file when tracing stops
+ *
+ * The ring lives in a shared anonymous mapping, so a forked child's events
+ * land in the same buffer as the shell's. Writers claim a slot with a
+ * compare-and-swap on the write position and publish it by storing its
+ * sequence number; when the ring is full, events are dropped and counted
+ * rather than blocking. Only the shell process flushes: between command
+ * lines, and from record() once the ring is half full.
+ *
+ * Tracing is process-wide, so the interface is static. When tracing is
+ * off, recording is a single pointer test.
+ */
+class Tracer {
+public:
+    // Chrome trace event phases
+    enum Phase : char {
+        Begin = 'B',
+        End = 'E',
+        Instant = 'i',
+        ProcessName = 'M'       // Names the process lane after the detail
+    };
+    
+    // Events held before older ones must be flushed
+    static constexpr size_t CAPACITY = 1 << 16;
+    
+    // Longest detail kept with an event; longer text is cut short
+    static constexpr size_t DETAIL_SIZE = 80;
+
+private:
+    struct Ring;
+    
+    static Ring* ring;          // nullptr while tracing is off
+    static int fileFd;
+    static std::string path;
+    static pid_t shellPid;
+    static size_t written;      // Events written to the file so far
+    
+    /**
+     * Write published events to the file
+     * @param all Also skip over slots that were claimed but never
+     *            published (only when no writer can still be running)
+     */
+    static void drain(bool all);
+
+public:
+    /**
+     * Start tracing to a file, finishing any trace already running
+     * @param file Where to write the JSON trace (created or truncated)
+     * @return true if successful, false if the file or buffer could not
+     *         be created (errno is set)
+     */
+    static bool start(const std::string& file);
+    
+    /**
+     * Flush every event and finish the trace file
+     * Also runs at exit; does nothing in a forked child.
+     */
+    static void stop();
+    
+    static bool enabled() { return ring != nullptr; }
+    
+    /**
+     * Record an event if tracing is on
+     * In the shell, this also flushes once the ring is half full; errno
+     * is left alone.
+     * @param phase Kind of event
+     * @param name Event name; must be a string literal (it is stored as a
+     *             pointer, which stays valid in forked children)
+     * @param detail Extra text shown with the event
+     * @param pid Process the event belongs to (0: the shell)
+     * @param nanos Timestamp from now() (0: the current time)
+     */
+    static void record(Phase phase, const char* name, std::string_view detail = std::string_view(),
+                       pid_t pid = 0, uint64_t nanos = 0);
+    
+    /**
+     * Flush if the ring is more than half full
+     * Called between command lines, where it cannot delay a command.
+     */
+    static void flushIfFull();
+    
+    /**
+     * @return Monotonic time in nanoseconds, the clock events are stamped with
+     */
+    static uint64_t now();
+    
+    static const std::string& getPath() { return path; }
+    
+    /**
+     * @return Number of events recorded since tracing started
+     */
+    static size_t getRecorded();
+    
+    /**
+     * @return Number of events dropped because the ring was full
+     */
+    static size_t getDropped();
+};
+
+/**
+ * TraceScope records a Begin event on construction and the matching End
+ * event when it goes out of scope
+ */
+class TraceScope {
+private:
+    const char* name;
+
+public:
+    TraceScope(const char* eventName, std::string_view detail = std::string_view())
+        : name(Tracer::enabled() ? eventName : nullptr) {
+        if (name) {
+            Tracer::record(Tracer::Begin, name, detail);
+        }
+    }
+    
+    ~TraceScope() {
+        // Tracing may have been switched on or off inside the scope
+        if (name && Tracer::enabled()) {
+            Tracer::record(Tracer::End, name);
+        }
+    }
+    
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#endif // TRACER_H
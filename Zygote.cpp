@@ -0,0 +1,536 @@
+#include "Zygote.h"
+#include "CommandExecutor.h"
+#include "IORedirection.h"
+#include "JobTable.h"
+#include "Tracer.h"
+#include <iostream>
+#include <unordered_set>
+#include <string_view>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+namespace {
+    /**
+     * Fixed part of a launch request; NUL-terminated strings follow in
+     * this order: path (if hasPath), argv, environment changes, cwd (if
+     * hasCwd), input file (if hasInputFile), output file (if hasOutputFile)
+     */
+    struct RequestHeader {
+        uint32_t argc;
+        uint32_t envCount;          // "NAME=value" sets NAME, "NAME" unsets it
+        uint8_t hasPath;
+        uint8_t hasCwd;
+        uint8_t hasInputFile;
+        uint8_t hasOutputFile;
+        uint8_t appendOutput;
+        uint8_t hasInputFd;         // Passed descriptors: stdin first, then stdout
+        uint8_t hasOutputFd;
+    };
+    
+    enum ReportType : int32_t { Started, Exited };
+    
+    /**
+     * Message from the helper: the reply to a launch request, or an exit
+     * A child's Started report always comes before its Exited report.
+     */
+    struct Report {
+        int32_t type;
+        pid_t pid;                  // -1 in a Started report: the launch failed
+        int32_t value;              // errno for a failed launch, wait status for an exit
+        struct rusage usage;
+    };
+    
+    // Room for the two descriptors a request can carry, suitably aligned
+    union ControlBuffer {
+        char data[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    };
+    
+    void appendString(std::vector<char>& buffer, std::string_view text) {
+        buffer.insert(buffer.end(), text.begin(), text.end());
+        buffer.push_back('\0');
+    }
+    
+    bool sendReport(int fd, ReportType type, pid_t pid, int value,
+                    const struct rusage* usage = nullptr) {
+        Report report;
+        memset(&report, 0, sizeof(report));
+        report.type = type;
+        report.pid = pid;
+        report.value = value;
+        if (usage) {
+            report.usage = *usage;
+        }
+        ssize_t sent;
+        do {
+            sent = send(fd, &report, sizeof(report), MSG_NOSIGNAL);
+        } while (sent == -1 && errno == EINTR);
+        return sent == static_cast<ssize_t>(sizeof(report));
+    }
+    
+    /**
+     * Start one requested command in the helper
+     * @param data The request, after the header
+     * @param end End of the request
+     * @param fds Descriptors passed with it (closed here)
+     * @param io Redirection handler used in the child
+     * @param childMask Signal mask to restore in the child
+     * @return pid of the child, or -1 with errno set
+     */
+    pid_t launchRequest(const RequestHeader& header, const char* data, const char* end,
+                        int* fds, IORedirection& io, const sigset_t& childMask) {
+        auto next = [&]() -> const char* {
+            const char* text = data;
+            data += strnlen(data, end - data) + 1;
+            return text;
+        };
+        
+        const char* path = header.hasPath ? next() : nullptr;
+        std::vector<char*> argv;
+        for (uint32_t i = 0; i < header.argc; i++) {
+            argv.push_back(const_cast<char*>(next()));
+        }
+        argv.push_back(nullptr);
+        
+        // Environment and directory changes stay in effect for later requests
+        for (uint32_t i = 0; i < header.envCount; i++) {
+            const char* entry = next();
+            const char* equals = strchr(entry, '=');
+            if (equals) {
+                std::string name(entry, equals - entry);
+                setenv(name.c_str(), equals + 1, 1);
+            } else {
+                unsetenv(entry);
+            }
+        }
+        if (header.hasCwd && chdir(next()) == -1) {
+            std::cerr << "MyShell Error: Launch helper cannot change directory: "
+                      << strerror(errno) << "\n";
+        }
+        const char* inputFile = header.hasInputFile ? next() : nullptr;
+        const char* outputFile = header.hasOutputFile ? next() : nullptr;
+        
+        int inputFd = header.hasInputFd ? fds[0] : -1;
+        int outputFd = header.hasOutputFd ? fds[header.hasInputFd ? 1 : 0] : -1;
+        
+        pid_t pid = -1;
+        int err = EINVAL;
+        if (data <= end && argv[0]) {
+            pid = fork();
+            err = errno;
+        }
+        if (pid == 0) {
+            sigprocmask(SIG_SETMASK, &childMask, nullptr);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGPIPE, SIG_DFL);
+            
+            if (!io.setupStream(inputFd, STDIN_FILENO) ||
+                !io.setupStream(outputFd, STDOUT_FILENO) ||
+                (inputFile && !io.setupInputRedirection(inputFile)) ||
+                (outputFile && !io.setupOutputRedirection(outputFile, header.appendOutput))) {
+                _exit(EXIT_FAILURE);
+            }
+            
+            if (path) {
+                execv(path, argv.data());
+            }
+            execvp(argv[0], argv.data());
+            
+            err = errno;
+            std::cerr << "MyShell Error: Command not found or failed to execute '"
+                      << argv[0] << "' (" << strerror(err) << ")\n";
+            _exit(err == ENOENT ? 127 : 126);
+        }
+        
+        if (inputFd != -1) {
+            close(inputFd);
+        }
+        if (outputFd != -1) {
+            close(outputFd);
+        }
+        errno = err;
+        return pid;
+    }
+}
+
+Zygote::Zygote(JobTable* jobTable)
+    : jobs(jobTable), socketFd(-1), helperPid(-1), cwdBuffer(PATH_MAX), environChanged(false) {}
+
+Zygote::~Zygote() {
+    // The helper exits once it sees the socket close
+    if (socketFd != -1) {
+        close(socketFd);
+    }
+}
+
+bool Zygote::start() {
+    if (socketFd != -1) {
+        return true;
+    }
+    
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+        std::cerr << "MyShell Error: Cannot create launch helper socket: "
+                  << strerror(errno) << "\n";
+        return false;
+    }
+    
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == -1) {
+        std::cerr << "MyShell Error: Cannot start launch helper: "
+                  << strerror(errno) << "\n";
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        serve(fds[1]);
+    }
+    
+    close(fds[1]);
+    socketFd = fds[0];
+    helperPid = pid;
+    
+    // The helper starts out with the shell's current environment and directory
+    commitEnvironment();
+    sentCwd = getcwd(cwdBuffer.data(), cwdBuffer.size()) ? cwdBuffer.data() : "";
+    return true;
+}
+
+void Zygote::serve(int fd) {
+    // Ctrl+C and broken pipes are for the commands, not the helper
+    signal(SIGINT, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_DFL);
+    
+    // Exits are picked up through a signalfd alongside requests
+    sigset_t childSignal, childMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &childMask);
+    int signalFd = signalfd(-1, &childSignal, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (signalFd == -1) {
+        _exit(EXIT_FAILURE);
+    }
+    
+    IORedirection io;
+    std::vector<char> buffer(MAX_REQUEST);
+    struct pollfd watched[2] = {{fd, POLLIN, 0}, {signalFd, POLLIN, 0}};
+    
+    for (;;) {
+        if (poll(watched, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        
+        if (watched[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(signalFd, &info, sizeof(info)) > 0) {}
+            
+            int status;
+            struct rusage usage;
+            pid_t pid;
+            while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+                sendReport(fd, Exited, pid, status, &usage);
+            }
+        }
+        
+        if (watched[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            int fds[2] = {-1, -1};
+            ControlBuffer control;
+            struct iovec part = {buffer.data(), buffer.size()};
+            struct msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = &part;
+            message.msg_iovlen = 1;
+            message.msg_control = control.data;
+            message.msg_controllen = sizeof(control.data);
+            
+            ssize_t size = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+            if (size == -1 && errno == EINTR) {
+                continue;
+            }
+            if (size <= 0) {
+                // The shell has gone
+                break;
+            }
+            
+            struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+            if (header && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+                size_t size = std::min(header->cmsg_len - CMSG_LEN(0), sizeof(fds));
+                memcpy(fds, CMSG_DATA(header), size);
+            }
+            
+            pid_t pid = -1;
+            int err = EINVAL;
+            if (static_cast<size_t>(size) >= sizeof(RequestHeader)) {
+                RequestHeader request;
+                memcpy(&request, buffer.data(), sizeof(request));
+                pid = launchRequest(request, buffer.data() + sizeof(request),
+                                    buffer.data() + size, fds, io, childMask);
+                err = errno;
+            } else {
+                for (int passed : fds) {
+                    if (passed != -1) {
+                        close(passed);
+                    }
+                }
+            }
+            sendReport(fd, Started, pid, pid == -1 ? err : 0);
+        }
+    }
+    
+    // Children carry on without us; nobody is left to report to
+    _exit(EXIT_SUCCESS);
+}
+
+uint32_t Zygote::appendEnvironmentChanges() {
+    size_t count = 0;
+    while (environ[count]) {
+        count++;
+    }
+    
+    // export and unset replace entries, so unchanged pointers mean an
+    // unchanged environment
+    environChanged = count != sentEnviron.size() ||
+                     !std::equal(environ, environ + count, sentEnviron.begin());
+    if (!environChanged) {
+        return 0;
+    }
+    
+    uint32_t changes = 0;
+    std::unordered_set<std::string_view> before(sentEntries.begin(), sentEntries.end());
+    std::unordered_set<std::string_view> names;
+    for (size_t i = 0; i < count; i++) {
+        std::string_view entry(environ[i]);
+        names.insert(entry.substr(0, entry.find('=')));
+        if (before.count(entry) == 0) {
+            appendString(request, entry);
+            changes++;
+        }
+    }
+    for (const std::string& entry : sentEntries) {
+        std::string_view name = std::string_view(entry).substr(0, entry.find('='));
+        if (names.count(name) == 0) {
+            appendString(request, name);
+            changes++;
+        }
+    }
+    return changes;
+}
+
+void Zygote::commitEnvironment() {
+    size_t count = 0;
+    while (environ[count]) {
+        count++;
+    }
+    sentEnviron.assign(environ, environ + count);
+    sentEntries.assign(environ, environ + count);
+    environChanged = false;
+}
+
+pid_t Zygote::spawn(const LaunchSpec& spec) {
+    if (socketFd == -1) {
+        errno = ECHILD;
+        return -1;
+    }
+    
+    RequestHeader header;
+    memset(&header, 0, sizeof(header));
+    request.resize(sizeof(header));
+    
+    if (spec.path) {
+        header.hasPath = 1;
+        appendString(request, spec.path);
+    }
+    for (char* const* arg = spec.argv; *arg; arg++) {
+        appendString(request, *arg);
+        header.argc++;
+    }
+    header.envCount = appendEnvironmentChanges();
+    
+    // The helper follows cd only when a launch needs it
+    const char* cwd = getcwd(cwdBuffer.data(), cwdBuffer.size());
+    bool cwdChanged = cwd && sentCwd != cwd;
+    if (cwdChanged) {
+        header.hasCwd = 1;
+        appendString(request, cwd);
+    }
+    if (spec.inputFile) {
+        header.hasInputFile = 1;
+        appendString(request, spec.inputFile);
+    }
+    if (spec.outputFile) {
+        header.hasOutputFile = 1;
+        appendString(request, spec.outputFile);
+    }
+    header.appendOutput = spec.appendOutput;
+    
+    if (request.size() > MAX_REQUEST) {
+        errno = E2BIG;
+        return -1;
+    }
+    
+    int fds[2];
+    int fdCount = 0;
+    if (spec.inputFd != -1) {
+        header.hasInputFd = 1;
+        fds[fdCount++] = spec.inputFd;
+    }
+    if (spec.outputFd != -1) {
+        header.hasOutputFd = 1;
+        fds[fdCount++] = spec.outputFd;
+    }
+    memcpy(request.data(), &header, sizeof(header));
+    
+    ControlBuffer control;
+    struct iovec part = {request.data(), request.size()};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    if (fdCount > 0) {
+        memset(control.data, 0, sizeof(control.data));
+        message.msg_control = control.data;
+        message.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, fdCount * sizeof(int));
+    }
+    
+    ssize_t sent;
+    do {
+        sent = sendmsg(socketFd, &message, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    if (sent == -1) {
+        disconnect();
+        errno = ECHILD;
+        return -1;
+    }
+    
+    if (environChanged) {
+        commitEnvironment();
+    }
+    if (cwdChanged) {
+        sentCwd = cwd;
+    }
+    
+    // Exits may arrive ahead of the reply; they are queued
+    pid_t pid;
+    int result;
+    while ((result = readReport(true, pid)) == 0) {}
+    if (result == -1) {
+        errno = ECHILD;
+        return -1;
+    }
+    
+    if (pid != -1) {
+        live.push_back(pid);
+    }
+    return pid;
+}
+
+int Zygote::readReport(bool block, pid_t& startedPid) {
+    if (socketFd == -1) {
+        return -1;
+    }
+    
+    Report report;
+    ssize_t size;
+    do {
+        size = recv(socketFd, &report, sizeof(report), block ? 0 : MSG_DONTWAIT);
+    } while (size == -1 && errno == EINTR);
+    
+    if (size == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return -1;
+    }
+    if (size != static_cast<ssize_t>(sizeof(report))) {
+        disconnect();
+        return -1;
+    }
+    
+    if (report.type == Started) {
+        startedPid = report.pid;
+        if (report.pid == -1) {
+            errno = report.value;
+        }
+        return 1;
+    }
+    
+    Tracer::record(Tracer::End, "process", std::string_view(), report.pid);
+    pending.push_back(Exit{report.pid, report.value, report.usage});
+    return 0;
+}
+
+void Zygote::routeToJobs() {
+    for (size_t i = 0; i < pending.size();) {
+        if (jobs->recordExit(pending[i].pid, pending[i].status)) {
+            live.erase(std::find(live.begin(), live.end(), pending[i].pid));
+            pending.erase(pending.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void Zygote::disconnect() {
+    std::cerr << "MyShell Error: Launch helper exited; starting commands directly\n";
+    close(socketFd);
+    socketFd = -1;
+    
+    // Processes that have not reported can no longer be waited for
+    live.clear();
+    for (const Exit& exit : pending) {
+        live.push_back(exit.pid);
+    }
+}
+
+pid_t Zygote::wait(pid_t pid, int& status, struct rusage& usage) {
+    for (;;) {
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (pid == -1 || pending[i].pid == pid) {
+                pid_t found = pending[i].pid;
+                status = pending[i].status;
+                usage = pending[i].usage;
+                pending.erase(pending.begin() + i);
+                live.erase(std::find(live.begin(), live.end(), found));
+                return found;
+            }
+        }
+        
+        // Background job processes finishing meanwhile are the job table's
+        if (pid != -1) {
+            routeToJobs();
+        }
+        
+        if (socketFd == -1 || (pid == -1 ? live.empty() : !owns(pid))) {
+            errno = ECHILD;
+            return -1;
+        }
+        
+        pid_t ignored;
+        readReport(true, ignored);
+    }
+}
+
+void Zygote::collect() {
+    pid_t ignored;
+    while (readReport(false, ignored) != -1) {}
+    routeToJobs();
+}
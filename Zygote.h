@@ -0,0 +1,146 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+class JobTable;
+struct LaunchSpec;
+
+/**
+ * Zygote is a small helper process, forked once while the shell is still
+ * small, that starts external commands on the shell's behalf
+ * Responsibilities:
+ * - Send launch requests over a Unix socket: argv, the environment
+ *   changes and working directory since the last request, and the
+ *   descriptors for stdin/stdout (passed with SCM_RIGHTS)
+ * - Collect the helper's exit reports and hand them to whoever waits:
+ *   foreground waits, the job table, or builtins like parallel
+ *
+ * Forking the helper costs the same however large the shell has grown
+ * since (history, variables, buffers), so launch latency stays flat.
+ * Processes started this way are the helper's children, not the shell's,
+ * so they can only be waited for through the helper.
+ */
+class Zygote {
+private:
+    // Longest request sent; launches with more arguments are not
+    // expressible and fall back to the other backends
+    static const size_t MAX_REQUEST = 64 * 1024;
+    
+    /**
+     * An exit reported by the helper that nobody has claimed yet
+     */
+    struct Exit {
+        pid_t pid;
+        int status;
+        struct rusage usage;
+    };
+    
+    JobTable* jobs;
+    int socketFd;                       // Connection to the helper (-1: not running)
+    pid_t helperPid;
+    std::vector<pid_t> live;            // Started through the helper and not yet claimed
+    std::vector<Exit> pending;          // Reported but not yet claimed, oldest first
+    std::vector<char> request;          // Reused request buffer
+    std::vector<char*> sentEnviron;     // environ as of the last request
+    std::vector<std::string> sentEntries;   // Its entries' text, to diff against
+    std::string sentCwd;                // Working directory as of the last request
+    std::vector<char> cwdBuffer;
+    bool environChanged;                // Whether the request being built carries changes
+    
+    /**
+     * Serve launch requests in the helper until the shell goes away
+     * @param fd The helper's end of the socket
+     */
+    [[noreturn]] static void serve(int fd);
+    
+    /**
+     * Append the environment changes since the last request
+     * @return Number of entries added ("NAME=value" sets, "NAME" unsets)
+     */
+    uint32_t appendEnvironmentChanges();
+    
+    /**
+     * Remember the environment a request was sent with
+     */
+    void commitEnvironment();
+    
+    /**
+     * Read one report from the helper
+     * @param block Whether to wait for one
+     * @param startedPid Receives the pid of a launch reply (-1: failed)
+     * @return 1 for a launch reply, 0 for an exit (queued), -1 if nothing
+     *         was available or the helper has gone
+     */
+    int readReport(bool block, pid_t& startedPid);
+    
+    /**
+     * Give queued exits of background job processes to the job table
+     */
+    void routeToJobs();
+    
+    /**
+     * Forget the helper after its socket failed; its children are lost
+     */
+    void disconnect();
+
+public:
+    explicit Zygote(JobTable* jobTable);
+    ~Zygote();
+    
+    Zygote(const Zygote&) = delete;
+    Zygote& operator=(const Zygote&) = delete;
+    
+    /**
+     * Fork the helper process if it is not running
+     * @return true if the helper is running
+     */
+    bool start();
+    
+    bool running() const { return socketFd != -1; }
+    
+    /**
+     * Start a command through the helper
+     * @param spec What to run; closeFd is ignored since the helper only
+     *             holds the descriptors that are passed to it
+     * @return pid of the child, or -1 with errno set (E2BIG if the request
+     *         is too large, ECHILD if the helper is not running)
+     */
+    pid_t spawn(const LaunchSpec& spec);
+    
+    /**
+     * Check whether a process was started through the helper and not yet
+     * waited for
+     * @param pid The process
+     */
+    bool owns(pid_t pid) const { return std::find(live.begin(), live.end(), pid) != live.end(); }
+    
+    /**
+     * Check whether any process started through the helper is unclaimed
+     */
+    bool hasChildren() const { return !live.empty(); }
+    
+    /**
+     * Wait for a process started through the helper
+     * Exits of other processes that arrive meanwhile are kept for later,
+     * or given to the job table if they belong to a background job.
+     * @param pid The process, or -1 for whichever exits first
+     * @param status Receives its raw wait status
+     * @param usage Receives its resource usage
+     * @return The process waited for, or -1 with errno set
+     */
+    pid_t wait(pid_t pid, int& status, struct rusage& usage);
+    
+    /**
+     * Take whatever exits have been reported, without blocking
+     * Background job processes go to the job table; others are kept.
+     */
+    void collect();
+};
+
+#endif // ZYGOTE_H
@@ -0,0 +1,102 @@
+/**
+ * cat throughput benchmark
+ *
+ * Copies a large file with /bin/cat and with the in-shell cat builtin,
+ * which moves data with copy_file_range, splice or sendfile, and reports
+ * GB/s for file-to-file, file-to-pipe and file-to-device copies.
+ *
+ * Usage: bin/cat_bench [megabytes] [runs] [directory]
+ */
+#include "Shell.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+static double timeLine(Shell& shell, const std::string& line, int runs) {
+    double best = 0;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        shell.runCommandString(line);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    long megabytes = argc > 1 ? std::atol(argv[1]) : 2048;
+    int runs = argc > 2 ? std::atoi(argv[2]) : 3;
+    std::string dir = argc > 3 ? argv[3] : (getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    
+    std::string source = dir + "/cat_bench.src";
+    std::string target = dir + "/cat_bench.dst";
+    
+    // Real data rather than a sparse file, so nothing can skip holes
+    int fd = open(source.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        std::cerr << "cat_bench: cannot create " << source << "\n";
+        return 1;
+    }
+    std::vector<char> block(1 << 20);
+    for (size_t i = 0; i < block.size(); i++) {
+        block[i] = static_cast<char>('a' + i % 26);
+    }
+    for (long i = 0; i < megabytes; i++) {
+        if (write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size())) {
+            std::cerr << "cat_bench: write failed\n";
+            close(fd);
+            unlink(source.c_str());
+            return 1;
+        }
+    }
+    close(fd);
+    
+    Shell shell;
+    double gigabytes = megabytes / 1024.0;
+    
+    struct Case {
+        const char* name;
+        std::string external;
+        std::string builtin;
+    };
+    const Case cases[] = {
+        {"file -> file", "/bin/cat " + source + " > " + target, 
+                         "cat " + source + " > " + target},
+        {"file -> pipe", "/bin/cat " + source + " | wc -c > /dev/null", 
+                         "cat " + source + " | wc -c > /dev/null"},
+        {"file -> device", "/bin/cat " + source + " > /dev/null", 
+                           "cat " + source + " > /dev/null"},
+    };
+    
+    std::cout << megabytes << " MiB, best of " << runs << " runs\n\n";
+    std::cout << std::left << std::setw(16) << "copy"
+              << std::right << std::setw(14) << "/bin/cat s"
+              << std::setw(12) << "GB/s"
+              << std::setw(14) << "builtin s"
+              << std::setw(12) << "GB/s"
+              << std::setw(10) << "speedup" << "\n";
+    
+    for (const Case& c : cases) {
+        double external = timeLine(shell, c.external, runs);
+        double builtin = timeLine(shell, c.builtin, runs);
+        
+        std::cout << std::left << std::setw(16) << c.name
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(14) << external
+                  << std::setw(12) << gigabytes / external
+                  << std::setw(14) << builtin
+                  << std::setw(12) << gigabytes / builtin
+                  << std::setprecision(2) << std::setw(9) << external / builtin << "x\n";
+    }
+    
+    unlink(source.c_str());
+    unlink(target.c_str());
+    return 0;
+}
@@ -0,0 +1,254 @@
+/**
+ * Component benchmark suite
+ *
+ * Times the shell's building blocks in isolation and prints one record per
+ * case as JSON (default) or CSV, so results can be stored and compared
+ * between releases. `make bench` runs it and keeps the output.
+ *
+ * Cases:
+ * - parse/...: CommandParser::parse on lines of different shapes
+ * - expand/...: CommandParser::expandVariables with many variables
+ * - exec/...: fork (or spawn) + exec + wait of `true` through execute()
+ * - pipe/...: throughput of a two-stage pipeline through executeWithPipe()
+ * - builtin/...: builtin lookup and dispatch
+ *
+ * Usage: bin/components_bench [--json|--csv] [--min-time seconds] [--filter text]
+ */
+#include "Shell.h"
+#include "FdStream.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+namespace {
+    struct Result {
+        std::string name;
+        unsigned long iterations;
+        double nsPerOp;
+        double bytesPerOp;      // Data moved per operation (0: not a throughput case)
+    };
+    
+    double minSeconds = 0.5;
+    
+    /**
+     * Run body in growing batches until a batch takes at least minSeconds
+     * @param name Case name
+     * @param bytesPerOp Bytes processed per call, for MB/s (0: none)
+     * @param body The operation
+     * @return Timing of the final batch
+     */
+    template <typename Body>
+    Result measure(const std::string& name, double bytesPerOp, Body body) {
+        body();     // Warm up reused buffers and caches
+        
+        unsigned long iterations = 1;
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned long i = 0; i < iterations; i++) {
+                body();
+            }
+            double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            
+            if (seconds >= minSeconds || iterations >= (1UL << 40)) {
+                return Result{name, iterations, seconds * 1e9 / iterations, bytesPerOp};
+            }
+            // Aim a little past the target so the next batch is usually the last
+            double scale = seconds > 0 ? minSeconds * 1.2 / seconds : 100;
+            iterations = static_cast<unsigned long>(iterations * std::min(std::max(scale, 2.0), 100.0));
+        }
+    }
+    
+    std::string jsonEscape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+    
+    void printJson(const std::vector<Result>& results) {
+        struct utsname host;
+        uname(&host);
+        
+        std::cout << "{\n"
+                  << "  \"suite\": \"myshell-components\",\n"
+                  << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+                  << "  \"host\": \"" << jsonEscape(host.nodename) << "\",\n"
+                  << "  \"kernel\": \"" << jsonEscape(host.release) << "\",\n"
+                  << "  \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+                  << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            std::cout << "    {\"name\": \"" << jsonEscape(r.name) << "\""
+                      << ", \"iterations\": " << r.iterations
+                      << std::fixed << std::setprecision(1)
+                      << ", \"ns_per_op\": " << r.nsPerOp
+                      << ", \"ops_per_sec\": " << 1e9 / r.nsPerOp;
+            if (r.bytesPerOp > 0) {
+                std::cout << ", \"mb_per_sec\": " << r.bytesPerOp / r.nsPerOp * 1e3;
+            }
+            std::cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        std::cout << "  ]\n}\n";
+    }
+    
+    void printCsv(const std::vector<Result>& results) {
+        std::cout << "name,iterations,ns_per_op,ops_per_sec,mb_per_sec\n";
+        for (const Result& r : results) {
+            std::cout << r.name << "," << r.iterations
+                      << std::fixed << std::setprecision(1)
+                      << "," << r.nsPerOp << "," << 1e9 / r.nsPerOp << ",";
+            if (r.bytesPerOp > 0) {
+                std::cout << r.bytesPerOp / r.nsPerOp * 1e3;
+            }
+            std::cout << "\n";
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool csv = false;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (std::strcmp(argv[i], "--json") == 0) {
+            csv = false;
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            minSeconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] 
+                      << " [--json|--csv] [--min-time seconds] [--filter text]\n";
+            return 2;
+        }
+    }
+    auto selected = [&filter](const std::string& name) {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    };
+    
+    std::vector<Result> results;
+    
+    // Parser
+    std::map<std::string, std::string> variables;
+    for (int i = 0; i < 1000; i++) {
+        variables["VAR" + std::to_string(i)] = "value_" + std::to_string(i);
+    }
+    CommandParser parser(&variables);
+    ParsedCommand parsed;
+    
+    std::string longLine = "cmd";
+    for (int i = 0; i < 200; i++) {
+        longLine += " argument" + std::to_string(i);
+    }
+    const std::pair<const char*, std::string> lines[] = {
+        {"parse/simple", "ls -la /tmp"},
+        {"parse/redirect", "sort -u < input.txt >> output.txt"},
+        {"parse/pipeline", "cat log | grep -v debug | sort | uniq -c | sort -rn | head -20"},
+        {"parse/quoted", "echo \"hello $VAR1 world\" 'single | quoted' esc\\ aped $VAR2/path"},
+        {"parse/variables", "cmd $VAR1 $VAR2 $VAR3 $VAR4 $VAR5 $VAR6 $VAR7 $VAR8 $VAR9 $VAR10"},
+        {"parse/long", longLine},
+    };
+    for (const auto& line : lines) {
+        if (selected(line.first)) {
+            const std::string& text = line.second;
+            results.push_back(measure(line.first, static_cast<double>(text.size()), 
+                [&]() { parser.parse(text, parsed); }));
+        }
+    }
+    
+    // Variable expansion
+    std::string manyVars;
+    for (int i = 0; i < 100; i++) {
+        manyVars += "/$VAR" + std::to_string(i * 10);
+    }
+    if (selected("expand/100_vars")) {
+        results.push_back(measure("expand/100_vars", static_cast<double>(manyVars.size()), 
+            [&]() { parser.expandVariables(manyVars); }));
+    }
+    if (selected("expand/no_vars")) {
+        const std::string plain(1000, 'x');
+        results.push_back(measure("expand/no_vars", static_cast<double>(plain.size()), 
+            [&]() { parser.expandVariables(plain); }));
+    }
+    
+    // Process launch
+    JobTable jobs;
+    IORedirection io;
+    CommandExecutor executor(&jobs);
+    executor.setIOHandler(&io);
+    
+    ParsedCommand trueCommand;
+    parser.parse("true", trueCommand);
+    const std::pair<const char*, LaunchBackend> backends[] = {
+        {"exec/fork_true", LaunchBackend::Fork},
+        {"exec/spawn_true", LaunchBackend::Spawn},
+    };
+    for (const auto& backend : backends) {
+        if (selected(backend.first)) {
+            executor.setBackend(backend.second);
+            results.push_back(measure(backend.first, 0, [&]() { executor.execute(trueCommand); }));
+        }
+    }
+    executor.setBackend(LaunchBackend::Fork);
+    
+    // Two-stage pipe throughput
+    const long pipeBytes = 64L << 20;
+    ParsedCommand pipeCommand;
+    parser.parse("head -c " + std::to_string(pipeBytes) + " /dev/zero | cat > /dev/null", pipeCommand);
+    const std::pair<const char*, size_t> pipeSizes[] = {
+        {"pipe/two_stage_default", 0},
+        {"pipe/two_stage_1m", 1 << 20},
+    };
+    for (const auto& size : pipeSizes) {
+        if (selected(size.first)) {
+            executor.setPipeCapacity(size.second);
+            results.push_back(measure(size.first, static_cast<double>(pipeBytes), 
+                [&]() { executor.execute(pipeCommand); }));
+        }
+    }
+    executor.setPipeCapacity(0);
+    
+    // Builtin dispatch, writing to /dev/null through the builtin sink
+    Shell shell;
+    BuiltinCommands builtins(&shell);
+    int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    FdOStream nullOut(devNull);
+    ParsedCommand echoCommand;
+    parser.parse("echo hello world", echoCommand);
+    const ArgList& echoArgs = echoCommand.stages[0].args;
+    
+    if (selected("builtin/lookup_hit")) {
+        results.push_back(measure("builtin/lookup_hit", 0, 
+            [&]() { return builtins.isBuiltin("history"); }));
+    }
+    if (selected("builtin/lookup_miss")) {
+        results.push_back(measure("builtin/lookup_miss", 0, 
+            [&]() { return builtins.isBuiltin("grep"); }));
+    }
+    if (selected("builtin/dispatch_echo")) {
+        results.push_back(measure("builtin/dispatch_echo", 0, 
+            [&]() { builtins.execute(echoArgs, std::cin, -1, nullOut, devNull); }));
+    }
+    nullOut.flush();
+    close(devNull);
+    
+    if (csv) {
+        printCsv(results);
+    } else {
+        printJson(results);
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * Command dispatch allocation check
+ *
+ * Counts heap allocations made by the shell process while parsing and
+ * launching commands once the reused buffers have warmed up. Steady-state
+ * dispatch is expected to allocate nothing; with --check the program
+ * exits non-zero if it does, so `make test` catches regressions.
+ *
+ * Usage: bin/dispatch_bench [--check] [iterations]
+ */
+#include "CommandParser.h"
+#include "CommandExecutor.h"
+#include "IORedirection.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static unsigned long allocationCount = 0;
+
+void* operator new(size_t size) {
+    allocationCount++;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char* argv[]) {
+    bool check = argc > 1 && std::strcmp(argv[1], "--check") == 0;
+    int iterations = argc > (check ? 2 : 1) ? std::atoi(argv[check ? 2 : 1]) : 200;
+    
+    std::map<std::string, std::string> variables;
+    variables["NAME"] = "a_value_long_enough_to_need_the_heap";
+    JobTable jobs;
+    CommandParser parser(&variables);
+    IORedirection io;
+    CommandExecutor executor(&jobs);
+    executor.setIOHandler(&io);
+    
+    struct Case {
+        const char* name;
+        const char* line;
+        bool launch;
+    };
+    const Case cases[] = {
+        {"parse", "grep -v --color=never \"$NAME\" 'quoted arg' < /dev/null > /dev/null", false},
+        {"fork", "true first-argument $NAME > /dev/null", true},
+        {"spawn", "true first-argument $NAME > /dev/null", true},
+        {"zygote", "true first-argument $NAME > /dev/null", true},
+        {"pipeline", "true $NAME | cat | cat > /dev/null", true},
+    };
+    
+    std::cout << std::left << std::setw(12) << "case"
+              << std::right << std::setw(14) << "us/command"
+              << std::setw(18) << "allocs/command" << "\n";
+    
+    bool failed = false;
+    for (const Case& c : cases) {
+        std::string line = c.line;
+        ParsedCommand cmd;
+        LaunchBackend backend = LaunchBackend::Fork;
+        if (std::strcmp(c.name, "spawn") == 0) {
+            backend = LaunchBackend::Spawn;
+        } else if (std::strcmp(c.name, "zygote") == 0) {
+            backend = LaunchBackend::Zygote;
+        }
+        executor.setBackend(backend);
+        
+        // Warm up reused buffers and the path cache
+        for (int i = 0; i < 5; i++) {
+            parser.parse(line, cmd);
+            if (c.launch) executor.execute(cmd);
+        }
+        
+        int runs = c.launch ? iterations : iterations * 100;
+        unsigned long before = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < runs; i++) {
+            parser.parse(line, cmd);
+            if (c.launch) executor.execute(cmd);
+        }
+        auto end = std::chrono::steady_clock::now();
+        unsigned long allocations = allocationCount - before;
+        
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << std::left << std::setw(12) << c.name
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << seconds * 1e6 / runs
+                  << std::setw(18) << static_cast<double>(allocations) / runs << "\n";
+        
+        if (allocations != 0) {
+            failed = true;
+        }
+    }
+    
+    if (check && failed) {
+        std::cerr << "dispatch_bench: steady-state dispatch allocated memory\n";
+        return 1;
+    }
+    return 0;
+}
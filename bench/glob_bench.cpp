@@ -0,0 +1,132 @@
+/**
+ * Glob expansion benchmark
+ *
+ * Fills a scratch directory with many empty files and expands patterns
+ * over it through the parser, as a command line would. Expanding the same
+ * pattern over growing prefixes of the directory shows whether the cost
+ * per entry stays flat.
+ *
+ * Usage: bin/glob_bench [entries] [parent-directory]
+ */
+#include "CommandParser.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+    double millisSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::string entryName(size_t i) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "f%07zu.dat", i);
+        return name;
+    }
+
+    /**
+     * Create entries [from, to) in dir
+     */
+    bool fill(const std::string& dir, size_t from, size_t to) {
+        int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dirFd == -1) {
+            return false;
+        }
+        for (size_t i = from; i < to; i++) {
+            int fd = openat(dirFd, entryName(i).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (fd == -1) {
+                close(dirFd);
+                return false;
+            }
+            close(fd);
+        }
+        close(dirFd);
+        return true;
+    }
+
+    void removeAll(const std::string& dir, size_t entries) {
+        int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dirFd != -1) {
+            for (size_t i = 0; i < entries; i++) {
+                unlinkat(dirFd, entryName(i).c_str(), 0);
+            }
+            close(dirFd);
+        }
+        rmdir(dir.c_str());
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t entries = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    std::string parent = argc > 2 ? argv[2] : "/tmp";
+
+    std::string dir = parent + "/glob_bench.XXXXXX";
+    if (!mkdtemp(&dir[0])) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+
+    std::map<std::string, std::string> variables;
+    CommandParser parser(&variables);
+    ParsedCommand cmd;
+
+    std::cout << std::left << std::setw(28) << "pattern"
+              << std::right << std::setw(10) << "entries"
+              << std::setw(10) << "matches"
+              << std::setw(12) << "ms"
+              << std::setw(12) << "ns/entry" << "\n";
+
+    auto run = [&](const std::string& words, size_t size) {
+        std::string line = "echo";
+        std::string label;
+        for (size_t start = 0; start < words.size();) {
+            size_t space = words.find(' ', start);
+            std::string word = words.substr(start, space == std::string::npos ? space : space - start);
+            line += " " + dir + "/" + word;
+            label += (label.empty() ? "" : " ") + word;
+            start = space == std::string::npos ? words.size() : space + 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        parser.parse(line, cmd);
+        double ms = millisSince(start);
+        std::cout << std::left << std::setw(28) << label
+                  << std::right << std::setw(10) << size
+                  << std::setw(10) << cmd.stages[0].args.size() - 1
+                  << std::fixed << std::setprecision(1) << std::setw(12) << ms
+                  << std::setw(12) << ms * 1e6 / size << "\n";
+    };
+
+    // Growing directory: the cost per entry should not grow with it
+    size_t filled = 0;
+    for (size_t size = entries / 8; size <= entries && size > 0; size *= 2) {
+        if (!fill(dir, filled, size)) {
+            std::perror("create");
+            removeAll(dir, size);
+            return 1;
+        }
+        filled = size;
+        run("*", size);
+    }
+    if (filled == 0 && entries > 0) {
+        fill(dir, 0, entries);
+        filled = entries;
+    }
+
+    std::cout << "\n";
+    run("*7.dat", filled);
+    run("f00012*", filled);
+    run("f[0-9]?[13]*5.dat", filled);
+    run("*.nomatch", filled);
+    // Two patterns over one directory read it once
+    run("*1.dat *2.dat", filled);
+
+    removeAll(dir, filled);
+    return 0;
+}
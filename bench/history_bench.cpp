@@ -0,0 +1,105 @@
+/**
+ * History search benchmark
+ *
+ * Fills a history store with synthetic commands and compares indexed
+ * substring search against a linear scan of every entry.
+ *
+ * Usage: bin/history_bench [entries] [queries]
+ */
+#include "HistoryStore.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+namespace {
+    const char* const commands[] = {
+        "git commit -m", "grep -rn", "ls -la", "cd", "make -j8", "docker run --rm",
+        "ssh deploy@host", "kubectl get pods -n", "tail -f", "find . -name",
+        "python3 manage.py", "curl -s https://api.example.com/v1/", "vim", "cat"
+    };
+    const char* const words[] = {
+        "src", "build", "release", "config.yaml", "main.cpp", "logs", "staging",
+        "production", "worker", "scheduler", "report.csv", "backup", "tmp", "node"
+    };
+    
+    double millisSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t entries = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    int queries = argc > 2 ? std::atoi(argv[2]) : 20;
+    
+    std::mt19937 rng(42);
+    HistoryStore history(entries);
+    
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < entries; i++) {
+        std::string line = commands[rng() % (sizeof(commands) / sizeof(commands[0]))];
+        int count = 1 + rng() % 3;
+        for (int w = 0; w < count; w++) {
+            line += ' ';
+            line += words[rng() % (sizeof(words) / sizeof(words[0]))];
+            line += std::to_string(rng() % 10000);
+        }
+        history.add(line);
+    }
+    std::cout << entries << " entries added in " << std::fixed << std::setprecision(1)
+              << millisSince(start) << " ms\n";
+    
+    // The first search builds the index
+    std::vector<size_t> matches;
+    start = std::chrono::steady_clock::now();
+    history.findAll("warmup", matches);
+    std::cout << "index built in " << millisSince(start) << " ms\n\n";
+    
+    std::cout << std::left << std::setw(24) << "pattern"
+              << std::right << std::setw(10) << "matches"
+              << std::setw(14) << "indexed ms"
+              << std::setw(14) << "linear ms"
+              << std::setw(16) << "reverse-i ms" << "\n";
+    
+    const char* patterns[] = {"scheduler1234", "production42", "kubectl get pods",
+                              "report.csv9999", "staging7 ", "zzz-no-match"};
+    for (const char* pattern : patterns) {
+        start = std::chrono::steady_clock::now();
+        for (int q = 0; q < queries; q++) {
+            history.findAll(pattern, matches);
+        }
+        double indexed = millisSince(start) / queries;
+        
+        start = std::chrono::steady_clock::now();
+        size_t linearMatches = 0;
+        for (int q = 0; q < queries; q++) {
+            linearMatches = 0;
+            for (size_t i = 0; i < history.size(); i++) {
+                if (history.at(i).find(pattern) != std::string_view::npos) {
+                    linearMatches++;
+                }
+            }
+        }
+        double linear = millisSince(start) / queries;
+        
+        // Newest match, as an interactive reverse search would show first
+        start = std::chrono::steady_clock::now();
+        for (int q = 0; q < queries; q++) {
+            size_t position = history.size();
+            history.findPrevious(pattern, position);
+        }
+        double reverse = millisSince(start) / queries;
+        
+        std::cout << std::left << std::setw(24) << pattern
+                  << std::right << std::setw(10) << matches.size()
+                  << std::setprecision(3)
+                  << std::setw(14) << indexed
+                  << std::setw(14) << linear
+                  << std::setw(16) << reverse
+                  << (linearMatches != matches.size() ? "  MISMATCH" : "") << "\n";
+    }
+    
+    return 0;
+}
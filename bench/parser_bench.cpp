@@ -0,0 +1,73 @@
+/**
+ * Command line parser benchmark
+ *
+ * Parses very long generated command lines of different shapes and
+ * reports time per line and input throughput.
+ *
+ * Usage: bin/parser_bench [words-per-line] [iterations]
+ */
+#include "CommandParser.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+static std::string makeLine(const std::string& shape, int words) {
+    std::string line = "cmd";
+    for (int i = 0; i < words; i++) {
+        std::string n = std::to_string(i % 100);
+        if (shape == "plain") {
+            line += " argument" + n;
+        } else if (shape == "variables") {
+            line += " $VAR" + n;
+        } else if (shape == "mixed") {
+            line += " pre$VAR" + n + "post";
+        } else if (shape == "quoted") {
+            line += " \"double $VAR" + n + " text\" 'single | text' esc\\ aped";
+        } else if (shape == "pipeline") {
+            line += (i % 10 == 9) ? " |" : " arg" + n;
+        }
+    }
+    return line + " > out.txt";
+}
+
+int main(int argc, char* argv[]) {
+    int words = argc > 1 ? std::atoi(argv[1]) : 10000;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 200;
+    
+    std::map<std::string, std::string> variables;
+    for (int i = 0; i < 100; i++) {
+        variables["VAR" + std::to_string(i)] = "value_of_variable_" + std::to_string(i);
+    }
+    CommandParser parser(&variables);
+    
+    std::cout << words << " words per line, " << iterations << " iterations\n\n";
+    std::cout << std::left << std::setw(12) << "shape"
+              << std::right << std::setw(12) << "bytes"
+              << std::setw(14) << "us/line"
+              << std::setw(12) << "MB/s" << "\n";
+    
+    const char* shapes[] = {"plain", "variables", "mixed", "quoted", "pipeline"};
+    for (const char* shape : shapes) {
+        std::string line = makeLine(shape, words);
+        size_t checksum = 0;
+        ParsedCommand cmd;
+        
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            parser.parse(line, cmd);
+            checksum += cmd.stages.size() + cmd.stages[0].args.size();
+        }
+        auto end = std::chrono::steady_clock::now();
+        
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << std::left << std::setw(12) << shape
+                  << std::right << std::setw(12) << line.size()
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(14) << seconds * 1e6 / iterations
+                  << std::setw(12) << line.size() * iterations / seconds / 1e6;
+        std::cout << (checksum == 0 ? " !" : "") << "\n";
+    }
+    
+    return 0;
+}
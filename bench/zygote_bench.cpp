@@ -0,0 +1,82 @@
+/**
+ * Launch latency as the shell grows: fork vs spawn vs zygote
+ *
+ * Starts the zygote helper while the process is small, then grows the
+ * heap step by step (touching every page, as a long-lived interactive
+ * shell would) and measures launching and waiting for `true` through
+ * CommandExecutor::execute() with each backend. Fork latency grows with
+ * the shell's size; the zygote's should stay flat.
+ *
+ * Usage: bin/zygote_bench [iterations] [max MiB]
+ */
+#include "CommandParser.h"
+#include "CommandExecutor.h"
+#include "IORedirection.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 200;
+    size_t maxMiB = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+
+    std::map<std::string, std::string> variables;
+    JobTable jobs;
+    CommandParser parser(&variables);
+    IORedirection io;
+    CommandExecutor executor(&jobs);
+    executor.setIOHandler(&io);
+
+    // Fork the helper before the heap grows, as the shell does at startup
+    if (!executor.setBackend(LaunchBackend::Zygote)) {
+        return 1;
+    }
+
+    std::string line = "true";
+    ParsedCommand cmd;
+    parser.parse(line, cmd);
+
+    const std::pair<const char*, LaunchBackend> backends[] = {
+        {"fork", LaunchBackend::Fork},
+        {"spawn", LaunchBackend::Spawn},
+        {"zygote", LaunchBackend::Zygote}
+    };
+
+    std::cout << std::left << std::setw(10) << "heap MiB" << std::right;
+    for (const auto& backend : backends) {
+        std::cout << std::setw(14) << (std::string(backend.first) + " us");
+    }
+    std::cout << "\n";
+
+    std::vector<std::vector<char>> heap;
+    size_t heapMiB = 0;
+    for (size_t target = 0; target <= maxMiB; target = target == 0 ? 64 : target * 2) {
+        // Grow in 64 MiB blocks, writing every page so it is really mapped
+        while (heapMiB < target) {
+            heap.emplace_back(64 << 20, 'x');
+            heapMiB += 64;
+        }
+
+        std::cout << std::left << std::setw(10) << heapMiB << std::right;
+        for (const auto& backend : backends) {
+            executor.setBackend(backend.second);
+            for (int i = 0; i < 5; i++) {
+                executor.execute(cmd);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                executor.execute(cmd);
+            }
+            double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            std::cout << std::fixed << std::setprecision(1)
+                      << std::setw(14) << seconds * 1e6 / iterations;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
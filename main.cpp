@@ -1,6 +1,8 @@
 #include "Shell.h"
 #include <iostream>
 #include <exception>
+#include <string>
+#include <vector>
 
 /**
  * MyShell - A Simple Command Line Shell
@@ -14,15 +16,32 @@
  * - Variable expansion ($VAR)
  * - Command history
  * - Job control (jobs, fg)
+ * - Batch mode: myshell -c 'commands' or myshell script.sh [args]
  * 
  * Author: Generated with modular design principles
  * Date: 2025
  */
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
         Shell shell;
-        shell.run();
+        
+        if (argc > 1 && std::string(argv[1]) == "-c") {
+            // Run the given command string and exit
+            if (argc < 3) {
+                std::cerr << "MyShell: -c: option requires an argument\n";
+                return 2;
+            }
+            return shell.runCommandString(argv[2]);
+        }
+        
+        if (argc > 1) {
+            // Run a script file with the remaining arguments as $1, $2, ...
+            std::vector<std::string> scriptArgs(argv + 2, argv + argc);
+            return shell.runScript(argv[1], scriptArgs);
+        }
+        
+        return shell.run();
     } catch (const std::exception& e) {
         std::cerr << "MyShell Fatal Error: " << e.what() << std::endl;
         return 1;
@@ -0,0 +1,132 @@
+/**
+ * Example loadable builtin: checksum
+ *
+ * Prints the CRC-32 (as zlib and `crc32` compute it) and size of each file,
+ * or of the input when no file is given, without starting a process:
+ *
+ *     enable -f bin/plugins/checksum.so checksum
+ *     checksum file...
+ *
+ * With -v NAME the checksum of a single input is stored in the variable
+ * NAME instead of printed.
+ */
+#include "BuiltinPlugin.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" const unsigned myshell_builtin_abi = MYSHELL_BUILTIN_ABI;
+
+namespace {
+    const size_t CHUNK_SIZE = 64 * 1024;
+    
+    /**
+     * Table for the reflected CRC-32 polynomial, one byte at a time
+     */
+    struct CrcTable {
+        uint32_t entries[256];
+        
+        CrcTable() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; bit++) {
+                    crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320u : 0);
+                }
+                entries[i] = crc;
+            }
+        }
+    };
+    
+    const CrcTable crcTable;
+    
+    /**
+     * Checksum everything readable from a descriptor
+     * @return false on a read error (errno is set)
+     */
+    bool checksum(int fd, uint32_t& crc, uint64_t& size) {
+        static char buffer[CHUNK_SIZE];
+        crc = 0xFFFFFFFFu;
+        size = 0;
+        for (;;) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                crc ^= 0xFFFFFFFFu;
+                return n == 0;
+            }
+            for (ssize_t i = 0; i < n; i++) {
+                crc = crcTable.entries[(crc ^ static_cast<unsigned char>(buffer[i])) & 0xFF] ^ (crc >> 8);
+            }
+            size += static_cast<uint64_t>(n);
+        }
+    }
+    
+    void report(const myshell_api* api, const char* subject, const char* message) {
+        char line[512];
+        int length = std::snprintf(line, sizeof(line), "MyShell: checksum: %s: %s\n", subject, message);
+        if (length > 0) {
+            ssize_t written = write(api->err_fd, line, static_cast<size_t>(length));
+            (void)written;
+        }
+    }
+}
+
+extern "C" int checksum_builtin(int argc, char* const* argv, const myshell_api* api) {
+    if (api->abi_version != MYSHELL_BUILTIN_ABI) {
+        return 2;
+    }
+    
+    const char* variable = nullptr;
+    int first = 1;
+    if (argc > 2 && std::strcmp(argv[1], "-v") == 0) {
+        variable = argv[2];
+        first = 3;
+    }
+    if (variable && argc - first > 1) {
+        report(api, "-v", "takes a single input");
+        return 2;
+    }
+    
+    int status = 0;
+    for (int i = first; i < argc || i == first; i++) {
+        const char* path = i < argc ? argv[i] : nullptr;
+        int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : api->in_fd;
+        if (fd == -1) {
+            report(api, path, std::strerror(errno));
+            status = 1;
+            continue;
+        }
+        
+        uint32_t crc;
+        uint64_t size;
+        bool ok = checksum(fd, crc, size);
+        int error = errno;
+        if (path) {
+            close(fd);
+        }
+        if (!ok) {
+            report(api, path ? path : "-", std::strerror(error));
+            status = 1;
+            continue;
+        }
+        
+        char line[4200];
+        if (variable) {
+            std::snprintf(line, sizeof(line), "%08x", crc);
+            api->set_variable(api->context, variable, line);
+            continue;
+        }
+        int length = std::snprintf(line, sizeof(line), "%08x %llu%s%s\n", crc,
+                                   static_cast<unsigned long long>(size), path ? " " : "",
+                                   path ? path : "");
+        if (length > 0 && api->write_out(api->context, line, static_cast<size_t>(length)) != 0) {
+            return 1;
+        }
+    }
+    return status;
+}
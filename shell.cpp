@@ -3,28 +3,117 @@
 #include <algorithm>
 #include <sys/wait.h>
 #include <signal.h>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "FdStream.h"
+#include "Tracer.h"
 
-Shell::Shell() : running(true) {
+namespace {
+    /**
+     * Number of history entries to keep, from HISTSIZE (default 1000)
+     */
+    size_t configuredHistorySize() {
+        const size_t DEFAULT_HISTORY = 1000;
+        const char* value = getenv("HISTSIZE");
+        if (!value) {
+            return DEFAULT_HISTORY;
+        }
+        
+        char* end;
+        unsigned long size = std::strtoul(value, &end, 10);
+        return (*end == '\0' && size > 0) ? size : DEFAULT_HISTORY;
+    }
+    
+    /**
+     * Convert a timeval (CPU time from getrusage) to seconds
+     */
+    double seconds(const struct timeval& tv) {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+    
+    /**
+     * Check whether a word is a variable assignment (NAME=value)
+     * @return Length of the name, or 0 if it is not an assignment
+     */
+    size_t assignmentName(std::string_view word) {
+        size_t equals = word.find('=');
+        if (equals == 0 || equals == std::string_view::npos || 
+            std::isdigit(static_cast<unsigned char>(word[0]))) {
+            return 0;
+        }
+        for (size_t i = 0; i < equals; i++) {
+            if (!std::isalnum(static_cast<unsigned char>(word[i])) && word[i] != '_') {
+                return 0;
+            }
+        }
+        return equals;
+    }
+    
+    /**
+     * Create the pipe a substituted command writes to; neither end is
+     * inherited across exec
+     */
+    bool openCapturePipe(int pipefd[2]) {
+        if (pipe2(pipefd, O_CLOEXEC) == -1) {
+            std::cerr << "MyShell Error: Failed to create pipe: " 
+                      << strerror(errno) << "\n";
+            return false;
+        }
+        return true;
+    }
+}
+
+Shell::Shell() : commandHistory(configuredHistorySize()), running(true), interactive(false), exitStatus(0), timeAll(false),
+                 batchInput(nullptr), substitutionDepth(0), substitutionStatus(-1) {
     // Initialize all components
     parser = std::make_unique<CommandParser>(&shellVariables);
-    executor = std::make_unique<CommandExecutor>(&backgroundProcesses);
+    executor = std::make_unique<CommandExecutor>(&jobs);
     builtins = std::make_unique<BuiltinCommands>(this);
     ioHandler = std::make_unique<IORedirection>();
+    interpreter = std::make_unique<Interpreter>(this);
     
     // Set up cross-component dependencies
     executor->setIOHandler(ioHandler.get());
+    executor->setBuiltins(builtins.get());
+    parser->setAssigner([this](const std::string& name, const std::string& value) {
+        setVariable(name, value);
+    });
+    parser->setSubstituter([this](std::string_view command) {
+        return substitute(command);
+    });
+    
+    // Builtins write into pipes from the shell process; a reader going away
+    // must show up as a write error, not kill the shell
+    signal(SIGPIPE, SIG_IGN);
     
     // Initialize some default shell variables
     shellVariables["PS1"] = "myshell> ";
     shellVariables["USER"] = getenv("USER") ? getenv("USER") : "unknown";
+    shellVariables["?"] = "0";
+    shellVariables["#"] = "0";
     
-    // Ignore SIGINT for the shell process (Ctrl+C should only affect child processes)
-    signal(SIGINT, SIG_IGN);
+    // MYSHELL_TRACE=file traces the whole session, as `trace on file` would
+    const char* traceFile = getenv("MYSHELL_TRACE");
+    if (traceFile && *traceFile && !Tracer::start(traceFile)) {
+        std::cerr << "MyShell: trace: cannot open '" << traceFile << "': " 
+                  << strerror(errno) << "\n";
+    }
 }
 
 Shell::~Shell() {
     // Clean up any remaining background processes
     cleanupBackgroundProcesses();
+    
+    // Finish the trace file so it can be loaded
+    Tracer::stop();
 }
 
 void Shell::printWelcomeMessage() {
@@ -55,38 +144,583 @@ void Shell::printPrompt() {
 }
 
 void Shell::addToHistory(const std::string& command) {
-    if (!command.empty() && command != commandHistory.back()) {
-        commandHistory.push_back(command);
+    // Empty lines and immediate repeats are skipped by the store
+    commandHistory.add(command);
+}
+
+void Shell::openHistoryFile() {
+    // HISTFILE overrides ~/.myshell_history; an empty HISTFILE disables saving
+    std::string path;
+    const char* histFile = getenv("HISTFILE");
+    if (histFile) {
+        path = histFile;
+    } else if (getenv("HOME")) {
+        path = std::string(getenv("HOME")) + "/.myshell_history";
+    }
+    
+    if (!path.empty() && !commandHistory.open(path)) {
+        std::cerr << "MyShell: history: cannot open '" << path << "': " 
+                  << strerror(errno) << "\n";
+    }
+}
+
+void Shell::cleanupBackgroundProcesses() {
+    // Cheap when no child has exited: the job table only waits after SIGCHLD
+    jobs.reap();
+    executor->collectExits();
+    
+    jobs.takeFinished(finishedJobs);
+    for (int id : finishedJobs) {
+        const JobTable::Job* job = jobs.find(id);
+        if (job) {
+            std::cout << "[" << id << "] " << JobTable::statusText(*job) 
+                      << "  " << job->command << "\n";
+            jobs.remove(id);
+        }
+    }
+}
+
+void Shell::executeLine(const std::string& commandLine) {
+    TraceScope trace("line", commandLine);
+    
+    // Syntax errors fail the line like any command, so batch callers see them
+    if (!parser->lex(commandLine, lineTemplate)) {
+        setLastStatus(2);
+        return;
+    }
+    if (!parser->isSimple(lineTemplate)) {
+        executeCompound(commandLine);
+        return;
+    }
+    
+    // A single pipeline is expanded into the reused command storage
+    ParsedCommand& parsed = lineCommand;
+    if (!parser->expand(lineTemplate, parsed)) {
+        failExpansion();
+        return;
+    }
+    
+    // Here-document bodies follow the line even if there is nothing to run
+    if (!parsed.hereDocs.empty()) {
+        TraceScope hereTrace("heredoc");
+        if (!readHereDocuments(parsed)) {
+            return;
+        }
+    }
+    if (parsed.stages[0].args.empty()) {
+        return;
+    }
+    
+    runCommand(parsed);
+}
+
+void Shell::executeCompound(const std::string& commandLine) {
+    auto program = std::make_shared<Program>();
+    compoundText = commandLine;
+    
+    // Bodies of here-documents come right after the line that opened them
+    if (!readHereBodies(lineTemplate, program->hereBodies)) {
+        setLastStatus(2);
+        return;
+    }
+    ScriptCompiler::Status result = compiler.compile(lineTemplate, *program);
+    while (result == ScriptCompiler::Status::Incomplete) {
+        if (!readContinuationLine(bodyLine)) {
+            std::cerr << "MyShell: syntax error: unexpected end of file\n";
+            setLastStatus(2);
+            return;
+        }
+        compoundText += '\n';
+        compoundText += bodyLine;
+        if (!parser->lex(compoundText, lineTemplate) || 
+            !readHereBodies(lineTemplate, program->hereBodies)) {
+            setLastStatus(2);
+            return;
+        }
+        result = compiler.compile(lineTemplate, *program);
+    }
+    
+    if (result == ScriptCompiler::Status::Ok) {
+        interpreter->run(program);
+    } else {
+        setLastStatus(2);
+    }
+}
+
+int Shell::runCommand(ParsedCommand& parsed) {
+    // A line of nothing but assignments and substitutions has the status
+    // of its last substitution
+    int substituted = substitutionStatus == -1 ? 0 : substitutionStatus;
+    substitutionStatus = -1;
+    
+    ArgList& firstArgs = parsed.stages[0].args;
+    if (firstArgs.empty()) {
+        setLastStatus(substituted);
+        return substituted;
+    }
+    
+    // NAME=value words on their own set shell variables
+    if (!parsed.hasPipe() && assignmentName(firstArgs[0]) > 0 &&
+        std::all_of(firstArgs.begin(), firstArgs.end(), 
+                    [](std::string_view word) { return assignmentName(word) > 0; })) {
+        for (std::string_view word : firstArgs) {
+            size_t length = assignmentName(word);
+            setVariable(std::string(word.substr(0, length)), std::string(word.substr(length + 1)));
+        }
+        setLastStatus(substituted);
+        return substituted;
+    }
+    
+    // `time cmd ...` times the rest of the line; other uses of the word
+    // (`time`, `time -a on`) go to the builtin
+    bool timed = timeAll;
+    if (firstArgs[0] == "time" && firstArgs.size() > 1 && firstArgs[1] != "-a") {
+        timed = true;
+        firstArgs = firstArgs.skip(1);
+    }
+    timed = timed && !parsed.background;
+    
+    // Functions run in the shell; builtins and external commands (alone or
+    // in pipelines) all go through the executor. A lone builtin or function
+    // is timed from the shell's own usage
+    bool function = !parsed.hasPipe() && interpreter->hasFunction(firstArgs[0]);
+    bool builtinOnly = !parsed.hasPipe() && (function || builtins->isBuiltin(firstArgs[0]));
+    struct rusage before;
+    auto start = std::chrono::steady_clock::now();
+    if (timed && builtinOnly) {
+        getrusage(RUSAGE_SELF, &before);
+    }
+    
+    int status;
+    if (function) {
+        const PipelineStage& stage = parsed.stages[0];
+        if (parsed.background || !stage.inputFile.empty() || !stage.outputFile.empty() || 
+            stage.hasHereInput()) {
+            std::cerr << "MyShell: " << firstArgs[0] 
+                      << ": functions cannot be redirected or run in the background\n";
+            status = 1;
+        } else {
+            status = interpreter->callFunction(firstArgs);
+        }
+    } else {
+        // A child or cat reading stdin must start where read stopped
+        if (!builtinOnly || builtins->readsDescriptor(firstArgs[0])) {
+            releaseInput();
+        }
+        executor->execute(parsed);
+        status = executor->getLastStatus();
+    }
+    
+    if (timed && builtinOnly) {
+        struct rusage after;
+        getrusage(RUSAGE_SELF, &after);
+        timersub(&after.ru_utime, &before.ru_utime, &after.ru_utime);
+        timersub(&after.ru_stime, &before.ru_stime, &after.ru_stime);
+        reportTimes(parsed, std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count(), after);
+    } else if (timed) {
+        reportTimes(parsed, -1, rusage());
+    }
+    
+    setLastStatus(status);
+    return status;
+}
+
+InputBuffer& Shell::getInput(int fd) {
+    size_t index = static_cast<size_t>(fd);
+    if (inputBuffers.size() <= index) {
+        inputBuffers.resize(index + 1);
+    }
+    if (!inputBuffers[index]) {
+        inputBuffers[index] = std::make_unique<InputBuffer>(fd);
+    }
+    return *inputBuffers[index];
+}
+
+void Shell::releaseInput() {
+    for (const auto& buffer : inputBuffers) {
+        if (buffer && buffer->pending() > 0) {
+            buffer->release();
+        }
+    }
+}
+
+bool Shell::redirectInput(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        std::cerr << "MyShell: " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    
+    // Keep the current stdin above the descriptors commands use
+    int saved = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    if ((saved == -1 && errno != EBADF) || (fd != STDIN_FILENO && dup2(fd, STDIN_FILENO) == -1)) {
+        std::cerr << "MyShell: " << path << ": " << strerror(errno) << "\n";
+        if (saved != -1) {
+            close(saved);
+        }
+        close(fd);
+        return false;
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    
+    getInput(STDIN_FILENO);
+    savedInputs.push_back(SavedInput{saved, std::move(inputBuffers[STDIN_FILENO])});
+    inputBuffers[STDIN_FILENO] = std::make_unique<InputBuffer>(STDIN_FILENO);
+    executor->setInputRedirected(true);
+    return true;
+}
+
+void Shell::restoreInput() {
+    SavedInput& saved = savedInputs.back();
+    if (saved.fd == -1) {
+        close(STDIN_FILENO);
+    } else {
+        dup2(saved.fd, STDIN_FILENO);
+        close(saved.fd);
+    }
+    inputBuffers[STDIN_FILENO] = std::move(saved.buffer);
+    savedInputs.pop_back();
+    executor->setInputRedirected(!savedInputs.empty());
+}
+
+void Shell::setVariable(const std::string& name, const std::string& value) {
+    shellVariables[name] = value;
+    
+    // An exported variable keeps the environment in step
+    if (getenv(name.c_str())) {
+        setenv(name.c_str(), value.c_str(), 1);
+        if (name == "PATH") {
+            executor->getPathCache().clear();
+        }
+    }
+}
+
+const char* Shell::substitute(std::string_view command) {
+    TraceScope trace("substitution", command);
+    
+    if (substitutions.size() <= substitutionDepth) {
+        substitutions.push_back(std::make_unique<Substitution>());
+    }
+    Substitution& sub = *substitutions[substitutionDepth];
+    sub.text.assign(command.data(), command.size());
+    sub.output.clear();
+    if (!parser->lex(sub.text, sub.tpl)) {
+        return nullptr;
+    }
+    
+    // A single command word with no operators or redirections may not need
+    // a copy of the shell
+    const std::vector<Token>& tokens = sub.tpl.tokens;
+    bool plain = !tokens.empty() && parser->isSimple(sub.tpl) &&
+                 std::all_of(tokens.begin(), tokens.end(), 
+                             [](const Token& token) { return token.type == TokenType::Word; });
+    std::string_view name = plain ? sub.tpl.literal(0) : std::string_view();
+    
+    substitutionDepth++;
+    int status = 0;
+    if (!name.empty() && builtins->canCapture(name)) {
+        status = captureBuiltin(sub);
+    } else if (!name.empty() && !builtins->isBuiltin(name) && !interpreter->hasFunction(name) &&
+               assignmentName(name) == 0) {
+        status = captureCommand(sub);
+    } else if (!tokens.empty()) {
+        status = captureSubshell(sub);
+    }
+    substitutionDepth--;
+    
+    size_t end = sub.output.find_last_not_of('\n');
+    sub.output.resize(end == std::string::npos ? 0 : end + 1);
+    
+    substitutionStatus = status;
+    setLastStatus(status);
+    return sub.output.c_str();
+}
+
+int Shell::captureBuiltin(Substitution& sub) {
+    if (!parser->expand(sub.tpl, sub.cmd)) {
+        return 1;
+    }
+    StringOStream out(sub.output);
+    builtins->execute(sub.cmd.stages[0].args, std::cin, -1, out, -1);
+    return builtins->getStatus();
+}
+
+int Shell::captureCommand(Substitution& sub) {
+    if (!parser->expand(sub.tpl, sub.cmd)) {
+        return 1;
+    }
+    const ArgList& args = sub.cmd.stages[0].args;
+    if (args.empty()) {
+        return 0;
+    }
+    
+    int pipefd[2];
+    if (!openCapturePipe(pipefd)) {
+        return 1;
+    }
+    releaseInput();
+    pid_t pid = executor->startCommand(args.argv(), -1, pipefd[1]);
+    close(pipefd[1]);
+    if (pid == -1) {
+        close(pipefd[0]);
+        return 127;
+    }
+    
+    if (!ioHandler->readAll(pipefd[0], sub.output)) {
+        std::cerr << "MyShell Error: Cannot read command output: " << strerror(errno) << "\n";
+    }
+    close(pipefd[0]);
+    return executor->waitCommand(pid);
+}
+
+int Shell::captureSubshell(Substitution& sub) {
+    int pipefd[2];
+    if (!openCapturePipe(pipefd)) {
+        return 1;
+    }
+    
+    // Nothing buffered may be inherited and written twice, or read twice
+    std::cout.flush();
+    releaseInput();
+    pid_t pid = fork();
+    if (pid == -1) {
+        std::cerr << "MyShell Error: Failed to fork process (" << strerror(errno) << ")\n";
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return 1;
+    }
+    
+    if (pid == 0) {
+        // The subshell writes into the pipe; Ctrl+C stops it like a command.
+        // Children of the launch helper would report their exits to the
+        // parent shell, so this copy forks its own.
+        signal(SIGINT, SIG_DFL);
+        interactive = false;
+        close(pipefd[0]);
+        if (!ioHandler->setupStream(pipefd[1], STDOUT_FILENO)) {
+            _exit(1);
+        }
+        executor->setBackend(LaunchBackend::Fork);
+        int status = runTemplate(sub.tpl, sub.cmd);
+        std::cout.flush();
+        _exit(status);
+    }
+    
+    close(pipefd[1]);
+    if (!ioHandler->readAll(pipefd[0], sub.output)) {
+        std::cerr << "MyShell Error: Cannot read command output: " << strerror(errno) << "\n";
+    }
+    close(pipefd[0]);
+    
+    int status;
+    pid_t result;
+    do {
+        result = waitpid(pid, &status, 0);
+    } while (result == -1 && errno == EINTR);
+    return result == -1 ? 1 : CommandExecutor::exitStatus(status);
+}
+
+int Shell::runTemplate(const CommandTemplate& tpl, ParsedCommand& cmd) {
+    if (parser->isSimple(tpl)) {
+        return parser->expand(tpl, cmd) ? runCommand(cmd) : failExpansion();
+    }
+    
+    auto program = std::make_shared<Program>();
+    ScriptCompiler::Status result = compiler.compile(tpl, *program);
+    if (result == ScriptCompiler::Status::Incomplete) {
+        std::cerr << "MyShell: syntax error: unexpected end of file\n";
+    }
+    if (result != ScriptCompiler::Status::Ok) {
+        return 2;
+    }
+    return interpreter->run(program);
+}
+
+bool Shell::readContinuationLine(std::string& line) {
+    if (batchInput) {
+        return batchInput->nextLine(line);
+    }
+    
+    std::cout << "> ";
+    std::cout.flush();
+    return getInput(STDIN_FILENO).nextLine(line);
+}
+
+bool Shell::readHereDocuments(ParsedCommand& cmd) {
+    for (const HereDocument& doc : cmd.hereDocs) {
+        // A body overridden by a later < is still read, but goes nowhere
+        int fd = -1;
+        if (doc.stage != std::string_view::npos) {
+            fd = ioHandler->createHereDocument();
+            if (fd == -1) {
+                return false;
+            }
+            cmd.stages[doc.stage].hereDocFd = fd;
+        }
         
-        // Limit history size to prevent memory bloat
-        const size_t MAX_HISTORY = 1000;
-        if (commandHistory.size() > MAX_HISTORY) {
-            commandHistory.erase(commandHistory.begin());
+        FdOStream body(fd);
+        std::string_view text;
+        while (readHereLine(doc.delimiter, doc.stripTabs, text)) {
+            if (fd != -1) {
+                writeHereLine(body, text, doc.expand);
+            }
         }
     }
+    return true;
 }
 
-void Shell::cleanupBackgroundProcesses() {
-    auto it = backgroundProcesses.begin();
-    while (it != backgroundProcesses.end()) {
-        int status;
-        pid_t result = waitpid(*it, &status, WNOHANG);
+bool Shell::readHereLine(std::string_view delimiter, bool stripTabs, std::string_view& text) {
+    if (!readContinuationLine(bodyLine)) {
+        std::cerr << "MyShell: warning: here-document delimited by end-of-file (wanted '" 
+                  << delimiter << "')\n";
+        return false;
+    }
+    
+    size_t start = 0;
+    if (stripTabs) {
+        start = bodyLine.find_first_not_of('\t');
+        if (start == std::string::npos) {
+            start = bodyLine.size();
+        }
+    }
+    text = std::string_view(bodyLine).substr(start);
+    return text != delimiter;
+}
+
+void Shell::writeHereLine(std::ostream& body, std::string_view text, bool expand) {
+    if (expand && text.find_first_of("$`\\") != std::string_view::npos) {
+        body << parser->expandVariables(std::string(text)) << '\n';
+    } else {
+        body.write(text.data(), text.size());
+        body.put('\n');
+    }
+}
+
+bool Shell::readHereBodies(const CommandTemplate& tpl, std::vector<std::string>& bodies) {
+    size_t seen = 0;
+    for (size_t i = 0; i + 1 < tpl.tokens.size(); i++) {
+        TokenType type = tpl.tokens[i].type;
+        if (type != TokenType::HereDoc && type != TokenType::HereDocStrip) {
+            continue;
+        }
+        if (seen++ < bodies.size()) {
+            continue;
+        }
         
-        if (result > 0) {
-            std::cout << "[Background] Process " << *it << " completed\n";
-            it = backgroundProcesses.erase(it);
-        } else if (result == -1) {
-            // Process doesn't exist anymore
-            it = backgroundProcesses.erase(it);
-        } else {
-            ++it;
+        // The delimiter is expanded as on a simple line
+        std::vector<std::string> words;
+        if (!parser->expandWords(tpl, i + 1, i + 2, words)) {
+            return false;
+        }
+        std::string delimiter = words.empty() ? std::string() : words[0];
+        
+        bodies.emplace_back();
+        std::string_view text;
+        while (readHereLine(delimiter, type == TokenType::HereDocStrip, text)) {
+            bodies.back().append(text).push_back('\n');
+        }
+    }
+    return true;
+}
+
+bool Shell::attachHereDocuments(ParsedCommand& cmd, const Program& program, uint32_t command) {
+    size_t index = program.hereStart[command];
+    for (const HereDocument& doc : cmd.hereDocs) {
+        // Programs compiled from a substitution have no bodies read
+        std::string_view text;
+        if (index < program.hereBodies.size()) {
+            text = program.hereBodies[index];
+        }
+        index++;
+        if (doc.stage == std::string_view::npos) {
+            continue;
+        }
+        
+        int fd = ioHandler->createHereDocument();
+        if (fd == -1) {
+            return false;
+        }
+        cmd.stages[doc.stage].hereDocFd = fd;
+        
+        FdOStream body(fd);
+        while (!text.empty()) {
+            size_t end = std::min(text.find('\n'), text.size());
+            writeHereLine(body, text.substr(0, end), doc.expand);
+            text.remove_prefix(std::min(end + 1, text.size()));
         }
     }
+    return true;
+}
+
+void Shell::reportTimes(const ParsedCommand& cmd, double builtinWallMicros, 
+                        const struct rusage& builtinUsage) {
+    std::cout.flush();
+    std::ostream& out = std::cerr;
+    out << std::fixed << std::setprecision(3);
+    
+    if (builtinWallMicros >= 0) {
+        out << "\nreal\t" << builtinWallMicros / 1e6 << "s\n"
+            << "user\t" << seconds(builtinUsage.ru_utime) << "s\n"
+            << "sys\t" << seconds(builtinUsage.ru_stime) << "s\n";
+        return;
+    }
+    
+    const RunUsage& run = executor->getLastRun();
+    double user = 0, sys = 0;
+    for (const StageUsage& stage : run.stages) {
+        user += seconds(stage.usage.ru_utime);
+        sys += seconds(stage.usage.ru_stime);
+    }
+    out << "\nreal\t" << run.wallMicros / 1e6 << "s\n"
+        << "user\t" << user << "s\n"
+        << "sys\t" << sys << "s\n";
+    
+    // Stages that failed to start have no entry, so only name stages when
+    // every one of them ran
+    bool named = run.stages.size() == cmd.stages.size();
+    for (size_t i = 0; i < run.stages.size(); i++) {
+        const StageUsage& stage = run.stages[i];
+        out << "  " << (named ? cmd.stages[i].args[0] : std::string_view("pid"))
+            << " [" << stage.pid << "]"
+            << "  user " << seconds(stage.usage.ru_utime) << "s"
+            << "  sys " << seconds(stage.usage.ru_stime) << "s"
+            << "  maxrss " << stage.usage.ru_maxrss << " KiB"
+            << "  ctxsw " << stage.usage.ru_nvcsw << " vol/" 
+            << stage.usage.ru_nivcsw << " invol"
+            << "  status " << CommandExecutor::exitStatus(stage.status) << "\n";
+    }
+    out << std::defaultfloat;
+}
+
+int Shell::failExpansion() {
+    if (!parser->failedCheck()) {
+        setLastStatus(2);
+        return 2;
+    }
+    setLastStatus(1);
+    if (!interactive) {
+        shutdown(1);
+    }
+    return 1;
+}
+
+int Shell::shellStatus() {
+    return running ? std::atoi(shellVariables["?"].c_str()) : exitStatus;
 }
 
-void Shell::run() {
+int Shell::run() {
+    // Ignore SIGINT for the shell process (Ctrl+C should only affect child processes)
+    signal(SIGINT, SIG_IGN);
+    
     printWelcomeMessage();
     
+    // Only interactive sessions keep a history file
+    openHistoryFile();
+    interactive = true;
+    
     std::string commandLine;
     
     while (running) {
@@ -96,7 +730,12 @@ void Shell::run() {
         printPrompt();
         
         // Read command line
-        if (!std::getline(std::cin, commandLine)) {
+        bool haveLine;
+        {
+            TraceScope trace("read");
+            haveLine = getInput(STDIN_FILENO).nextLine(commandLine);
+        }
+        if (!haveLine) {
             // EOF reached (Ctrl+D)
             std::cout << "\nGoodbye!\n";
             break;
@@ -110,19 +749,59 @@ void Shell::run() {
         // Add to history
         addToHistory(commandLine);
         
-        // Parse the command
-        ParsedCommand parsed = parser->parse(commandLine);
+        executeLine(commandLine);
+        Tracer::flushIfFull();
+    }
+    return shellStatus();
+}
+
+int Shell::runBatch(ScriptReader& reader) {
+    // Here-document bodies come from the script too
+    batchInput = &reader;
+    
+    // Nobody is watching a prompt, so let cout buffer freely; the executor
+    // flushes it before starting a child so output stays in order
+    std::ios::sync_with_stdio(false);
+    
+    std::string commandLine;
+    
+    while (running && reader.nextLine(commandLine)) {
+        cleanupBackgroundProcesses();
         
-        if (parsed.args.empty()) {
+        // Skip empty lines, comments and the #! line
+        size_t first = commandLine.find_first_not_of(" \t\r");
+        if (first == std::string::npos || commandLine[first] == '#') {
             continue;
         }
         
-        // Check if it's a built-in command
-        if (builtins->isBuiltin(parsed.args[0])) {
-            builtins->execute(parsed.args);
-        } else {
-            // Execute external command
-            executor->execute(parsed);
-        }
+        executeLine(commandLine);
+        Tracer::flushIfFull();
     }
-}
\ No newline at end of file
+    
+    batchInput = nullptr;
+    std::cout.flush();
+    return shellStatus();
+}
+
+int Shell::runCommandString(const std::string& commands) {
+    ScriptReader reader;
+    reader.openString(commands);
+    return runBatch(reader);
+}
+
+int Shell::runScript(const std::string& path, const std::vector<std::string>& args) {
+    ScriptReader reader;
+    if (!reader.openFile(path)) {
+        std::cerr << "MyShell: " << path << ": " << strerror(errno) << "\n";
+        return 127;
+    }
+    
+    // Positional parameters
+    shellVariables["0"] = path;
+    for (size_t i = 0; i < args.size(); i++) {
+        shellVariables[std::to_string(i + 1)] = args[i];
+    }
+    shellVariables["#"] = std::to_string(args.size());
+    
+    return runBatch(reader);
+}
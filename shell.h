@@ -9,6 +9,12 @@
 #include "CommandExecutor.h"
 #include "BuiltinCommands.h"
 #include "IORedirection.h"
+#include "ScriptReader.h"
+#include "InputBuffer.h"
+#include "HistoryStore.h"
+#include "JobTable.h"
+#include "ScriptCompiler.h"
+#include "Interpreter.h"
 
 using namespace std;
 
@@ -19,37 +25,291 @@ using namespace std;
  */
 class Shell {
 private:
+    /**
+     * Storage for one level of command substitution, reused by the next
+     * substitution at the same depth
+     */
+    struct Substitution {
+        string text;                // The command
+        CommandTemplate tpl;
+        ParsedCommand cmd;
+        string output;              // Captured output
+    };
+    
+    /**
+     * stdin as it was before a loop's `< file` replaced it
+     */
+    struct SavedInput {
+        int fd;                             // Copy of the previous stdin (-1: it was closed)
+        unique_ptr<InputBuffer> buffer;     // Its read-ahead
+    };
+    
     unique_ptr<CommandParser> parser;
     unique_ptr<CommandExecutor> executor;
     unique_ptr<BuiltinCommands> builtins;
     unique_ptr<IORedirection> ioHandler;
+    unique_ptr<Interpreter> interpreter;
+    ScriptCompiler compiler;
     
-    vector<string> commandHistory;
+    HistoryStore commandHistory;
     map<string, string> shellVariables;
-    vector<pid_t> backgroundProcesses;
+    JobTable jobs;
+    vector<int> finishedJobs;       // Reused list of jobs to report
+    CommandTemplate lineTemplate;   // Reused for every line so lexing doesn't allocate
+    ParsedCommand lineCommand;      // Reused for every line so parsing doesn't allocate
+    string compoundText;            // Lines of a compound command being read
     bool running;
+    bool interactive;               // Commands are typed at the prompt (not a script, -c or $( ))
+    int exitStatus;                 // Code given to exit, once running is false
+    bool timeAll;                   // Report resource usage after every command
+    ScriptReader* batchInput;       // Source of script lines (nullptr: interactive stdin)
+    string bodyLine;                // Reused buffer for here-document lines
+    vector<unique_ptr<Substitution>> substitutions;     // One per nesting depth
+    size_t substitutionDepth;
+    int substitutionStatus;         // Status of the last $( ) since a command ran (-1: none)
+    vector<unique_ptr<InputBuffer>> inputBuffers;   // Read-ahead per descriptor (index: fd)
+    vector<SavedInput> savedInputs;     // One per loop reading a file, innermost last
     
     void printWelcomeMessage();
     void printPrompt();
     void addToHistory(const string& command);
+    void openHistoryFile();
     void cleanupBackgroundProcesses();
     
+    /**
+     * Parse and run one command line
+     * @param commandLine The raw command line
+     */
+    void executeLine(const string& commandLine);
+    
+    /**
+     * Compile and run a line with lists or compound commands, reading
+     * further lines until every construct it opens is closed
+     * @param commandLine The first line, already lexed into lineTemplate
+     */
+    void executeCompound(const string& commandLine);
+    
+    /**
+     * Run a $( ) or `...` command and capture its output
+     * Builtins that only print run in the shell, writing to memory; a lone
+     * external command is started with its output on a pipe; anything else
+     * runs in a forked copy of the shell. Trailing newlines are removed in
+     * place and $? is set.
+     * @param command The command text
+     * @return The output, valid until the next substitution at the same
+     *         depth, or nullptr on a syntax error (already reported)
+     */
+    const char* substitute(string_view command);
+    
+    /**
+     * Capture a printing builtin's output without leaving the shell
+     * @return The builtin's exit status
+     */
+    int captureBuiltin(Substitution& sub);
+    
+    /**
+     * Capture an external command's output through a pipe
+     * @return The command's exit status
+     */
+    int captureCommand(Substitution& sub);
+    
+    /**
+     * Capture the output of anything else by running it in a subshell
+     * @return The subshell's exit status
+     */
+    int captureSubshell(Substitution& sub);
+    
+    /**
+     * Run a lexed command in this process, compiling it if it needs to be
+     * @param tpl The command; it must be complete
+     * @param cmd Storage for the expanded command
+     * @return Its exit status
+     */
+    int runTemplate(const CommandTemplate& tpl, ParsedCommand& cmd);
+    
+    /**
+     * Read one more input line from wherever command lines come from
+     * @param line Receives the line
+     * @return false at end of input
+     */
+    bool readContinuationLine(string& line);
+    
+    /**
+     * Read the bodies of a command's here-documents into in-memory files
+     * Lines are streamed into the file as they are read.
+     * @param cmd The parsed command; its stages' hereDocFd are set
+     * @return true if successful, false if a file could not be created
+     */
+    bool readHereDocuments(ParsedCommand& cmd);
+    
+    /**
+     * Read the next line of a here-document body into bodyLine
+     * @param delimiter The line that ends the body
+     * @param stripTabs Remove leading tabs (<<-)
+     * @param text Receives the line, without the tabs
+     * @return false at the delimiter, or at end of input (warned about)
+     */
+    bool readHereLine(string_view delimiter, bool stripTabs, string_view& text);
+    
+    /**
+     * Write one line of a here-document body, expanding it unless the
+     * delimiter was quoted
+     */
+    void writeHereLine(ostream& body, string_view text, bool expand);
+    
+    /**
+     * Read the bodies of here-documents in a line of a compound command
+     * Bodies follow the line that opened them, so this runs after every
+     * line is added. Text is kept as read and expanded when the command runs.
+     * @param tpl The lexed lines so far
+     * @param bodies Bodies already read; receives the new ones
+     * @return false if a delimiter could not be expanded
+     */
+    bool readHereBodies(const CommandTemplate& tpl, vector<string>& bodies);
+    
+    /**
+     * Print timing and resource usage of the command just run (to stderr)
+     * @param cmd The command, for naming pipeline stages
+     * @param builtinWallMicros Wall time if a builtin ran instead of a
+     *                          child process (negative: use the executor's report)
+     * @param builtinUsage Shell's own usage during the builtin
+     */
+    void reportTimes(const ParsedCommand& cmd, double builtinWallMicros, 
+                     const struct rusage& builtinUsage);
+    
+    /**
+     * Run every line from a reader without prompts or banner
+     * @param reader Source of script lines
+     * @return Exit status of the shell
+     */
+    int runBatch(ScriptReader& reader);
+    
+    /**
+     * Exit status of the shell: the code given to exit, or else the last
+     * command's ($?)
+     */
+    int shellStatus();
+    
 public:
     Shell();
     ~Shell();
     
-    // Main shell loop
-    void run();
+    /**
+     * Main shell loop (interactive)
+     * @return Exit status of the shell
+     */
+    int run();
+    
+    /**
+     * Run commands given with -c
+     * @param commands One or more newline-separated command lines
+     * @return Exit status of the shell
+     */
+    int runCommandString(const string& commands);
+    
+    /**
+     * Run a script file, making its arguments available as $0, $1, ...
+     * @param path The script file
+     * @param args Positional arguments for the script
+     * @return Exit status of the shell (127 if the script cannot be opened)
+     */
+    int runScript(const string& path, const vector<string>& args);
+    
+    /**
+     * Run one parsed command as the shell does for a typed line: variable
+     * assignments, the `time` prefix, functions, builtins and external
+     * commands; $? is set afterwards
+     * @param cmd The command; an empty command succeeds
+     * @return Its exit status
+     */
+    int runCommand(ParsedCommand& cmd);
+    
+    /**
+     * Set a shell variable, updating the environment too if it is exported
+     * @param name Variable name
+     * @param value New value
+     */
+    void setVariable(const string& name, const string& value);
+    
+    /**
+     * Set $?
+     * @param status Exit status of the last command
+     */
+    void setLastStatus(int status) { shellVariables["?"] = to_string(status); }
+    
+    /**
+     * Set $? for a command that failed to expand: 2, or 1 for a missing
+     * ${NAME:?}, which also ends a non-interactive shell as POSIX requires
+     * @return The status
+     */
+    int failExpansion();
+    
+    /**
+     * Give a compiled command's here-documents their bodies, expanded now
+     * @param cmd The expanded command; its stages' hereDocFd are set
+     * @param program The program holding the bodies
+     * @param command Index of the command in the program
+     * @return true if successful, false if a file could not be created
+     */
+    bool attachHereDocuments(ParsedCommand& cmd, const Program& program, uint32_t command);
+    
+    /**
+     * Get the read-ahead buffer of one of the shell's descriptors
+     * Command lines, read and mapfile all take input through it, so bytes
+     * one of them read ahead are there for the next.
+     * @param fd The descriptor
+     */
+    InputBuffer& getInput(int fd);
+    
+    /**
+     * Give bytes read ahead back to their files before a command that
+     * inherits the descriptors runs
+     */
+    void releaseInput();
+    
+    /**
+     * Make a file the shell's stdin until restoreInput(), for a loop's
+     * `< file`: builtins and commands in the loop read the file, and the
+     * previous stdin keeps what was read ahead from it
+     * @param path The file
+     * @return false if it cannot be opened (already reported)
+     */
+    bool redirectInput(const string& path);
+    
+    /**
+     * Put back the stdin replaced by the latest redirectInput()
+     */
+    void restoreInput();
     
     // Getters for child classes to access shell state
-    const vector<string>& getHistory() const { return commandHistory; }
+    const HistoryStore& getHistory() const { return commandHistory; }
+    HistoryStore& getHistory() { return commandHistory; }
     const map<string, string>& getVariables() const { return shellVariables; }
     map<string, string>& getVariables() { return shellVariables; }
-    vector<pid_t>& getBackgroundProcesses() { return backgroundProcesses; }
+    JobTable& getJobs() { return jobs; }
+    CommandParser& getParser() { return *parser; }
+    Interpreter& getInterpreter() { return *interpreter; }
+    CommandExecutor& getExecutor() { return *executor; }
+    IORedirection& getIOHandler() { return *ioHandler; }
+    
+    /**
+     * Report resource usage after every foreground command, as if each
+     * were prefixed with `time`
+     * @param enabled Whether to report
+     */
+    void setTimeAll(bool enabled) { timeAll = enabled; }
+    bool getTimeAll() const { return timeAll; }
     
-    // Control shell execution
-    void shutdown() { running = false; }
+    /**
+     * Stop reading commands once the current one finishes
+     * @param status Exit status of the shell
+     */
+    void shutdown(int status) {
+        exitStatus = status;
+        running = false;
+    }
     bool isRunning() const { return running; }
+    bool isInteractive() const { return interactive; }
 };
 
 #endif // SHELL_H
\ No newline at end of file